@@ -33,17 +33,57 @@ namespace Plugin {
 	Core::NodeId dns (config.DNS.Value().c_str());
         Core::JSON::ArrayType<Config::Server>::Iterator index (config.Servers.Elements());
 
+        // The leases of every server are kept in a journal of its own, so they survive a restart.
+        string persistentPath (service->PersistentPath());
+        Core::Directory directory (persistentPath.c_str());
+
+        if ((persistentPath.empty() == false) && (directory.CreatePath() == false)) {
+            TRACE(Trace::Error, (_T("Could not create %s, leases are not kept over a restart."), persistentPath.c_str()));
+            persistentPath.clear();
+        }
+
         while (index.Next() == true) {
             if (index.Current().Interface.IsSet() == true) {
+                DHCPServerImplementation::Pool pool;
+
+                pool.Start = index.Current().PoolStart.Value();
+                pool.Size = index.Current().PoolSize.Value();
+                pool.Router = index.Current().Router.Value();
+                pool.Domain = index.Current().Domain.Value();
+                pool.Subnet = index.Current().Subnet.Value();
+
+                if (index.Current().LeaseTime.IsSet() == true) {
+                    pool.LeaseTime = index.Current().LeaseTime.Value();
+                }
+                pool.RenewalTime = index.Current().RenewalTime.Value();
+                pool.RebindingTime = index.Current().RebindingTime.Value();
+
+                Core::JSON::ArrayType<Core::JSON::String>::Iterator routers (index.Current().Routers.Elements());
+                while (routers.Next() == true) {
+                    pool.Routers.push_back(Core::NodeId(routers.Current().Value().c_str()));
+                }
+
+                Core::JSON::ArrayType<Core::JSON::String>::Iterator servers (index.Current().DNS.Elements());
+                while (servers.Next() == true) {
+                    pool.DNS.push_back(Core::NodeId(servers.Current().Value().c_str()));
+                }
+                if ((pool.DNS.empty() == true) && (dns.IsValid() == true)) {
+                    pool.DNS.push_back(dns);
+                }
+
+                Core::JSON::ArrayType<Config::Server::Reservation>::Iterator reservations (index.Current().Reservations.Elements());
+                while (reservations.Next() == true) {
+                    pool.Reservations.push_back(std::pair<string, Core::NodeId>(reservations.Current().Hardware.Value(), Core::NodeId(reservations.Current().Address.Value().c_str())));
+                }
+
                 _servers.emplace(std::piecewise_construct, 
                     std::make_tuple(index.Current().Interface.Value()), 
                     std::make_tuple(
                         config.Name.Value(),
                         index.Current().Interface.Value(),
-                        index.Current().PoolStart.Value(),
-                        index.Current().PoolSize.Value(),
-			index.Current().Router.Value(),
-			dns));
+                        pool,
+                        (persistentPath.empty() == true ? string() : persistentPath + index.Current().Interface.Value() + _T(".leases")),
+                        index.Current().Batch.Value()));
             }
         }
 
@@ -139,6 +139,34 @@ namespace Plugin {
             private:
                 Server& operator=(const Server&) = delete;
 
+            public:
+                class Reservation : public Core::JSON::Container {
+                private:
+                    Reservation& operator= (const Reservation&) = delete;
+
+                public:
+                    Reservation()
+                        : Core::JSON::Container()
+                        , Hardware()
+                        , Address() {
+                        Add(_T("hardware"), &Hardware);
+                        Add(_T("address"), &Address);
+                    }
+                    Reservation(const Reservation& copy)
+                        : Core::JSON::Container()
+                        , Hardware(copy.Hardware)
+                        , Address(copy.Address) {
+                        Add(_T("hardware"), &Hardware);
+                        Add(_T("address"), &Address);
+                    }
+                    virtual ~Reservation() {
+                    }
+
+                public:
+                    Core::JSON::String Hardware; //!< aa:bb:cc:dd:ee:ff
+                    Core::JSON::String Address;
+                };
+
             public:
                 Server () 
                     : Core::JSON::Container()
@@ -146,12 +174,30 @@ namespace Plugin {
                     , PoolStart(0)
                     , PoolSize(0)
                     , Router(0)
-                    , Active(false) {
+                    , Active(false)
+                    , Batch(1)
+                    , LeaseTime(0)
+                    , RenewalTime(0)
+                    , RebindingTime(0)
+                    , Subnet(0)
+                    , Routers()
+                    , DNS()
+                    , Domain()
+                    , Reservations() {
                     Add(_T("interface"), &Interface);
                     Add(_T("poolstart"), &PoolStart);
                     Add(_T("poolsize"), &PoolSize);
                     Add(_T("router"), &Router);
                     Add(_T("active"), &Active);
+                    Add(_T("batch"), &Batch);
+                    Add(_T("leasetime"), &LeaseTime);
+                    Add(_T("renewaltime"), &RenewalTime);
+                    Add(_T("rebindingtime"), &RebindingTime);
+                    Add(_T("subnet"), &Subnet);
+                    Add(_T("routers"), &Routers);
+                    Add(_T("dns"), &DNS);
+                    Add(_T("domain"), &Domain);
+                    Add(_T("reservations"), &Reservations);
                 }
                 Server(const Server& copy) 
                     : Core::JSON::Container()
@@ -159,12 +205,30 @@ namespace Plugin {
                     , PoolStart(copy.PoolStart)
                     , PoolSize(copy.PoolSize)
                     , Router(copy.Router)
-                    , Active(copy.Active) {
+                    , Active(copy.Active)
+                    , Batch(copy.Batch)
+                    , LeaseTime(copy.LeaseTime)
+                    , RenewalTime(copy.RenewalTime)
+                    , RebindingTime(copy.RebindingTime)
+                    , Subnet(copy.Subnet)
+                    , Routers(copy.Routers)
+                    , DNS(copy.DNS)
+                    , Domain(copy.Domain)
+                    , Reservations(copy.Reservations) {
                     Add(_T("interface"), &Interface);
                     Add(_T("poolstart"), &PoolStart);
                     Add(_T("poolsize"), &PoolSize);
                     Add(_T("router"), &Router);
                     Add(_T("active"), &Active);
+                    Add(_T("batch"), &Batch);
+                    Add(_T("leasetime"), &LeaseTime);
+                    Add(_T("renewaltime"), &RenewalTime);
+                    Add(_T("rebindingtime"), &RebindingTime);
+                    Add(_T("subnet"), &Subnet);
+                    Add(_T("routers"), &Routers);
+                    Add(_T("dns"), &DNS);
+                    Add(_T("domain"), &Domain);
+                    Add(_T("reservations"), &Reservations);
                 }
                 virtual ~Server() {
                 }
@@ -175,6 +239,15 @@ namespace Plugin {
                 Core::JSON::DecUInt32 PoolSize;
                 Core::JSON::DecUInt32 Router;
                 Core::JSON::Boolean Active;
+                Core::JSON::DecUInt8 Batch; //!< Requests read and answered in one go, 1 is one at a time.
+                Core::JSON::DecUInt32 LeaseTime; //!< In seconds, a day if not set.
+                Core::JSON::DecUInt32 RenewalTime; //!< T1 in seconds, half of the lease time if not set.
+                Core::JSON::DecUInt32 RebindingTime; //!< T2 in seconds, 7/8 of the lease time if not set.
+                Core::JSON::DecUInt8 Subnet; //!< Bits in the subnet mask, that of the interface if not set.
+                Core::JSON::ArrayType<Core::JSON::String> Routers; //!< Instead of router.
+                Core::JSON::ArrayType<Core::JSON::String> DNS; //!< Instead of the dns of all servers.
+                Core::JSON::String Domain;
+                Core::JSON::ArrayType<Reservation> Reservations;
             };
 
         public:
@@ -25,37 +25,173 @@ namespace WPEFramework {
                 if ( (result == Core::ERROR_NONE) && (SocketDatagram::Broadcast(true) == false) ) {
                     result = Core::ERROR_BAD_REQUEST;
                 }
-                else {
+                else if (result == Core::ERROR_NONE) {
                     _server = static_cast<const Core::NodeId::SocketInfo&>(selectedNode).IPV4Socket.sin_addr.s_addr;
 
                     // Now lets define the under and upper marker of the dhcp server address pool.
-                    uint32_t mask    = (0xFFFFFFFF >> selectedNode.Mask());
+                    const uint8_t bits = ((_pool.Subnet != 0) && (_pool.Subnet <= 32) ? _pool.Subnet : selectedNode.Mask());
+                    uint32_t mask    = (bits >= 32 ? 0 : (0xFFFFFFFF >> bits));
                     uint32_t address = ntohl(_server);
 
-			        _minAddress = ((address & (~mask)) + (_poolStart & mask));
-			        _maxAddress = ((address & (~mask)) + ((_poolStart + _poolSize) & mask));
+			        _minAddress = ((address & (~mask)) + (_pool.Start & mask));
+			        _maxAddress = ((address & (~mask)) + ((_pool.Start + _pool.Size) & mask));
 			        _lastIssued = _minAddress;
 
-					if (_router != static_cast<uint32_t>(~0)) {
-                        if (_router == 0) {
-							_router = address;
-                        }
-                        else {
-			                _router = ((address & (~mask)) + (_router & mask));
-					    }
-					}
-					if (_dns == static_cast<uint32_t>(~0)) {
-						_dns = address;
-					}
+			        _leases.Lock();
+			        _compacting = false;
+			        _leases.Reset(_minAddress, (_maxAddress > _minAddress ? _maxAddress - _minAddress : 0));
+
+			        Compile(address, mask);
+
+			        if (_journalName.empty() == false) {
+			            // Pick up the leases handed out before the restart, what ran out in the mean time is dropped
+			            // and the journal starts over with only what is left. Reservations come from the configuration.
+			            auto replay = [this](const LeaseJournal::type kind, const uint32_t address, const uint64_t expiration, const uint8_t id[], const uint8_t length) {
+			                if ((kind == LeaseJournal::LEASE) && (expiration != Permanent)) {
+			                    _leases.Restore(Identifier(id, length), address, expiration);
+			                }
+			                else if (kind == LeaseJournal::RELEASE) {
+			                    _leases.Remove(Identifier(id, length));
+			                }
+			            };
+
+			            LeaseJournal::Replay(_journalName, replay);
+
+			            _leases.Reclaim(Core::Time::Now().Ticks());
+			        }
+
+			        Reserve();
+
+			        if (_journalName.empty() == false) {
+			            Iterator index(_leases);
+			            _journal.Compact(_journalName, index);
+			        }
+
+			        _leases.Unlock();
                 }
 			}
 
 			return (result);
 		}
 		uint32_t DHCPServerImplementation::Close() {
-			return (SocketDatagram::Close(Core::infinite));
+			uint32_t result = SocketDatagram::Close(Core::infinite);
+
+			// A compaction that is running, has to finish before the journal is closed.
+			PluginHost::WorkerPool::Instance().Revoke(_job);
+
+			_leases.Lock();
+			_journal.Close();
+			_leases.Unlock();
+
+			return (result);
+		}
+
+
+		// Puts the options handed out with every address in the template, once, the answers copy them.
+		void DHCPServerImplementation::Compile(const uint32_t address, const uint32_t mask) {
+
+			std::list<uint32_t> routers;
+			std::list<uint32_t> dns;
+
+			_template.Clear(_serverName, _server);
+
+			// RFC 2131 section 4.4.5, T1 defaults to half of the lease time and T2 to 7/8 of it.
+			_leaseTime = (_pool.LeaseTime == 0 ? DefaultLeaseTime : (_pool.LeaseTime > MaxLeaseTime ? MaxLeaseTime : _pool.LeaseTime));
+
+			const uint32_t renewal = ((_pool.RenewalTime != 0) && (_pool.RenewalTime < _leaseTime) ? _pool.RenewalTime : (_leaseTime / 2));
+			const uint32_t rebinding = ((_pool.RebindingTime > renewal) && (_pool.RebindingTime < _leaseTime) ? _pool.RebindingTime : (_leaseTime - (_leaseTime / 8)));
+
+			for (std::list<Core::NodeId>::const_iterator index(_pool.Routers.begin()); index != _pool.Routers.end(); index++) {
+				if (index->Type() == Core::NodeId::TYPE_IPV4) {
+					routers.push_back(ntohl(static_cast<const Core::NodeId::SocketInfo&>(*index).IPV4Socket.sin_addr.s_addr));
+				}
+			}
+			if ((routers.empty() == true) && (_pool.Router != static_cast<uint32_t>(~0))) {
+				routers.push_back(_pool.Router == 0 ? address : ((address & (~mask)) + (_pool.Router & mask)));
+			}
+			_router = (routers.empty() == true ? static_cast<uint32_t>(~0) : routers.front());
+
+			for (std::list<Core::NodeId>::const_iterator index(_pool.DNS.begin()); index != _pool.DNS.end(); index++) {
+				if (index->Type() == Core::NodeId::TYPE_IPV4) {
+					dns.push_back(ntohl(static_cast<const Core::NodeId::SocketInfo&>(*index).IPV4Socket.sin_addr.s_addr));
+				}
+			}
+			if (dns.empty() == true) {
+				dns.push_back(address);
+			}
+
+			// RFC 2132 sections 3.3, 3.5, 3.8, 3.17, 5.3, 9.2, 9.11 and 9.12
+			bool fits = (_template.Add(OPTION_IPADDRESSLEASETIME, _leaseTime) == true) &&
+			            (_template.Add(OPTION_RENEWALTIME, renewal) == true) &&
+			            (_template.Add(OPTION_REBINDINGTIME, rebinding) == true) &&
+			            (_template.Add(OPTION_SUBNETMASK, ~mask) == true) &&
+			            (_template.Add(OPTION_BROADCASTADDRESS, (address | mask)) == true) &&
+			            ((routers.empty() == true) || (_template.Add(OPTION_ROUTER, routers) == true)) &&
+			            (_template.Add(OPTION_DNS, dns) == true);
+
+			if ((fits == true) && (_pool.Domain.empty() == false)) {
+				fits = (_pool.Domain.length() <= 255) &&
+				       (_template.Add(OPTION_DOMAINNAME, reinterpret_cast<const uint8_t*>(_pool.Domain.c_str()), static_cast<uint8_t>(_pool.Domain.length())) == true);
+			}
+
+			if (fits == false) {
+				TRACE(Trace::Error, (_T("The options of the pool on %s do not fit in an answer, some are left out."), _interfaceName.c_str()));
+			}
+		}
+
+		// The hardware address of a reserved client identifies it as the client hardware address (chaddr) of the
+		// request, or as a client identifier option of the Ethernet type (RFC 2132 section 9.14). Its address is
+		// taken out of the pool, if it is in there.
+		void DHCPServerImplementation::Reserve() {
+
+			_reservations.clear();
+
+			for (std::list< std::pair<string, Core::NodeId> >::const_iterator index(_pool.Reservations.begin()); index != _pool.Reservations.end(); index++) {
+				uint8_t hardware[MaxHWLength + 1];
+
+				::memset(hardware, 0, sizeof(hardware));
+
+				if ((index->second.Type() != Core::NodeId::TYPE_IPV4) || (Hardware(index->first, &(hardware[1])) == false)) {
+					TRACE(Trace::Error, (_T("Reservation of %s on %s is invalid."), index->first.c_str(), _interfaceName.c_str()));
+				}
+				else {
+					const uint32_t address = ntohl(static_cast<const Core::NodeId::SocketInfo&>(index->second).IPV4Socket.sin_addr.s_addr);
+					const Identifier chaddr(&(hardware[1]), MaxHWLength);
+
+					hardware[0] = 1;
+
+					_reservations[chaddr] = address;
+					_reservations[Identifier(hardware, 7)] = address;
+
+					_leases.Restore(chaddr, address, Permanent);
+				}
+			}
 		}
 
+		// Six hexadecimal bytes, separated by a colon or a dash.
+		/* static */ bool DHCPServerImplementation::Hardware(const string& text, uint8_t address[6]) {
+			uint8_t index = 0;
+			uint8_t digits = 0;
+
+			for (string::const_iterator entry(text.begin()); (entry != text.end()) && (index < 6); entry++) {
+				const TCHAR c = *entry;
+
+				if ((c == ':') || (c == '-')) {
+					index += (digits != 0 ? 1 : 6);
+					digits = 0;
+				}
+				else if ((isxdigit(c) != 0) && (digits < 2)) {
+					address[index] = (address[index] << 4) | static_cast<uint8_t>(isdigit(c) ? (c - '0') : ((tolower(c) - 'a') + 10));
+					digits++;
+				}
+				else {
+					index = 6;
+					digits = 0;
+				}
+			}
+
+			return ((index == 5) && (digits != 0));
+		}
 
 		/* static */ Core::ProxyPoolType<DHCPServerImplementation::Response> DHCPServerImplementation::_responseFactory(2);
 	}
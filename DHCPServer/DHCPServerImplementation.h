@@ -2,6 +2,13 @@
 #define __DHCPSERVERIMPLEMENTATION_H__
 
 #include "Module.h"
+#include "LeaseJournal.h"
+
+#include <unordered_map>
+
+#ifndef __WIN32__
+#include <sys/socket.h>
+#endif
 
 namespace WPEFramework {
 
@@ -29,6 +36,7 @@ namespace WPEFramework {
 				OPTION_ROUTER = 3,
 				OPTION_DNS = 6,
 				OPTION_HOSTNAME = 12,
+				OPTION_DOMAINNAME = 15,
                 OPTION_BROADCASTADDRESS = 28,
 				OPTION_REQUESTEDIPADDRESS = 50,
 				OPTION_IPADDRESSLEASETIME = 51,
@@ -69,6 +77,27 @@ namespace WPEFramework {
 			// For display of host name information
 			static constexpr uint16_t MaxHostNameSize = 256;
 
+			// How long an offered address is kept for the client, before it can be offered to another one.
+			static constexpr uint32_t OfferTime = 60;
+
+			// Lease time handed out if none is configured, in seconds.
+			static constexpr uint32_t DefaultLeaseTime = 24 * 60 * 60;
+
+			// Longest lease time handed out, in seconds, its expiration is calculated in milliseconds (uint32_t).
+			static constexpr uint32_t MaxLeaseTime = 0xFFFFFFFF / 1000;
+
+			// Leases of reserved addresses never expire.
+			static constexpr uint64_t Permanent = ~static_cast<uint64_t>(0);
+
+			// Records in the journal that may be overruled by later ones, beyond one per lease, before it is compacted.
+			static constexpr uint32_t JournalSlack = 64;
+
+			// Most requests read (recvmmsg) and answers sent (sendmmsg) in one go, if batching is configured.
+			static constexpr uint8_t MaxBatch = 64;
+
+			// Room for a request read in a batch, an Ethernet frame. Anything bigger is dropped.
+			static constexpr uint16_t BatchFrameSize = 1536;
+
 			// DHCP magic cookie values
                         static constexpr uint8_t  MagicCookie[] = { 99, 130, 83, 99 };
 
@@ -155,20 +184,21 @@ namespace WPEFramework {
 					}
 				}
 				Identifier(const Identifier& copy) : _length(copy._length) {
-					printf("Identifier copy %d\n", __LINE__);
 					if (_length > sizeof(_id._buffer)) {
 						_id._allocation = new uint8_t[_length];
 						::memcpy(_id._allocation, copy._id._allocation, _length);
 					}
 					else {
-						printf("Identifier copy %d\n", __LINE__);
 						::memcpy(_id._buffer, copy._id._buffer, _length);
 					}
 				}
-				Identifier(const Identifier&& copy) : _length(copy._length) {
+				Identifier(Identifier&& copy) : _length(copy._length) {
 
 					if (_length > sizeof(_id._buffer)) {
+						// Take over the allocation, the source no longer owns it.
 						_id._allocation = copy._id._allocation;
+						copy._id._allocation = nullptr;
+						copy._length = 0;
 					}
 					else {
 						::memcpy(_id._buffer, copy._id._buffer, _length);
@@ -235,6 +265,16 @@ namespace WPEFramework {
 				inline string Text() const {
 					return (Core::ToString(string(reinterpret_cast<const char*>(Id()), _length)));
 				}
+				inline uint64_t Hash() const {
+					const uint8_t* data = Id();
+					uint64_t hash = 14695981039346656037ULL;
+
+					for (uint8_t index = 0; index < _length; index++) {
+						hash = (hash ^ data[index]) * 1099511628211ULL;
+					}
+
+					return (hash);
+				}
 
 			private:
 				uint8_t _length;
@@ -290,6 +330,38 @@ namespace WPEFramework {
 				uint64_t _expiration;
 				const uint32_t _address;
 			};
+			// What is handed out: the addresses of the pool and the options that come with them.
+			class Pool {
+			public:
+				Pool()
+					: Start(0)
+					, Size(0)
+					, Router(0)
+					, Routers()
+					, DNS()
+					, Domain()
+					, Subnet(0)
+					, LeaseTime(DefaultLeaseTime)
+					, RenewalTime(0)
+					, RebindingTime(0)
+					, Reservations() {
+				}
+				~Pool() {
+				}
+
+			public:
+				uint32_t Start; //!< Offset of the first address of the pool in the subnet.
+				uint32_t Size;
+				uint32_t Router; //!< Offset of the router in the subnet, 0 is this server, ~0 is none. Only if there are no Routers.
+				std::list<Core::NodeId> Routers;
+				std::list<Core::NodeId> DNS; //!< If there are none, this server is the name server.
+				string Domain;
+				uint8_t Subnet; //!< Bits in the subnet mask, 0 takes the mask of the interface.
+				uint32_t LeaseTime; //!< In seconds.
+				uint32_t RenewalTime; //!< T1 in seconds, 0 is half of the lease time.
+				uint32_t RebindingTime; //!< T2 in seconds, 0 is 7/8 of the lease time.
+				std::list< std::pair<string, Core::NodeId> > Reservations; //!< Hardware address (aa:bb:cc:dd:ee:ff) and the address it always gets.
+			};
 		private:
 			class ScratchPad {
 			private:
@@ -317,6 +389,8 @@ namespace WPEFramework {
 					// Determine preferred IP address
 					locator = GetOption(OPTION_REQUESTEDIPADDRESS);
 					_preferred = ((locator != nullptr) && (locator[0] == sizeof(uint32_t)) ? ((locator[1] << 24) | (locator[2] << 16) | (locator[3] << 8) | locator[4]) : 0);
+
+					_client = ntohl(message->ciaddr.s_addr);
 				}
 				~ScratchPad() {
 				}
@@ -328,6 +402,10 @@ namespace WPEFramework {
 				uint32_t RequestedIP() const {
 					return (_preferred);
 				}
+				// The address the client has in use (ciaddr), if it is renewing or rebinding its lease.
+				inline uint32_t ClientIP() const {
+					return (_client);
+				}
 				inline bool HasClassification() const {
 					return (_classification != CLASSIFICATION_INVALID);
 				}
@@ -379,17 +457,72 @@ namespace WPEFramework {
 				const uint8_t* _optionData;
 				uint16_t _optionSize;
 				uint32_t _preferred;
+				uint32_t _client;
 				classifications _classification;
 			};
-			class LeaseList : public std::list<Lease> {
+			struct Hasher {
+				inline size_t operator()(const Identifier& id) const {
+					return (static_cast<size_t>(id.Hash()));
+				}
+			};
+
+			typedef std::unordered_map<Identifier, uint32_t, Hasher> IdentifierMap;
+
+			// The leases of the pool, one slot for every address, so an address is found by its offset in the pool.
+			// A client is found through a hash on its identifier, a free address through a bitmap, a word at a
+			// time. Leases that expire are kept in a heap, on the soonest expiration, and only taken back once the
+			// pool needs them (Reclaim). An entry in the heap is stale if the lease was renewed after it was pushed.
+			class LeaseTable {
 			private:
-				LeaseList(const LeaseList&) = delete;
-				LeaseList& operator= (const LeaseList&) = delete;
+				LeaseTable(const LeaseTable&) = delete;
+				LeaseTable& operator= (const LeaseTable&) = delete;
+
+				typedef std::pair<uint64_t, uint32_t> HeapEntry;
+
+				struct Later {
+					inline bool operator()(const HeapEntry& lhs, const HeapEntry& rhs) const {
+						return (lhs.first > rhs.first);
+					}
+				};
+			public:
+				class Iterator {
+				private:
+					Iterator() = delete;
+					Iterator& operator= (const Iterator&) = delete;
+
+				public:
+					Iterator(const LeaseTable& table) : _table(table), _offset(~0) {
+						_table.ReadLock();
+					}
+					Iterator(const Iterator& copy) : _table(copy._table), _offset(copy._offset) {
+						_table.ReadLock();
+					}
+					~Iterator() {
+						_table.ReadUnlock();
+					}
+
+				public:
+					inline void Reset() {
+						_offset = ~0;
+					}
+					inline bool Next() {
+						_offset = _table.Used(_offset + 1);
+						return (_offset < _table.Size());
+					}
+					inline const Lease& Current() const {
+						ASSERT(_offset < _table.Size());
+						return (_table._slots[_offset]);
+					}
+
+				private:
+					const LeaseTable& _table;
+					uint32_t _offset;
+				};
 
 			public:
-				LeaseList() : std::list<Lease>() {
+				LeaseTable() : _first(0), _used(0), _slots(), _free(), _index(), _expirations() {
 				}
-				~LeaseList() {
+				~LeaseTable() {
 				}
 
 			public:
@@ -405,18 +538,324 @@ namespace WPEFramework {
 				inline void ReadUnlock() const {
 					_adminLock.Unlock();
 				}
+				inline uint32_t Size() const {
+					return (static_cast<uint32_t>(_slots.size()));
+				}
+				inline uint32_t Count() const {
+					return (_used);
+				}
+
+				// NOTE:
+				// All methods below need to be executed within the lock.
+				void Reset(const uint32_t first, const uint32_t size) {
+					_first = first;
+					_used = 0;
+					_index.clear();
+					_expirations.clear();
+					_slots.clear();
+					_slots.reserve(size);
+
+					for (uint32_t offset = 0; offset < size; offset++) {
+						_slots.emplace_back(Identifier(), first + offset);
+					}
+
+					// All free, the bits past the end of the pool are never free.
+					_free.assign((size + 63) / 64, ~static_cast<uint64_t>(0));
+
+					if ((size % 64) != 0) {
+						_free.back() = (static_cast<uint64_t>(1) << (size % 64)) - 1;
+					}
+				}
+				inline Lease* Find(const uint32_t address) {
+					const uint32_t offset = address - _first;
+					return ((offset < _slots.size()) && (IsFree(offset) == false) ? &(_slots[offset]) : nullptr);
+				}
+				inline Lease* Find(const Identifier& id) {
+					IdentifierMap::const_iterator index(_index.find(id));
+					return (index != _index.end() ? &(_slots[index->second]) : nullptr);
+				}
+				// Returns nullptr if the address is not in the pool or already taken.
+				Lease* Create(const Identifier& id, const uint32_t address) {
+					const uint32_t offset = address - _first;
+					Lease* result = nullptr;
+
+					if ((offset < _slots.size()) && (IsFree(offset) == true)) {
+						result = Take(offset, id);
+					}
+
+					return (result);
+				}
+				// The first free address from the given one on, wrapping around at the end of the pool.
+				Lease* Allocate(const Identifier& id, const uint32_t from) {
+					const uint32_t start = ((from - _first) < _slots.size() ? (from - _first) : 0);
+					uint32_t offset = Free(start, static_cast<uint32_t>(_slots.size()));
+					Lease* result = nullptr;
+
+					if (offset == static_cast<uint32_t>(~0)) {
+						offset = Free(0, start);
+					}
+					if (offset != static_cast<uint32_t>(~0)) {
+						result = Take(offset, id);
+					}
+
+					return (result);
+				}
+				// Hand an (expired) lease to another client.
+				void Update(Lease& lease, const Identifier& id) {
+					const uint32_t offset = lease.Raw() - _first;
+					IdentifierMap::iterator previous(_index.find(id));
+
+					if ((previous != _index.end()) && (previous->second != offset)) {
+						Release(previous->second);
+					}
+
+					_index.erase(lease.Id());
+					lease.Update(id);
+					_index[id] = offset;
+				}
+				void Expiration(Lease& lease, const uint64_t time) {
+					lease.Expiration(time);
+
+					// Stale entries pile up with every renewal, once there are too many, start over from the leases.
+					if (_expirations.size() >= (2 * _slots.size())) {
+						_expirations.clear();
+
+						for (uint32_t offset = Used(0); offset < _slots.size(); offset = Used(offset + 1)) {
+							_expirations.push_back(HeapEntry(_slots[offset].Expiration(), offset));
+						}
+
+						std::make_heap(_expirations.begin(), _expirations.end(), Later());
+					}
+					else {
+						_expirations.push_back(HeapEntry(time, lease.Raw() - _first));
+						std::push_heap(_expirations.begin(), _expirations.end(), Later());
+					}
+				}
+				// Puts back a lease as it was before, addresses that are not in the pool (anymore) are skipped.
+				void Restore(const Identifier& id, const uint32_t address, const uint64_t expiration) {
+					const uint32_t offset = address - _first;
+
+					if (offset < _slots.size()) {
+						if (IsFree(offset) == true) {
+							Take(offset, id);
+						}
+						else if (_slots[offset].Id() != id) {
+							Update(_slots[offset], id);
+						}
+
+						Expiration(_slots[offset], expiration);
+					}
+				}
+				// The client gives up its lease, returns false if it did not have one.
+				bool Remove(const Identifier& id) {
+					IdentifierMap::const_iterator index(_index.find(id));
+					bool result = (index != _index.end());
+
+					if (result == true) {
+						Release(index->second);
+					}
+
+					return (result);
+				}
+				// Frees the addresses of all leases that expired before the given time.
+				void Reclaim(const uint64_t now) {
+					while ((_expirations.empty() == false) && (_expirations.front().first < now)) {
+						const HeapEntry entry(_expirations.front());
+
+						std::pop_heap(_expirations.begin(), _expirations.end(), Later());
+						_expirations.pop_back();
+
+						if ((IsFree(entry.second) == false) && (_slots[entry.second].Expiration() == entry.first)) {
+							Release(entry.second);
+						}
+					}
+				}
+
+			private:
+				inline bool IsFree(const uint32_t offset) const {
+					return ((_free[offset / 64] & (static_cast<uint64_t>(1) << (offset % 64))) != 0);
+				}
+				static inline uint8_t Lowest(const uint64_t word) {
+					ASSERT(word != 0);
+				#ifdef __GNUC__
+					return (static_cast<uint8_t>(__builtin_ctzll(word)));
+				#else
+					uint8_t result = 0;
+					while ((word & (static_cast<uint64_t>(1) << result)) == 0) {
+						result++;
+					}
+					return (result);
+				#endif
+				}
+				// The first free offset in [begin, end), ~0 if there is none.
+				uint32_t Free(const uint32_t begin, const uint32_t end) const {
+					uint32_t result = static_cast<uint32_t>(~0);
+					uint32_t word = begin / 64;
+					uint64_t bits = (begin < end ? _free[word] & (~static_cast<uint64_t>(0) << (begin % 64)) : 0);
+
+					while ((bits == 0) && (((word + 1) * 64) < end)) {
+						bits = _free[++word];
+					}
+					if (bits != 0) {
+						const uint32_t offset = (word * 64) + Lowest(bits);
+						result = (offset < end ? offset : static_cast<uint32_t>(~0));
+					}
+
+					return (result);
+				}
+				// The first used offset from the given one on, the size of the table if there is none.
+				uint32_t Used(const uint32_t begin) const {
+					uint32_t result = static_cast<uint32_t>(_slots.size());
+
+					if (begin < _slots.size()) {
+						uint32_t word = begin / 64;
+						uint64_t bits = ~_free[word] & (~static_cast<uint64_t>(0) << (begin % 64));
+
+						while ((bits == 0) && ((word + 1) < _free.size())) {
+							bits = ~_free[++word];
+						}
+						if (bits != 0) {
+							result = std::min(result, (word * 64) + Lowest(bits));
+						}
+					}
+
+					return (result);
+				}
+				Lease* Take(const uint32_t offset, const Identifier& id) {
+					Lease& lease(_slots[offset]);
+
+					// A client holds one lease at the time, it moves to the new address.
+					IdentifierMap::iterator previous(_index.find(id));
+					if (previous != _index.end()) {
+						Release(previous->second);
+					}
+
+					_free[offset / 64] &= ~(static_cast<uint64_t>(1) << (offset % 64));
+					_used++;
+					lease.Update(id);
+					lease.Expiration(0);
+					_index[id] = offset;
+
+					return (&lease);
+				}
+				void Release(const uint32_t offset) {
+					Lease& lease(_slots[offset]);
+
+					_index.erase(lease.Id());
+					lease.Update(Identifier());
+					lease.Expiration(0);
+					_free[offset / 64] |= (static_cast<uint64_t>(1) << (offset % 64));
+					_used--;
+				}
 
 			private:
-				mutable Core::CriticalSection	_adminLock;
+				mutable Core::CriticalSection _adminLock;
+				uint32_t _first;
+				uint32_t _used;
+				std::vector<Lease> _slots;
+				std::vector<uint64_t> _free; //!< A bit per slot, set if the address is free.
+				IdentifierMap _index;
+				std::vector<HeapEntry> _expirations;
 			};
 
-	
+			// The start of every answer of the server, put together from the configuration of the pool once (Open),
+			// so an answer is a copy of it with the fields of the client patched in.
+			class Template {
+			private:
+				Template(const Template&) = delete;
+				Template& operator= (const Template&) = delete;
+
+			public:
+				// The message type and the server identifier lead, a negative acknowledge only carries those.
+				static constexpr uint8_t NakSize = 9;
+
+			public:
+				Template() : _size(0) {
+					::memset(&_header, 0, sizeof(_header));
+				}
+				~Template() {
+				}
+
+			public:
+				inline const CoreMessage& Header() const {
+					return (_header);
+				}
+				inline const uint8_t* Options() const {
+					return (_options);
+				}
+				inline uint8_t Size() const {
+					return (_size);
+				}
+				void Clear(const std::string& serverName, const uint32_t server) {
+
+					::memset(&_header, 0, sizeof(_header));
+
+					_header.operation = OPERATION_BOOTREPLY;
+					_header.siaddr.s_addr = server;
+					::memcpy(_header.sname, serverName.c_str(), std::min(sizeof(_header.sname), serverName.length()));
+					::memcpy(_header.pbMagicCookie, MagicCookie, sizeof(_header.pbMagicCookie));
+
+					// DHCP Message Type - RFC 2132 section 9.6, the type itself is set per answer.
+					_options[0] = OPTION_DHCPMESSAGETYPE;
+					_options[1] = 1;
+					_options[2] = 0;
+
+					// Server Identifier - RFC 2132 section 9.7
+					_options[3] = OPTION_SERVERIDENTIFIER;
+					_options[4] = 4;
+					::memcpy(&(_options[5]), &server, 4);
+
+					_size = NakSize;
+				}
+				// Returns false if the option does not fit anymore.
+				bool Add(const uint8_t option, const uint8_t data[], const uint8_t length) {
+					bool result = (static_cast<uint32_t>(_size + 2 + length) <= sizeof(_options));
+
+					if (result == true) {
+						_options[_size]     = option;
+						_options[_size + 1] = length;
+						::memcpy(&(_options[_size + 2]), data, length);
+						_size += (2 + length);
+					}
+
+					return (result);
+				}
+				// A 32 bits value (time, mask), in host order.
+				bool Add(const uint8_t option, const uint32_t value) {
+					const uint32_t data = htonl(value);
+					return (Add(option, reinterpret_cast<const uint8_t*>(&data), sizeof(data)));
+				}
+				// A list of addresses, in host order.
+				bool Add(const uint8_t option, const std::list<uint32_t>& addresses) {
+					uint8_t data[252];
+					uint8_t length = 0;
+					std::list<uint32_t>::const_iterator index(addresses.begin());
+
+					while ((index != addresses.end()) && ((length + sizeof(uint32_t)) <= sizeof(data))) {
+						const uint32_t value = htonl(*index);
+						::memcpy(&(data[length]), &value, sizeof(value));
+						length += sizeof(value);
+						index++;
+					}
+
+					return ((index == addresses.end()) && (Add(option, data, length) == true));
+				}
+
+			private:
+				CoreMessage _header;
+				uint8_t _size;
+				uint8_t _options[255];
+			};
 
 			class Response {
 			private:
 				Response(const Response&) = delete;
 				Response& operator= (const Response&) = delete;
 
+			public:
+				// The fixed part and the options, at most 255 bytes, followed by the end option.
+				static constexpr uint16_t FrameSize = sizeof(CoreMessage) + 256;
+
 			public:
 				Response() {
 					Clear();
@@ -446,49 +885,28 @@ namespace WPEFramework {
 
 					return (sizeof(_dhcpReply) + _optionSize + 1);
 				}
-				inline void Base(const std::string& serverName, const uint32_t server, const CoreMessage& message, const uint32_t router, const uint32_t dns) {
+				// Server message handling RFC 2131 section 4.3, what is the same for every client is in the template.
+				inline void Base(const Template& base, const CoreMessage& message) {
+
+					::memcpy(&_dhcpReply, &(base.Header()), sizeof(_dhcpReply));
+					::memcpy(_optionData, base.Options(), base.Size());
+					_optionSize = base.Size();
 
-					// Server message handling RFC 2131 section 4.3
                     _replyAddress = message.giaddr.s_addr;
 					_ciaddr = message.ciaddr.s_addr;
 					_yiaddr = message.yiaddr.s_addr;
 
-					_dhcpReply.operation = OPERATION_BOOTREPLY;
 					_dhcpReply.htype = message.htype;
 					_dhcpReply.hlen = message.hlen;
-					// dhcpReply->hops = 0;
 					_dhcpReply.xid = message.xid;
-					// dhcpReply->ciaddr = 0;
-					// dhcpReply->yiaddr = 0;  Or changed below
-					_dhcpReply.siaddr.s_addr = server;
 					_dhcpReply.flags = (message.giaddr.s_addr != 0 ? htons(BroadcastValue) : 0) | message.flags;
 					_dhcpReply.giaddr = message.giaddr;
 					::memcpy(_dhcpReply.chaddr, message.chaddr, sizeof(_dhcpReply.chaddr));
-					::memcpy(_dhcpReply.sname, serverName.c_str(), std::min(sizeof(_dhcpReply.sname), serverName.length()));
-					// dhcpReply->file = 0;
-
-					::memcpy(_dhcpReply.pbMagicCookie, MagicCookie, sizeof(_dhcpReply.pbMagicCookie));
-
-					// DHCP Message Type - RFC 2132 section 9.6
-					_optionData[0] = OPTION_DHCPMESSAGETYPE;
-					_optionData[1] = 1;
-					_optionData[2] = 0;
-
-					// Server Identifier - RFC 2132 section 9.7
-					_optionData[3] = OPTION_SERVERIDENTIFIER;
-					_optionData[4] = 4;
-					::memcpy(&(_optionData[5]), &server, 4);
-
-                    _optionSize = 9;
-					if (router != static_cast<uint32_t>(~0)) {
-						Router(router);
-					}
-					if (dns != static_cast<uint32_t>(~0)) {
-						DNS(dns);
-					}
-
 				}
 				inline Core::NodeId Reply() const {
+					return (Core::NodeId(Destination()));
+				}
+				inline sockaddr_in Destination() const {
 					uint32_t result = _replyAddress;
 
 					// Determine how to send the reply  RFC 2131 section 4.1
@@ -500,7 +918,6 @@ namespace WPEFramework {
 						    break;
 						case CLASSIFICATION_ACK:
 							if (_ciaddr == 0) {
-								printf("Stiekem altijd 255 \n");
 								result = (((htons(BroadcastValue) & _dhcpReply.flags) != 0) ? INADDR_BROADCAST : INADDR_BROADCAST);
 							}
 							else {
@@ -517,11 +934,12 @@ namespace WPEFramework {
 	
                                         }
 					sockaddr_in saClientAddress;
+					::memset(&saClientAddress, 0, sizeof(saClientAddress));
 					saClientAddress.sin_family = AF_INET;
 					saClientAddress.sin_addr.s_addr = result;
 					saClientAddress.sin_port = htons(DefaultDHCPClientPort);
 
-					return (Core::NodeId(saClientAddress));
+					return (saClientAddress);
 				}
 				inline void Offer(const uint32_t address) {
 
@@ -533,90 +951,89 @@ namespace WPEFramework {
 					if (positive == true) {
 
 						_optionData[2] = CLASSIFICATION_ACK;
-						_dhcpReply.ciaddr.s_addr = htonl(address);
-						_dhcpReply.yiaddr.s_addr = _dhcpReply.ciaddr.s_addr;
+						_dhcpReply.ciaddr.s_addr = _ciaddr;
+						_dhcpReply.yiaddr.s_addr = htonl(address);
 					}
 					else {
+						// RFC 2131 table 3, a negative acknowledge carries no address and no configuration.
 						_optionData[2] = CLASSIFICATION_NAK;
+						_dhcpReply.siaddr.s_addr = 0;
+						_optionSize = Template::NakSize;
 					}
 				}
-				inline void LeaseTime(const uint16_t hours) {
 
-                                        uint32_t value = hours * 60 * 60;
+			private:
+				CoreMessage _dhcpReply;
+				uint8_t _optionSize;
+				uint8_t _optionData[256];
+                                uint32_t _replyAddress;
+                                uint32_t _ciaddr;
+                                uint32_t _yiaddr;
+			};
 
-					// IP Address Lease Time - RFC 2132 section 9.2
-					_optionData[_optionSize]     = OPTION_IPADDRESSLEASETIME;
-					_optionData[_optionSize + 1] = 4;
-					_optionData[_optionSize + 2] = (value >> 24) & 0xFF;
-					_optionData[_optionSize + 3] = (value >> 16) & 0xFF;
-					_optionData[_optionSize + 4] = (value >> 8) & 0xFF;
-					_optionData[_optionSize + 5] = value & 0xFF;
+			class Job : public Core::IDispatchType<void> {
+			private:
+				Job() = delete;
+				Job(const Job&) = delete;
+				Job& operator= (const Job&) = delete;
 
-                                        _optionSize += 6;
+			public:
+				Job(DHCPServerImplementation* parent)
+					: _parent(*parent) {
+					ASSERT(parent != nullptr);
 				}
-				inline void SubnetMask(const uint8_t bits) {
-
-					const uint32_t mask(static_cast<uint32_t>(~0) << (32 - bits));
-
-					// Subnet Mask - RFC 2132 section 3.3
-					_optionData[_optionSize]     = OPTION_SUBNETMASK;
-					_optionData[_optionSize + 1] = 4;
-					_optionData[_optionSize + 2] = (mask >> 24) & 0xFF;
-					_optionData[_optionSize + 3] = (mask >> 16) & 0xFF;
-					_optionData[_optionSize + 4] = (mask >> 8) & 0xFF;
-					_optionData[_optionSize + 5] = mask & 0xFF;
-
-                                        _optionSize += 6;
+				~Job() {
 				}
-				inline void Router(const uint32_t address) {
 
-                                        const uint32_t value = htonl(address);
-					_optionData[_optionSize]     = OPTION_ROUTER;
-					_optionData[_optionSize + 1] = 4;
-					::memcpy(&(_optionData[_optionSize + 2]), &value, 4);
-                                        _optionSize += 6;
+			public:
+				virtual void Dispatch() override {
+					_parent.Compact();
 				}
-				inline void DNS (const uint32_t address) {
 
-                                        const uint32_t value = htonl(address);
-					_optionData[_optionSize]     = OPTION_DNS;
-					_optionData[_optionSize + 1] = 4;
-					::memcpy(&(_optionData[_optionSize + 2]), &value, 4);
-                                        _optionSize += 6;
-				}
-	
 			private:
-				CoreMessage _dhcpReply;
-				uint8_t _optionSize;
-				uint8_t _optionData[256];
-                                uint32_t _replyAddress;
-                                uint32_t _ciaddr;
-                                uint32_t _yiaddr;
+				DHCPServerImplementation& _parent;
 			};
 
 		public:
-			typedef Core::LockableIteratorType<const LeaseList, const Lease&, LeaseList::const_iterator> Iterator;
+			typedef LeaseTable::Iterator Iterator;
 
 		public:
-			DHCPServerImplementation(const string& serverName, const string& interfaceName, const uint32_t poolStart, const uint32_t poolSize, const uint32_t router, const Core::NodeId& DNS)
+			DHCPServerImplementation(const string& serverName, const string& interfaceName, const Pool& pool, const string& journal, const uint8_t batch)
 				: Core::SocketDatagram(false, Core::NodeId("255.255.255.255",DefaultDHCPServerPort), Core::NodeId("255.255.255.255", DefaultDHCPClientPort), 1024, 16384)
 				, _serverName(Core::ToString(serverName))
                                 , _interfaceName(interfaceName)
-                                , _poolStart(poolStart)
-                                , _poolSize(poolSize)
+                                , _pool(pool)
 				, _minAddress(0)
 				, _maxAddress(0)
 				, _lastIssued(0)
 				, _server(0)
-				, _router(router)
-				, _dns(~0)
+				, _router(~0)
+				, _leaseTime(DefaultLeaseTime)
+				, _template()
+				, _reservations()
 				, _leases()
-				, _responses() {
+				, _journalName(journal)
+				, _journal()
+				, _compacting(false)
+				, _job(Core::ProxyType<Job>::Create(this))
+				, _responses()
+				, _batch(batch == 0 ? 1 : (batch > MaxBatch ? MaxBatch : batch))
+				, _pending() {
 				static_assert(sizeof(uint32_t) == 4, "Incorrect architecture chosen. uint32_t must by 4 bytes");
 
-				if (DNS.IsValid() == true) {
-                	_dns = ntohl(static_cast<const Core::NodeId::SocketInfo&>(DNS).IPV4Socket.sin_addr.s_addr);
-				} 
+#ifdef __WIN32__
+				_batch = 1;
+#else
+				if (_batch > 1) {
+					// The first request of a batch is read by the socket itself, the rest and all answers
+					// go through these.
+					_pending.reserve(_batch);
+					_frames.resize(((_batch - 1) * BatchFrameSize) + (_batch * Response::FrameSize));
+					_headers.resize(_batch);
+					_vectors.resize(_batch);
+					_senders.resize(_batch);
+				}
+#endif
 
 				
 			}
@@ -657,80 +1074,142 @@ namespace WPEFramework {
 			uint32_t Close();
 
 		private:
-			// NOTE:
-			// The next three methods, Find,Find and Create need to be executed within the lock.
-			inline Lease* Find(const uint32_t address) {
+			void Compile(const uint32_t address, const uint32_t mask);
+			void Reserve();
+			static bool Hardware(const string& text, uint8_t address[6]);
 
-				LeaseList::iterator index(_leases.begin());
-				while ((index != _leases.end()) && (index->Raw() != address)) {
-					index++;
-				}
+			// The handlers of the requests need to be executed within the lock of the leases, it is taken
+			// once for all requests read in one go.
+			void Discover(Response& response, const ScratchPad& scratchPad) {
 
-				return (index != _leases.end() ? &(*index) : nullptr);
-			}
-			inline Lease* Find(const Identifier& id) {
-				LeaseList::iterator index(_leases.begin());
-				while ((index != _leases.end()) && (index->Id() != id)) {
-					index++;
+				const Core::Time now(Core::Time::Now());
+				IdentifierMap::const_iterator reserved(_reservations.find(scratchPad.Id()));
+
+				if (reserved != _reservations.end()) {
+					// Always the same address, nothing to keep track of.
+					response.Offer(reserved->second);
 				}
+				else {
+					// Addresses of leases that ran out are only taken back now that they might be needed.
+					_leases.Reclaim(now.Ticks());
 
-				return (index != _leases.end() ? &(*index) : nullptr);
-			}
-			inline Lease* Create(const Identifier& id, const uint32_t address) {
-				_leases.push_back(Lease(id, address));
-				return &(_leases.back());
-			}
-			void Discover(Response& response, const ScratchPad& scratchPad) {
+					Lease* result = _leases.Find(scratchPad.Id());
 
-				_leases.Lock();
-				Lease* result = Find(scratchPad.Id());
+					// RFC 2131 section 4.3.1
+					if ((result == nullptr) && (scratchPad.RequestedIP() != 0)) {
+						result = _leases.Find(scratchPad.RequestedIP());
 
-				// RFC 2131 section 4.3.1
-				if ((result == nullptr) && (scratchPad.RequestedIP() != 0)) {
-					result = Find(scratchPad.RequestedIP());
+						if (result == nullptr) {
+							// Ip address has not been taken yet, time to "assign" it to this client (if it is in our pool).
+							result = _leases.Create(scratchPad.Id(), scratchPad.RequestedIP());
+						}
+						else if (result->IsExpired() == true) {
+							_leases.Update(*result, scratchPad.Id());
+						}
+						else {
+							// It is in use by another client, pick one from the pool.
+							result = nullptr;
+						}
+					}
+
+					if (result == nullptr) {
+						// Seems we have no record for this client, create a new one..
+						result = _leases.Allocate(scratchPad.Id(), _lastIssued + 1);
+
+						if (result != nullptr) {
+							_lastIssued = result->Raw();
+						}
+					}
 
 					if (result == nullptr) {
-						// Ip address has not been taken yet, time to "assign" it to this client.
-						result = Create(scratchPad.Id(), scratchPad.RequestedIP());
+						TRACE(Flow, (string(_T("Looks like we ran out of IP addresses!!"))));
 					}
-					else if (result->IsExpired() == true) {
-						result->Update(scratchPad.Id());
+					else {
+						if (result->IsExpired() == true) {
+							// Hold it for this client, till it gets to requesting it.
+							_leases.Expiration(*result, Core::Time(now).Add(OfferTime * 1000).Ticks());
+
+							// Nothing is promised yet, it does not have to be on disk before the offer is sent.
+							Record(*result, false);
+						}
+
+						response.Offer(result->Raw());
 					}
 				}
+			}
+			// RFC 2131 section 4.3.2, with a server identifier the client selects an offer (SELECTING), one of an
+			// other server means ours is turned down. Without it, the client verifies the lease it has after a
+			// reboot (INIT-REBOOT, requested IP address) or extends it (RENEWING or REBINDING, ciaddr).
+			void Request(Response& response, const ScratchPad& scratchPad) {
 
-				if (result == nullptr) {
-					uint32_t poolSize(_maxAddress - _minAddress);
+				const uint32_t serverId = scratchPad.ServerIdentifier();
 
-					// Seems we have no record for this client, create a new one..
-					while ((--poolSize != 0) && (Find(++_lastIssued) != nullptr)) /* INTENTIONALLY LEFT EMPTY */;
+				if ((serverId == 0) || (serverId == ntohl(_server))) {
+					IdentifierMap::const_iterator reserved(_reservations.find(scratchPad.Id()));
+					Lease* result = (reserved == _reservations.end() ? _leases.Find(scratchPad.Id()) : nullptr);
+					const uint32_t requested = (scratchPad.RequestedIP() != 0 ? scratchPad.RequestedIP() : scratchPad.ClientIP());
 
-					if (poolSize != 0) {
-						result = Create(scratchPad.Id(), _lastIssued);
+					if ((reserved == _reservations.end()) && (result == nullptr)) {
+						// Without a record of the client, it might have its lease from another server, so only
+						// refuse what was selected from us.
+						if (serverId != 0) {
+							response.Acknowledge(false, requested);
+						}
+					}
+					else {
+						const uint32_t address = (reserved != _reservations.end() ? reserved->second : result->Raw());
+						const bool positive = (requested == address);
+
+						if ((positive == true) && (result != nullptr)) {
+							_leases.Expiration(*result, Core::Time::Now().Add(_leaseTime * 1000).Ticks());
+
+							Record(*result, true);
+						}
+
+						response.Acknowledge(positive, address);
 					}
 				}
+			}
+			// RFC 2131 section 4.3.4, there is no answer to a release. A reserved address is never given up.
+			void Release(const ScratchPad& scratchPad) {
 
-				if (result == nullptr) {
-					TRACE(Flow, (string(_T("Looks like we ran out of IP addresses!!"))));
+				if ((_reservations.find(scratchPad.Id()) == _reservations.end()) && (_leases.Remove(scratchPad.Id()) == true)) {
+					_journal.Append(LeaseJournal::RELEASE, 0, 0, scratchPad.Id().Id(), scratchPad.Id().Length(), true);
 				}
-				else {
-					response.Offer(result->Raw());
-					response.SubnetMask(24);
+			}
+			void Record(const Lease& lease, const bool sync) {
 
+				_journal.Append(LeaseJournal::LEASE, lease.Raw(), lease.Expiration(), lease.Id().Id(), lease.Id().Length(), sync);
+
+				if ((_compacting == false) && (_journal.Records() > ((2 * _leases.Count()) + JournalSlack))) {
+					// Rewriting the log takes a while, the answers should not wait for it.
+					_compacting = true;
+					PluginHost::WorkerPool::Instance().Submit(_job);
+				}
+			}
+			// Only the snapshot of the leases and the swap of the logs are done within the lock of the leases.
+			void Compact() {
+				_leases.Lock();
+
+				const bool active = (_journal.IsOpen() == true);
+
+				if (active == true) {
+					Iterator index(_leases);
+					_journal.Snapshot(index);
 				}
 
 				_leases.Unlock();
-			}
-			void Request(Response& response, const ScratchPad& scratchPad) {
+
+				const bool written = (active == true) && (_journal.Write() == true);
 
 				_leases.Lock();
 
-				// RFC 2131 section 4.3.2 Determine requested IP address
-				Lease* result = Find(scratchPad.Id());
-				uint32_t serverId = scratchPad.ServerIdentifier();
-				uint32_t requested = scratchPad.RequestedIP();
+				if (active == true) {
+					_journal.Finish(written);
+				}
+
+				_compacting = false;
 
-				response.Acknowledge((serverId != 0) && (result != nullptr), requested);							
-				response.LeaseTime(24);
 				_leases.Unlock();
 			}
 			void Submit(const Core::ProxyType< Response > entry) {
@@ -766,6 +1245,25 @@ namespace WPEFramework {
 				return(result);
 			}
 			virtual uint16_t ReceiveData(uint8_t dataFrame[], const uint16_t length) {
+
+				_leases.Lock();
+
+				Handle(dataFrame, length, SocketDatagram::RemoteNode());
+
+				if (_batch > 1) {
+					Receive();
+				}
+
+				// Whatever is promised to the clients is on disk, before they get to hear about it.
+				_journal.Sync();
+
+				_leases.Unlock();
+
+				Transmit();
+
+				return (length);
+			}
+			void Handle(const uint8_t dataFrame[], const uint16_t length, const Core::NodeId& source) {
 				const CoreMessage* const message = reinterpret_cast<const CoreMessage*>(dataFrame);
 				// Check the size of the message, certain elments need to be in there (RFC 2131 section 3)
 				if (sizeof(CoreMessage) > length) {
@@ -777,7 +1275,7 @@ namespace WPEFramework {
 				else if (memcmp(MagicCookie, &(dataFrame[sizeof(CoreMessage) - sizeof(MagicCookie)]), sizeof(MagicCookie)) != 0) {
 					TRACE(Trace::Information, (string(_T("Magic cookie does not comply."))));
 				}
-				else if (SocketDatagram::RemoteNode() == SocketDatagram::LocalNode()) {
+				else if (source == SocketDatagram::LocalNode()) {
 					TRACE(Trace::Information, (string(_T("Receiving a request from the our-selves, will not respond."))));
 				}
 				else {
@@ -790,7 +1288,7 @@ namespace WPEFramework {
 					else {
 						// Create our selves a response we can reply.
 						Core::ProxyType<Response> response(_responseFactory.Element());
-						response->Base(_serverName, _server, *message, _router, _dns);
+						response->Base(_template, *message);
 
 						switch (scratchPad.Classification()) {
 						case CLASSIFICATION_DISCOVER:
@@ -801,9 +1299,10 @@ namespace WPEFramework {
 							Request(*response, scratchPad);
 							break;
 						case CLASSIFICATION_DECLINE:
-							// Fall-through
+							// UNSUPPORTED: Mark address as unusable
+							break;
 						case CLASSIFICATION_RELEASE:
-							// UNSUPPORTED: Mark address as unused
+							Release(scratchPad);
 							break;
 						case CLASSIFICATION_INFORM:
 							// Unsupported DHCP message type - fail silently
@@ -818,27 +1317,101 @@ namespace WPEFramework {
 							break;
 						}
 
-						if (response.IsValid() == true) {
-							Submit(response);
+						if (response->IsValid() == true) {
+							_pending.push_back(response);
 						}
 					}
 				}
-				return (length);
 			}
+			// Reads the requests that queued up behind the one the socket read, at most a batch minus that one.
+			void Receive() {
+#ifndef __WIN32__
+				for (uint8_t index = 0; index < (_batch - 1); index++) {
+					_vectors[index].iov_base = &(_frames[index * BatchFrameSize]);
+					_vectors[index].iov_len = BatchFrameSize;
+					_headers[index].msg_hdr.msg_name = &(_senders[index]);
+					_headers[index].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+					_headers[index].msg_hdr.msg_iov = &(_vectors[index]);
+					_headers[index].msg_hdr.msg_iovlen = 1;
+					_headers[index].msg_hdr.msg_control = nullptr;
+					_headers[index].msg_hdr.msg_controllen = 0;
+					_headers[index].msg_hdr.msg_flags = 0;
+				}
+
+				int count = ::recvmmsg(SocketDatagram::Descriptor(), _headers.data(), (_batch - 1), MSG_DONTWAIT, nullptr);
+
+				for (int index = 0; index < count; index++) {
+					if ((_headers[index].msg_hdr.msg_flags & MSG_TRUNC) != 0) {
+						TRACE(Trace::Information, (_T("Message is too big for a batch, dropped. Size %d"), _headers[index].msg_len));
+					}
+					else {
+						Handle(&(_frames[index * BatchFrameSize]), static_cast<uint16_t>(_headers[index].msg_len), Core::NodeId(_senders[index]));
+					}
+				}
+#endif
+			}
+			// Sends the answers to a batch of requests in one go, what the socket can not take right now,
+			// or anything that has to wait for earlier answers, is sent through the socket (SendData).
+			void Transmit() {
+				uint32_t sent = 0;
+
+#ifndef __WIN32__
+				if ((_batch > 1) && (_responses.empty() == true) && (_pending.empty() == false)) {
+					uint8_t* frame = &(_frames[(_batch - 1) * BatchFrameSize]);
+
+					for (uint32_t index = 0; index < _pending.size(); index++, frame += Response::FrameSize) {
+						_senders[index] = _pending[index]->Destination();
+						_vectors[index].iov_base = frame;
+						_vectors[index].iov_len = _pending[index]->SendData(frame, Response::FrameSize);
+						_headers[index].msg_hdr.msg_name = &(_senders[index]);
+						_headers[index].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+						_headers[index].msg_hdr.msg_iov = &(_vectors[index]);
+						_headers[index].msg_hdr.msg_iovlen = 1;
+						_headers[index].msg_hdr.msg_control = nullptr;
+						_headers[index].msg_hdr.msg_controllen = 0;
+						_headers[index].msg_hdr.msg_flags = 0;
+					}
 
+					int count = ::sendmmsg(SocketDatagram::Descriptor(), _headers.data(), static_cast<unsigned int>(_pending.size()), MSG_DONTWAIT);
+
+					if (count > 0) {
+						sent = count;
+					}
+				}
+#endif
+
+				for (uint32_t index = sent; index < _pending.size(); index++) {
+					Submit(_pending[index]);
+				}
+
+				_pending.clear();
+			}
 		private:
 			std::string _serverName;
                         string _interfaceName;
-                        uint32_t _poolStart;
-                        uint32_t _poolSize;
+                        const Pool _pool;
 			uint32_t _minAddress;
 			uint32_t _maxAddress;
 			uint32_t _lastIssued;
                         uint32_t _server;
 			uint32_t _router;
-			uint32_t _dns;
-			LeaseList _leases;
+			uint32_t _leaseTime;
+			Template _template;
+			IdentifierMap _reservations; //!< Clients that always get the same address.
+			LeaseTable _leases;
+			string _journalName;
+			LeaseJournal _journal;
+			bool _compacting;
+			Core::ProxyType<Core::IDispatch> _job;
 			std::list< Core::ProxyType<Response> > _responses;
+			uint8_t _batch;
+			std::vector< Core::ProxyType<Response> > _pending;
+#ifndef __WIN32__
+			std::vector<uint8_t> _frames; //!< Requests read in a batch, followed by the answers sent in one.
+			std::vector<struct mmsghdr> _headers;
+			std::vector<struct iovec> _vectors;
+			std::vector<sockaddr_in> _senders;
+#endif
 
 			static Core::ProxyPoolType<Response> _responseFactory;
 		};
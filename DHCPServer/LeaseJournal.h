@@ -0,0 +1,314 @@
+#ifndef __DHCPSERVERLEASEJOURNAL_H__
+#define __DHCPSERVERLEASEJOURNAL_H__
+
+#include "Module.h"
+
+#ifndef __WIN32__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace WPEFramework {
+
+	namespace Plugin {
+
+		// Append only log of the leases handed out, so they survive a restart (or a crash) of the server.
+		// A record is: length (uint32_t), checksum (uint32_t) and a payload of type (uint8_t), address
+		// (uint32_t), expiration (uint64_t) and the client identifier (uint8_t length + bytes), in host
+		// byte order. The latest record of an address or client wins. A torn record at the end (crash
+		// while writing) fails the checksum, it and anything after it is ignored.
+		// The log is rewritten with one record per lease (Compact) when it is opened and whenever it holds
+		// too many records that are overruled by later ones.
+#ifndef __WIN32__
+		class LeaseJournal {
+		private:
+			LeaseJournal(const LeaseJournal&) = delete;
+			LeaseJournal& operator= (const LeaseJournal&) = delete;
+
+			static constexpr uint32_t HeaderSize = 2 * sizeof(uint32_t);
+			static constexpr uint32_t FixedSize = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint8_t);
+
+		public:
+			enum type {
+				LEASE = 1,
+				RELEASE = 2
+			};
+
+		public:
+			LeaseJournal() : _fileName(), _handle(-1), _records(0), _unsynced(false), _record(), _temporary(-1), _snapshot(), _snapshotRecords(0), _tail(), _tailRecords(0) {
+			}
+			~LeaseJournal() {
+				Close();
+			}
+
+		public:
+			inline bool IsOpen() const {
+				return (_handle != -1);
+			}
+			inline uint32_t Records() const {
+				return (_records);
+			}
+
+			// Calls action(type, address, expiration, id, length) for every intact record, in order. The whole
+			// file is read in one go, it is small. Returns the number of records.
+			template <typename ACTION>
+			static uint32_t Replay(const string& fileName, ACTION& action) {
+				uint32_t result = 0;
+				int handle = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+
+				if (handle != -1) {
+					struct stat info;
+
+					if ((::fstat(handle, &info) == 0) && (info.st_size > 0)) {
+						std::vector<uint8_t> buffer(static_cast<size_t>(info.st_size));
+
+						if (::read(handle, buffer.data(), buffer.size()) == static_cast<ssize_t>(buffer.size())) {
+							uint32_t offset = 0;
+							uint32_t header[2];
+							bool intact = true;
+
+							while ((intact == true) && ((offset + HeaderSize) <= buffer.size())) {
+								::memcpy(header, &(buffer[offset]), sizeof(header));
+
+								intact = ((header[0] >= FixedSize) && ((offset + HeaderSize + header[0]) <= buffer.size()) && (Checksum(&(buffer[offset + HeaderSize]), header[0]) == header[1]));
+
+								if (intact == true) {
+									const uint8_t* payload = &(buffer[offset + HeaderSize]);
+									uint32_t address;
+									uint64_t expiration;
+
+									::memcpy(&address, &(payload[1]), sizeof(address));
+									::memcpy(&expiration, &(payload[1 + sizeof(address)]), sizeof(expiration));
+
+									intact = ((FixedSize + payload[FixedSize - 1]) == header[0]);
+
+									if (intact == true) {
+										action(static_cast<type>(payload[0]), address, expiration, &(payload[FixedSize]), payload[FixedSize - 1]);
+										offset += HeaderSize + header[0];
+										result++;
+									}
+								}
+							}
+						}
+					}
+
+					::close(handle);
+				}
+
+				return (result);
+			}
+
+			// Replaces the log by one that holds a record for each of the leases (anything with Next() and
+			// Current(), giving a Lease), and continues appending to it.
+			template <typename ITERATOR>
+			bool Compact(const string& fileName, ITERATOR& leases) {
+				Close();
+
+				_fileName = fileName;
+
+				Snapshot(leases);
+
+				bool result = Finish(Write());
+
+				// If it could not be rewritten, keep on appending to what is there.
+				if (_handle == -1) {
+					_handle = ::open(_fileName.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+				}
+
+				return (result);
+			}
+			// Compact in steps, so the leases only need to be locked for the Snapshot and to Finish, the bulk
+			// is written and synced (Write) without them. What is appended in between is kept, for Finish.
+			template <typename ITERATOR>
+			void Snapshot(ITERATOR& leases) {
+				_snapshot.clear();
+				_snapshotRecords = 0;
+				_tail.clear();
+				_tailRecords = 0;
+
+				while (leases.Next() == true) {
+					Add(_snapshot, LEASE, leases.Current().Raw(), leases.Current().Expiration(), leases.Current().Id().Id(), leases.Current().Id().Length());
+					_snapshotRecords++;
+				}
+
+				_temporary = ::open((_fileName + _T(".tmp")).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			}
+			bool Write() {
+				return ((_temporary != -1) && (::write(_temporary, _snapshot.data(), _snapshot.size()) == static_cast<ssize_t>(_snapshot.size())) && (::fdatasync(_temporary) == 0));
+			}
+			bool Finish(const bool written) {
+				const string temporary(_fileName + _T(".tmp"));
+				bool result = (written == true) &&
+				              (::write(_temporary, _tail.data(), _tail.size()) == static_cast<ssize_t>(_tail.size())) &&
+				              ((_tail.empty() == true) || (::fdatasync(_temporary) == 0)) &&
+				              (::rename(temporary.c_str(), _fileName.c_str()) == 0);
+
+				if (_temporary != -1) {
+					::close(_temporary);
+					_temporary = -1;
+				}
+
+				if (result == true) {
+					// The old log is gone, the new one must be found after a crash, before anything is promised from it.
+					SyncDirectory(_fileName);
+
+					Close();
+
+					_handle = ::open(_fileName.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+					_records = _snapshotRecords + _tailRecords;
+				}
+				else {
+					TRACE_L1("Could not compact lease journal %s, error %d", _fileName.c_str(), errno);
+					::unlink(temporary.c_str());
+				}
+
+				_snapshot.clear();
+				_tail.clear();
+
+				return (result);
+			}
+			void Close() {
+				if (_handle != -1) {
+					::fdatasync(_handle);
+					::close(_handle);
+					_handle = -1;
+					_unsynced = false;
+				}
+			}
+			// A record that is promised to a client (sync) must be on disk before the answer is sent, which
+			// is what the next Sync() takes care of. Records of a whole batch of requests share one sync.
+			void Sync() {
+				if (_unsynced == true) {
+					::fdatasync(_handle);
+					_unsynced = false;
+				}
+			}
+			void Append(const type kind, const uint32_t address, const uint64_t expiration, const uint8_t id[], const uint8_t length, const bool sync) {
+				if (_handle != -1) {
+					_record.clear();
+
+					Add(_record, kind, address, expiration, id, length);
+
+					if (::write(_handle, _record.data(), _record.size()) != static_cast<ssize_t>(_record.size())) {
+						TRACE_L1("Could not write to lease journal %s, error %d", _fileName.c_str(), errno);
+					}
+					else {
+						_records++;
+						_unsynced = (_unsynced == true) || (sync == true);
+
+						if (_temporary != -1) {
+							// Compacting, the log that replaces this one must have it as well.
+							_tail.insert(_tail.end(), _record.begin(), _record.end());
+							_tailRecords++;
+						}
+					}
+				}
+			}
+
+		private:
+			static void Add(std::vector<uint8_t>& buffer, const type kind, const uint32_t address, const uint64_t expiration, const uint8_t id[], const uint8_t length) {
+				const uint32_t offset = static_cast<uint32_t>(buffer.size());
+				uint32_t header[2] = { FixedSize + length, 0 };
+
+				buffer.resize(offset + HeaderSize + header[0]);
+
+				uint8_t* payload = &(buffer[offset + HeaderSize]);
+
+				payload[0] = static_cast<uint8_t>(kind);
+				::memcpy(&(payload[1]), &address, sizeof(address));
+				::memcpy(&(payload[1 + sizeof(address)]), &expiration, sizeof(expiration));
+				payload[FixedSize - 1] = length;
+				::memcpy(&(payload[FixedSize]), id, length);
+
+				header[1] = Checksum(payload, header[0]);
+				::memcpy(&(buffer[offset]), header, sizeof(header));
+			}
+			static void SyncDirectory(const string& fileName) {
+				size_t slash = fileName.find_last_of('/');
+				const string directory(slash == string::npos ? string(_T(".")) : (slash == 0 ? string(_T("/")) : fileName.substr(0, slash)));
+				int handle = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+				if (handle != -1) {
+					::fsync(handle);
+					::close(handle);
+				}
+			}
+			static uint32_t Checksum(const uint8_t data[], const uint32_t length) {
+				// FNV-1a
+				uint32_t result = 2166136261u;
+
+				for (uint32_t index = 0; index < length; index++) {
+					result = (result ^ data[index]) * 16777619u;
+				}
+
+				return (result);
+			}
+
+		private:
+			string _fileName;
+			int _handle;
+			uint32_t _records;
+			bool _unsynced;
+			std::vector<uint8_t> _record;
+			int _temporary;
+			std::vector<uint8_t> _snapshot;
+			uint32_t _snapshotRecords;
+			std::vector<uint8_t> _tail;
+			uint32_t _tailRecords;
+		};
+#else
+		// No journal, leases do not survive a restart.
+		class LeaseJournal {
+		private:
+			LeaseJournal(const LeaseJournal&) = delete;
+			LeaseJournal& operator= (const LeaseJournal&) = delete;
+
+		public:
+			enum type {
+				LEASE = 1,
+				RELEASE = 2
+			};
+
+		public:
+			LeaseJournal() {
+			}
+			~LeaseJournal() {
+			}
+
+		public:
+			inline bool IsOpen() const {
+				return (false);
+			}
+			inline uint32_t Records() const {
+				return (0);
+			}
+			template <typename ACTION>
+			static uint32_t Replay(const string&, ACTION&) {
+				return (0);
+			}
+			template <typename ITERATOR>
+			bool Compact(const string&, ITERATOR&) {
+				return (false);
+			}
+			template <typename ITERATOR>
+			void Snapshot(ITERATOR&) {
+			}
+			bool Write() {
+				return (false);
+			}
+			bool Finish(const bool) {
+				return (false);
+			}
+			void Close() {
+			}
+			void Sync() {
+			}
+			void Append(const type, const uint32_t, const uint64_t, const uint8_t[], const uint8_t, const bool) {
+			}
+		};
+#endif
+	}
+}
+
+#endif // __DHCPSERVERLEASEJOURNAL_H__
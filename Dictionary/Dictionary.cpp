@@ -22,12 +22,49 @@ static bool IsValidName(const string& value)
     return ((value.empty() == false) && (value.find_first_of(Dictionary::NameSpaceDelimiter, 0) == static_cast<size_t>(~0)));
 }
 
+static bool IsValidStructure(const Dictionary::NameSpace& current)
+{
+    bool result = true;
+    Core::JSON::ArrayType<Dictionary::NameSpace::Entry>::ConstIterator keyIndex(current.Dictionary.Elements());
+    Core::JSON::ArrayType<Dictionary::NameSpace>::ConstIterator spaceIndex(current.Spaces.Elements());
+
+    while ((result == true) && (keyIndex.Next() == true)) {
+        result = IsValidName(keyIndex.Current().Key.Value());
+    }
+
+    while ((result == true) && (spaceIndex.Next() == true)) {
+        result = (IsValidName(spaceIndex.Current().Name.Value()) == true) && (IsValidStructure(spaceIndex.Current()) == true);
+    }
+
+    return (result);
+}
+
+// The namespace itself, or one nested in it. Everything is nested in the root namespace.
+static bool IsInside(const string& nameSpace, const string& space)
+{
+    return ((nameSpace.empty() == true) || ((space.compare(0, nameSpace.length(), nameSpace) == 0) && ((space.length() == nameSpace.length()) || (space[nameSpace.length()] == Dictionary::NameSpaceDelimiter))));
+}
+
+Dictionary::KeyMap& Dictionary::Keys(const string& nameSpace)
+{
+    const Space* space(_dictionary.Find(nameSpace));
+
+    if (space == nullptr) {
+        _dictionary.Set(Space(nameSpace, new KeyMap(_epoch)));
+        space = _dictionary.Find(nameSpace);
+
+        ASSERT(space != nullptr);
+    }
+
+    return (space->Keys());
+}
+
 bool Dictionary::CreateInternalDictionary(const string& currentSpace, const NameSpace& current)
 {
     bool correctStructure(true);
     Core::JSON::ArrayType<NameSpace::Entry>::ConstIterator keyIndex(current.Dictionary.Elements());
     Core::JSON::ArrayType<NameSpace>::ConstIterator spaceIndex(current.Spaces.Elements());
-    std::list<RuntimeEntry>* currentList = NULL;
+    KeyMap* currentList = NULL;
 
     // Fill in the keys from this name space...
     while ((correctStructure == true) && (keyIndex.Next() == true)) {
@@ -37,12 +74,10 @@ bool Dictionary::CreateInternalDictionary(const string& currentSpace, const Name
 
         if (correctStructure == true) {
             if (currentList == NULL) {
-                currentList = &(_dictionary[currentSpace]);
-
-                ASSERT(currentList != NULL);
+                currentList = &(Keys(currentSpace));
             }
 
-            currentList->push_back(RuntimeEntry(key, keyIndex.Current().Value.Value(), keyIndex.Current().Type.Value()));
+            currentList->Set(RuntimeEntry(key, keyIndex.Current().Value.Value(), keyIndex.Current().Type.Value()));
         }
     }
 
@@ -57,47 +92,129 @@ bool Dictionary::CreateInternalDictionary(const string& currentSpace, const Name
 
 void Dictionary::CreateExternalDictionary(const string& currentSpace, NameSpace& current) const
 {
-    Core::TextFragment requiredSpace(currentSpace);
-    DictionaryMap::const_iterator index(_dictionary.begin());
+    DictionaryMap::Iterator index(_dictionary);
+
+    while (index.Next() == true) {
+        const Space& space(index.Current());
 
-    while (index != _dictionary.end()) {
         // Vallidate if the given path does include this namespace..
-        if ((currentSpace.empty() == true) || (requiredSpace.EqualText(index->first.c_str(), 0, requiredSpace.Length(), true) == true)) {
+        if (IsInside(currentSpace, space.Key()) == true) {
             // Seems like we need to report this space, build it up
-            NameSpace& blockToFill(current[index->first]);
+            NameSpace& blockToFill(current[space.Key()]);
 
             // No we got the namespace bloc, fill in the keys..
-            const std::list<RuntimeEntry>& keyList(index->second);
-            std::list<RuntimeEntry>::const_iterator keyIndex(keyList.begin());
+            KeyMap::Iterator keyIndex(space.Keys());
 
-            while (keyIndex != keyList.end()) {
+            while (keyIndex.Next() == true) {
+                const RuntimeEntry& runtime(keyIndex.Current());
                 NameSpace::Entry& entry(blockToFill.Dictionary.Add(NameSpace::Entry()));
-                entry.Key = keyIndex->Key();
-                entry.Value = keyIndex->Value();
+                entry.Key = runtime.Key();
+                entry.Value = runtime.Value();
 
-                if (keyIndex->Type() != entry.Type.Default()) {
-                    entry.Type = keyIndex->Type();
+                if (runtime.Type() != entry.Type.Default()) {
+                    entry.Type = runtime.Type();
                 }
-
-                keyIndex++;
             }
         }
-        index++;
     }
 }
 
+void Dictionary::Flush()
+{
+    _journal.Sync();
+
+    _adminLock.Lock();
+    bool compact = (_journal.Size() >= (_config.CompactSize.Value() * 1024));
+    _adminLock.Unlock();
+
+    if (compact == true) {
+        Compact();
+    }
+}
+
+// The snapshot is taken, and the journal is rotated, under the lock, the file is written without it.
+void Dictionary::Compact()
+{
+    NameSpace dictionary;
+    string content;
+
+    _adminLock.Lock();
+    CreateExternalDictionary(EMPTY_STRING, dictionary);
+    _journal.Rotate();
+    _dirty = false;
+    _adminLock.Unlock();
+
+    dictionary.ToString(content);
+
+    if (Save(content) == true) {
+        _journal.Retire();
+    }
+}
+
+// Write a new file and move it over the old one, so there always is a complete storage file.
+bool Dictionary::Save(const string& content) const
+{
+    bool result = false;
+    const string fileName(_storage + _T(".tmp"));
+    int handle = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (handle != -1) {
+        result = ((::write(handle, content.c_str(), content.length()) == static_cast<ssize_t>(content.length())) && (::fsync(handle) == 0));
+
+        ::close(handle);
+
+        result = result && (::rename(fileName.c_str(), _storage.c_str()) == 0);
+
+        if (result == true) {
+            Journal::SyncDirectory(_storage);
+        }
+    }
+
+    if (result == false) {
+        TRACE_L1("Could not save the dictionary to %s, error %d", _storage.c_str(), errno);
+    }
+
+    return (result);
+}
+
 /* virtual */ const string Dictionary::Initialize(PluginHost::IShell* service)
 {
     _config.FromString(service->ConfigLine());
 
-    Core::File dictionaryFile(service->PersistentPath() + _config.Storage.Value());
+    _storage = service->PersistentPath() + _config.Storage.Value();
+
+    Core::File dictionaryFile(_storage);
 
     if (dictionaryFile.Open(true) == true) {
         NameSpace dictionary;
         dictionary.FromFile(dictionaryFile);
+
+        _adminLock.Lock();
         CreateInternalDictionary(EMPTY_STRING, dictionary);
+        _adminLock.Unlock();
     }
 
+    // Apply the changes to persistent keys made after the storage file was written.
+    auto replay = [this](const string& nameSpace, const string& key, const string& value, const uint8_t type) {
+        Keys(nameSpace).Set(RuntimeEntry(key, value, static_cast<enumType>(type)));
+    };
+    uint32_t size = 0;
+
+    _adminLock.Lock();
+    uint32_t records = Journal::Replay(_storage + _T(".log.old"), replay, size);
+    records += Journal::Replay(_storage + _T(".log"), replay, size);
+    _adminLock.Unlock();
+
+    _journal.Open(_storage + _T(".log"), size);
+
+    if (records != 0) {
+        TRACE(Trace::Information, (_T("Replayed %d journal records."), records));
+        Compact();
+    }
+
+    _flusher.Start(_config.SyncInterval.Value());
+    _notifier.Start(_config.NotifyBatch.Value(), _config.NotifyDelay.Value());
+
     _skipURL = static_cast<uint8_t>(service->WebPrefix().length());
 
     // On succes return a name as a Callsign to be used in the URL, after the "service"prefix
@@ -106,30 +223,55 @@ void Dictionary::CreateExternalDictionary(const string& currentSpace, NameSpace&
 
 /* virtual */ void Dictionary::Deinitialize(PluginHost::IShell* service)
 {
+    _notifier.Terminate();
+    _flusher.Terminate();
 
-    Core::File dictionaryFile(service->PersistentPath() + _config.Storage.Value());
-
-    if (dictionaryFile.Open(true) == true) {
-        NameSpace dictionary;
-        CreateExternalDictionary(EMPTY_STRING, dictionary);
-        dictionary.ToFile(dictionaryFile);
+    // Volatile keys are not journaled, but they are kept over a restart, so save them now. If nothing
+    // changed since the last compaction, there is nothing to write.
+    if ((_dirty == true) || (_journal.Size() != 0)) {
+        Compact();
     }
+
+    _journal.Close();
 }
 
 /* virtual */ string Dictionary::Information() const
 {
-    // No additional info to report.
-    return (string());
+    // Report how the observers keep up with the changes.
+    Statistics info;
+    std::list<Notifier::Statistics> observers;
+    string result;
+
+    _notifier.Snapshot(observers);
+
+    std::list<Notifier::Statistics>::const_iterator index(observers.begin());
+
+    while (index != observers.end()) {
+        info.Observers.Add(Statistics::Observer(*index));
+        index++;
+    }
+
+    info.ToString(result);
+
+    return (result);
 }
 
 /* virtual */ void Dictionary::Inbound(Web::Request& request)
 {
-    // There are no requests coming in with a body that require a JSON body. So continue without action here.
-    request.Body(Core::ProxyType<Web::IBody>(textBodyDataFactory.Element()));
+    // Only the multi key set comes with a JSON body, a single key gets its value as text.
+    if (request.Verb == Web::Request::HTTP_PUT) {
+        request.Body(Core::ProxyType<Web::IBody>(jsonBodyDataFactory.Element()));
+    }
+    else {
+        request.Body(Core::ProxyType<Web::IBody>(textBodyDataFactory.Element()));
+    }
 }
 
 // <GET> ../[namespace/]{Key}
-// <PUT> ../[namespace/]{Key}?Type=[persistent|volatile|closure]
+// <GET> ../[namespace/]?Keys=key1,key2,...
+// <GET> ../[namespace/]
+// <POST> ../[namespace/]{Key}?Type=[persistent|volatile|closure]
+// <PUT> ../[namespace/]
 /* virtual */ Core::ProxyType<Web::Response> Dictionary::Process(const Web::Request& request)
 {
     ASSERT(_skipURL <= request.Path.length());
@@ -155,7 +297,37 @@ void Dictionary::CreateExternalDictionary(const string& currentSpace, NameSpace&
         key = index.Current().Text();
     }
 
-    if (request.Verb == Web::Request::HTTP_GET) {
+    if ((request.Verb == Web::Request::HTTP_GET) && (key.empty() == true)) {
+        Core::ProxyType<Web::JSONBodyType<NameSpace> > response(jsonBodyDataFactory.Element());
+        Core::TextSegmentIterator queryIterator(Core::TextSegmentIterator(Core::TextFragment(request.Query), true, '='));
+
+        if ((queryIterator.Next() == true) && (queryIterator.Current() == _T("Keys")) && (queryIterator.Next() == true)) {
+            // Batch get, the keys found are reported in their namespace.
+            Core::TextSegmentIterator keyIterator(queryIterator.Current(), false, ',');
+            std::list<string> keys;
+
+            while (keyIterator.Next() == true) {
+                keys.push_back(keyIterator.Current().Text());
+            }
+
+            Get(nameSpace, keys, (*response)[nameSpace]);
+        }
+        else {
+            // All keys in this namespace and the ones nested in it.
+            auto reader = [this, &nameSpace, &response]() {
+                Epoch::Guard guard(_epoch);
+
+                response->Clear();
+                CreateExternalDictionary(nameSpace, *response);
+            };
+
+            Consistent(reader);
+        }
+
+        result->Body(Core::proxy_cast<Web::IBody>(response));
+        result->ContentType = Web::MIMETypes::MIME_JSON;
+    }
+    else if (request.Verb == Web::Request::HTTP_GET) {
         string value;
         Core::ProxyType<Web::TextBody> valueBody(textBodyDataFactory.Element());
 
@@ -172,17 +344,27 @@ void Dictionary::CreateExternalDictionary(const string& currentSpace, NameSpace&
         const string value(valueBody.IsValid() == true ? string(*valueBody) : string());
         Core::TextSegmentIterator typeIterator(Core::TextSegmentIterator(Core::TextFragment(request.Query), true, '='));
 
+        bool typed = false;
+
         if ((typeIterator.Next() == true) && (typeIterator.Current() == _T("Type")) && (typeIterator.Next() == true)) {
             // Seems we have a type specifier
             keyType = Core::EnumerateType<Dictionary::enumType>(typeIterator.Current(), false).Value();
+            typed = true;
         }
 
         TRACE(Trace::Information, (_T("SetKey ( %s, %s, %s)"), key.c_str(), value.c_str(), Core::EnumerateType<Dictionary::enumType>(keyType).Data()));
-        Set(nameSpace, key, value);
+        Set(nameSpace, key, value, (typed == true ? &keyType : nullptr));
 
         result->ErrorCode = Web::STATUS_OK;
         result->Message = _T("OK");
     }
+    else if ((request.Verb == Web::Request::HTTP_PUT) && (key.empty() == true) && (request.HasBody() == true)) {
+        // The names in the body are relative to the namespace of the path.
+        if (Set(nameSpace, *(request.Body<const Web::JSONBodyType<NameSpace> >())) == false) {
+            result->ErrorCode = Web::STATUS_BAD_REQUEST;
+            result->Message = _T("Invalid key or namespace name.");
+        }
+    }
     else {
         result->ErrorCode = Web::STATUS_BAD_REQUEST;
         result->Message = _T("Bad request.");
@@ -191,29 +373,25 @@ void Dictionary::CreateExternalDictionary(const string& currentSpace, NameSpace&
     return (result);
 }
 
+// Readers do not take the _adminLock, the epoch guard keeps what they find alive till they are done.
 /* virtual */ bool Dictionary::Get(const string& nameSpace, const string& key, string& value) const
 {
     bool result = false;
 
-    _adminLock.Lock();
+    auto reader = [this, &nameSpace, &key, &value, &result]() {
+        Epoch::Guard guard(_epoch);
 
-    DictionaryMap::const_iterator index(_dictionary.find(nameSpace));
+        const Space* space(_dictionary.Find(nameSpace));
+        const RuntimeEntry* entry(space != nullptr ? space->Keys().Find(key) : nullptr);
 
-    if (index != _dictionary.end()) {
-        const std::list<RuntimeEntry>& container(index->second);
-        std::list<RuntimeEntry>::const_iterator listIndex(container.begin());
+        result = (entry != nullptr);
 
-        while ((listIndex != container.end()) && (listIndex->Key() != key)) {
-            listIndex++;
+        if (result == true) {
+            value = entry->Value();
         }
+    };
 
-        if (listIndex != container.end()) {
-            result = true;
-            value = listIndex->Value();
-        }
-    }
-
-    _adminLock.Unlock();
+    Consistent(reader);
 
     return (result);
 }
@@ -223,60 +401,85 @@ void Dictionary::CreateExternalDictionary(const string& currentSpace, NameSpace&
     static Core::ProxyPoolType<Dictionary::Iterator> iterators(4);
 
     Exchange::IDictionary::IIterator* result = nullptr;
+    Core::ProxyType<Iterator> entries (iterators.Element());
+    bool found = false;
 
-    _adminLock.Lock();
+    auto reader = [this, &nameSpace, &entries, &found]() {
+        Epoch::Guard guard(_epoch);
 
-    DictionaryMap::const_iterator index(_dictionary.find(nameSpace));
+        const Space* space(_dictionary.Find(nameSpace));
 
-    if (index != _dictionary.end()) {
-        Core::ProxyType<Iterator> entries (iterators.Element());
+        found = (space != nullptr);
 
-        entries->Load(InternalIterator(index->second));
+        if (found == true) {
+            entries->Load(space->Keys());
+        }
+    };
 
+    Consistent(reader);
+
+    if (found == true) {
         result = &(*entries);
         result->AddRef();
     }
 
-    _adminLock.Unlock();
-
     return (result);
 }
 
+uint32_t Dictionary::Get(const string& nameSpace, const std::list<string>& keys, NameSpace& result) const
+{
+    uint32_t found = 0;
+
+    auto reader = [this, &nameSpace, &keys, &result, &found]() {
+        Epoch::Guard guard(_epoch);
+
+        const Space* space(_dictionary.Find(nameSpace));
+
+        result.Dictionary.Clear();
+        found = 0;
+
+        if (space != nullptr) {
+            std::list<string>::const_iterator index(keys.begin());
+
+            while (index != keys.end()) {
+                const RuntimeEntry* entry(space->Keys().Find(*index));
+
+                if (entry != nullptr) {
+                    result.Dictionary.Add(NameSpace::Entry(entry->Key(), entry->Value(), entry->Type()));
+                    found++;
+                }
+                index++;
+            }
+        }
+    };
+
+    Consistent(reader);
+
+    return (found);
+}
+
 // Direct method to Set a value for a key in a certain namespace from the dictionary.
 // NameSpace and key MUST be filled.
 /* virtual */ bool Dictionary::Set(const string& nameSpace, const string& key, const string& value)
 {
-    // Direct method to Set a value for a key in a certain namespace from the dictionary.
-    bool result = false;
+    return (Set(nameSpace, key, value, nullptr));
+}
 
+bool Dictionary::Set(const string& nameSpace, const string& key, const string& value, const enumType* type)
+{
+    // Writers are serialized by the _adminLock.
     _adminLock.Lock();
 
-    std::list<RuntimeEntry>& container(_dictionary[nameSpace]);
-    std::list<RuntimeEntry>::iterator listIndex(container.begin());
+    bool result = Update(nameSpace, key, value, type);
 
-    while ((listIndex != container.end()) && (listIndex->Key() != key)) {
-        listIndex++;
-    }
-
-    if (listIndex == container.end()) {
-        result = true;
-        container.push_back(RuntimeEntry(key, value, VOLATILE));
-    }
-    else if (listIndex->Value() != value) {
-        result = true;
-        listIndex->Value(value);
+    if (_config.SyncInterval.Value() == 0) {
+        _journal.Sync();
     }
 
     if (result == true) {
-        ObserverMap::iterator index(_observers.begin());
-
-        // Right, we updated send out the modification !!!
-        while (index != _observers.end()) {
-            if (index->first == nameSpace) {
-                index->second->Modified(nameSpace, key, value);
-            }
-            index++;
-        }
+        // Right, we updated send out the modification !!! Only queued here, so the order of the changes is kept
+        // but the observers are called without holding the lock.
+        _notifier.Modified(nameSpace, key, value);
     }
 
     _adminLock.Unlock();
@@ -284,46 +487,99 @@ void Dictionary::CreateExternalDictionary(const string& currentSpace, NameSpace&
     return (result);
 }
 
-/* virtual */ void Dictionary::Register(const string& nameSpace, struct Exchange::IDictionary::INotification* sink)
+bool Dictionary::Set(const string& nameSpace, const NameSpace& changes)
 {
-    _adminLock.Lock();
+    // Check everything first, so it is all or nothing.
+    bool result = IsValidStructure(changes);
 
-#ifdef __DEBUG__
-    ObserverMap::iterator index(_observers.begin());
+    if (result == true) {
+        std::vector<Notifier::Modification> modifications;
 
-    // DO NOT REGISTER THE SAME NOTIFICATION SINK ON THE SAME NAMESPACE MORE THAN ONCE. !!!!!!
-    while (index != _observers.end()) {
-        ASSERT((index->second != sink) || (nameSpace != index->first));
+        _adminLock.Lock();
 
-        index++;
+        // Readers that overlap the odd version try again, so the batch is published as a whole.
+        _version.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        Update(nameSpace, changes, modifications);
+
+        _version.fetch_add(1, std::memory_order_release);
+
+        // The journal is synced once for the whole batch, and not while readers wait for it.
+        if (_config.SyncInterval.Value() == 0) {
+            _journal.Sync();
+        }
+
+        if (modifications.empty() == false) {
+            _notifier.Modified(modifications);
+        }
+
+        _adminLock.Unlock();
     }
-#endif
 
-    _observers.push_back(std::pair<string, struct Exchange::IDictionary::INotification*>(nameSpace, sink));
+    return (result);
+}
 
-    _adminLock.Unlock();
+void Dictionary::Update(const string& nameSpace, const NameSpace& changes, std::vector<Notifier::Modification>& modifications)
+{
+    Core::JSON::ArrayType<NameSpace::Entry>::ConstIterator keyIndex(changes.Dictionary.Elements());
+    Core::JSON::ArrayType<NameSpace>::ConstIterator spaceIndex(changes.Spaces.Elements());
+
+    while (keyIndex.Next() == true) {
+        const NameSpace::Entry& entry(keyIndex.Current());
+        const enumType type(entry.Type.Value());
+
+        if (Update(nameSpace, entry.Key.Value(), entry.Value.Value(), (entry.Type.IsSet() == true ? &type : nullptr)) == true) {
+            Notifier::Modification modification;
+            modification.NameSpace = nameSpace;
+            modification.Key = entry.Key.Value();
+            modification.Value = entry.Value.Value();
+            modifications.push_back(modification);
+        }
+    }
+
+    while (spaceIndex.Next() == true) {
+        Update(nameSpace + NameSpaceDelimiter + spaceIndex.Current().Name.Value(), spaceIndex.Current(), modifications);
+    }
 }
 
-/* virtual */ void Dictionary::Unregister(const string& nameSpace, struct Exchange::IDictionary::INotification* sink)
+bool Dictionary::Update(const string& nameSpace, const string& key, const string& value, const enumType* type)
 {
-    bool found = false;
+    bool result = false;
 
-    _adminLock.Lock();
+    KeyMap& container(Keys(nameSpace));
+    const RuntimeEntry* entry(container.Find(key));
+    const enumType previous(entry == nullptr ? VOLATILE : entry->Type());
+    const enumType current(type == nullptr ? previous : *type);
+
+    result = ((entry == nullptr) || (entry->Value() != value));
 
-    ObserverMap::iterator index(_observers.begin());
+    if ((result == true) || (current != previous)) {
+        container.Set(RuntimeEntry(key, value, current));
+        _dirty = true;
 
-    while ((found == false) && (index != _observers.end())) {
-        found = ((index->second == sink) && (nameSpace == index->first));
-        if (found == false) {
-            index++;
+        // Journal the persistent keys, and the ones that just stopped being persistent.
+        if ((current == PERSISTENT) || (previous == PERSISTENT)) {
+            _journal.Append(nameSpace, key, value, current);
+
+            if (_journal.Size() >= (_config.CompactSize.Value() * 1024)) {
+                _flusher.Signal();
+            }
         }
     }
 
-    if (index != _observers.end()) {
-        _observers.erase(index);
-    }
+    return (result);
+}
 
-    _adminLock.Unlock();
+// The sink is referenced till it is unregistered, the changes are delivered to it from the notifier thread.
+/* virtual */ void Dictionary::Register(const string& nameSpace, struct Exchange::IDictionary::INotification* sink)
+{
+    _notifier.Register(nameSpace, sink);
+}
+
+/* virtual */ void Dictionary::Unregister(const string& nameSpace, struct Exchange::IDictionary::INotification* sink)
+{
+    _notifier.Unregister(nameSpace, sink);
 }
 
 }
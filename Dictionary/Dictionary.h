@@ -2,6 +2,9 @@
 #define __DICTIONARY_H
 
 #include "Module.h"
+#include "HashTable.h"
+#include "Journal.h"
+#include "Notifier.h"
 #include <interfaces/IDictionary.h>
 
 namespace WPEFramework {
@@ -20,27 +23,26 @@ private:
     Dictionary(const Dictionary&) = delete;
     Dictionary& operator=(const Dictionary&) = delete;
 
+    // Once in the dictionary, an entry is read without a lock, so it is never changed. A new
+    // value is a new entry.
     class RuntimeEntry {
     public:
         RuntimeEntry()
             : _key()
             , _value()
             , _type(VOLATILE)
-            , _dirty(false)
         {
         }
         RuntimeEntry(const RuntimeEntry& copy)
             : _key(copy._key)
             , _value(copy._value)
             , _type(copy._type)
-            , _dirty(false)
         {
         }
         RuntimeEntry(const string& key, const string& value, const enumType& type)
             : _key(key)
             , _value(value)
             , _type(type)
-            , _dirty(false)
         {
         }
         ~RuntimeEntry()
@@ -65,11 +67,6 @@ private:
         {
             return (_value);
         }
-        inline void Value(const string& value)
-        {
-            _dirty = true;
-            _value = value;
-        }
         inline enumType Type() const
         {
             return (_type);
@@ -79,11 +76,46 @@ private:
         string _key;
         string _value;
         enumType _type;
-        bool _dirty;
     };
 
-    typedef std::map<const string, std::list<RuntimeEntry> > DictionaryMap;
-    typedef std::list<std::pair<const string, struct Exchange::IDictionary::INotification*> > ObserverMap;
+    typedef HashTableType<RuntimeEntry> KeyMap;
+
+    // Namespaces are never removed, so the key table of a namespace lives as long as the dictionary.
+    class Space {
+    public:
+        Space() = delete;
+        Space& operator=(const Space&) = delete;
+
+        Space(const string& name, KeyMap* keys)
+            : _name(name)
+            , _keys(keys)
+        {
+        }
+        Space(const Space& copy)
+            : _name(copy._name)
+            , _keys(copy._keys)
+        {
+        }
+        ~Space()
+        {
+        }
+
+    public:
+        inline const string& Key() const
+        {
+            return (_name);
+        }
+        inline KeyMap& Keys() const
+        {
+            return (*_keys);
+        }
+
+    private:
+        string _name;
+        KeyMap* _keys;
+    };
+
+    typedef HashTableType<Space> DictionaryMap;
     typedef Core::IteratorType<const std::list<RuntimeEntry>, const RuntimeEntry&, std::list<RuntimeEntry>::const_iterator> InternalIterator;
 
 public:
@@ -93,7 +125,7 @@ public:
         Iterator& operator= (const Iterator&) = delete;
 
 public:
-        Iterator() : _iterator(), _lifeTime(nullptr) {
+        Iterator() : _entries(), _iterator(), _lifeTime(nullptr) {
         }
         ~Iterator() {
         }
@@ -103,9 +135,19 @@ public:
         }
 
     public:
-        void Load(const InternalIterator& iterator) {
+        // The entries are copied, so the iterator does not hold up the writers.
+        void Load(const KeyMap& keys) {
             ASSERT(_lifeTime != nullptr);
-            _iterator = iterator;
+
+            KeyMap::Iterator index(keys);
+
+            _entries.clear();
+
+            while (index.Next() == true) {
+                _entries.push_back(index.Current());
+            }
+
+            _iterator = InternalIterator(_entries);
         }
         // IUnknown implementation
         // -----------------------------------------------
@@ -142,6 +184,7 @@ public:
         }
 
     private:
+        std::list<RuntimeEntry> _entries;
         InternalIterator _iterator;
         Core::IReferenceCounted* _lifeTime;
     };
@@ -298,9 +341,17 @@ public:
             : Core::JSON::Container()
             , Storage(_T("dictionary.json"))
             , LingerTime(10)
+            , SyncInterval(1000)
+            , CompactSize(64)
+            , NotifyBatch(0)
+            , NotifyDelay(0)
         { // Time in minutes.
             Add(_T("storage"), &Storage);
             Add(_T("lingertime"), &LingerTime);
+            Add(_T("syncinterval"), &SyncInterval);
+            Add(_T("compactsize"), &CompactSize);
+            Add(_T("notifybatch"), &NotifyBatch);
+            Add(_T("notifydelay"), &NotifyDelay);
         }
         ~Config()
         {
@@ -309,6 +360,158 @@ public:
     public:
         Core::JSON::String Storage;
         Core::JSON::DecUInt16 LingerTime;
+        Core::JSON::DecUInt32 SyncInterval; // Time in milliseconds between syncs of the journal, 0 syncs every change.
+        Core::JSON::DecUInt32 CompactSize; // Size in KB of the journal, before it is compacted into the storage.
+        Core::JSON::DecUInt16 NotifyBatch; // Changes delivered to an observer in one go, 0 is all pending changes.
+        Core::JSON::DecUInt16 NotifyDelay; // Time in milliseconds changes are held back, to coalesce bursts.
+    };
+
+    class Statistics : public Core::JSON::Container {
+    private:
+        Statistics(const Statistics&) = delete;
+        Statistics& operator=(const Statistics&) = delete;
+
+    public:
+        class Observer : public Core::JSON::Container {
+        public:
+            Observer()
+                : Core::JSON::Container()
+                , NameSpace()
+                , Depth(0)
+                , Delivered(0)
+                , Coalesced(0)
+                , Latency(0)
+                , MaxLatency(0)
+            {
+                Add(_T("namespace"), &NameSpace);
+                Add(_T("depth"), &Depth);
+                Add(_T("delivered"), &Delivered);
+                Add(_T("coalesced"), &Coalesced);
+                Add(_T("latency"), &Latency);
+                Add(_T("maxlatency"), &MaxLatency);
+            }
+            Observer(const Observer& copy)
+                : Core::JSON::Container()
+                , NameSpace(copy.NameSpace)
+                , Depth(copy.Depth)
+                , Delivered(copy.Delivered)
+                , Coalesced(copy.Coalesced)
+                , Latency(copy.Latency)
+                , MaxLatency(copy.MaxLatency)
+            {
+                Add(_T("namespace"), &NameSpace);
+                Add(_T("depth"), &Depth);
+                Add(_T("delivered"), &Delivered);
+                Add(_T("coalesced"), &Coalesced);
+                Add(_T("latency"), &Latency);
+                Add(_T("maxlatency"), &MaxLatency);
+            }
+            Observer(const Notifier::Statistics& info)
+                : Core::JSON::Container()
+                , NameSpace()
+                , Depth()
+                , Delivered()
+                , Coalesced()
+                , Latency()
+                , MaxLatency()
+            {
+                Add(_T("namespace"), &NameSpace);
+                Add(_T("depth"), &Depth);
+                Add(_T("delivered"), &Delivered);
+                Add(_T("coalesced"), &Coalesced);
+                Add(_T("latency"), &Latency);
+                Add(_T("maxlatency"), &MaxLatency);
+
+                NameSpace = info.NameSpace;
+                Depth = info.Depth;
+                Delivered = info.Delivered;
+                Coalesced = info.Coalesced;
+                Latency = info.Latency;
+                MaxLatency = info.MaxLatency;
+            }
+            virtual ~Observer()
+            {
+            }
+
+        public:
+            Core::JSON::String NameSpace;
+            Core::JSON::DecUInt32 Depth; // Changes waiting to be delivered.
+            Core::JSON::DecUInt32 Delivered;
+            Core::JSON::DecUInt32 Coalesced; // Changes replaced by a later one, before they were delivered.
+            Core::JSON::DecUInt64 Latency; // Average time in microseconds a change waits to be delivered.
+            Core::JSON::DecUInt64 MaxLatency;
+        };
+
+    public:
+        Statistics()
+            : Core::JSON::Container()
+            , Observers()
+        {
+            Add(_T("observers"), &Observers);
+        }
+        ~Statistics()
+        {
+        }
+
+    public:
+        Core::JSON::ArrayType<Observer> Observers;
+    };
+
+    // Syncs the journal and, once it is large enough, compacts it into the storage file.
+    class Flusher : public Core::Thread {
+    private:
+        Flusher() = delete;
+        Flusher(const Flusher&) = delete;
+        Flusher& operator=(const Flusher&) = delete;
+
+    public:
+        Flusher(Dictionary& parent)
+            : Core::Thread(Core::Thread::DefaultStackSize(), _T("DictionaryFlusher"))
+            , _parent(parent)
+            , _signal(false, true)
+            , _interval(Core::infinite)
+        {
+        }
+        ~Flusher()
+        {
+            ASSERT((Core::Thread::State() == Core::Thread::STOPPED) || (Core::Thread::State() == Core::Thread::INITIALIZED));
+        }
+
+    public:
+        void Start(const uint32_t interval)
+        {
+            _interval = (interval == 0 ? Core::infinite : interval);
+
+            Core::Thread::Run();
+        }
+        inline void Signal()
+        {
+            _signal.SetEvent();
+        }
+        void Terminate()
+        {
+            Core::Thread::Stop();
+
+            _signal.SetEvent();
+
+            Core::Thread::Wait(Core::Thread::STOPPED, Core::infinite);
+        }
+
+    private:
+        virtual uint32_t Worker()
+        {
+            _signal.Lock(_interval);
+            _signal.ResetEvent();
+
+            _parent.Flush();
+
+            return (0);
+        }
+
+    private:
+        Dictionary& _parent;
+        Core::Event _signal;
+        uint32_t _interval;
     };
 
 public:
@@ -316,11 +519,23 @@ public:
         : _adminLock()
         , _skipURL(0)
         , _config()
-        , _dictionary()
+        , _epoch()
+        , _version(0)
+        , _dictionary(_epoch)
+        , _journal()
+        , _flusher(*this)
+        , _storage()
+        , _dirty(false)
+        , _notifier()
     {
     }
     virtual ~Dictionary()
     {
+        DictionaryMap::Iterator index(_dictionary);
+
+        while (index.Next() == true) {
+            delete &(index.Current().Keys());
+        }
     }
 
     BEGIN_INTERFACE_MAP(Dictionary)
@@ -376,7 +591,50 @@ public:
     virtual void Register(const string& nameSpace, struct Exchange::IDictionary::INotification* sink);
     virtual void Unregister(const string& nameSpace, struct Exchange::IDictionary::INotification* sink);
 
+    //  Multi key methods, not (yet) part of IDictionary
+    // -------------------------------------------------------------------------------------------------------
+    // The keys found in the namespace are added to the dictionary of the result, returns how many were found.
+    uint32_t Get(const string& nameSpace, const std::list<string>& keys, NameSpace& result) const;
+
+    // Sets all keys in the given structure, relative to the namespace, under one lock and with one batch
+    // of notifications. If a name is invalid, nothing is set. Readers see all of the changes or none.
+    bool Set(const string& nameSpace, const NameSpace& changes);
+
 private:
+    // A batch of changes is published between two increments of _version, a reader that overlapped one
+    // does its read again. The epoch is entered per attempt, as the writer may wait for the readers to leave.
+    template <typename READER>
+    void Consistent(READER& reader) const
+    {
+        bool done = false;
+
+        while (done == false) {
+            uint32_t version = _version.load(std::memory_order_acquire);
+
+            if ((version & 1) == 0) {
+                reader();
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                done = (_version.load(std::memory_order_relaxed) == version);
+            }
+            if (done == false) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // The type is only changed if one is given, new keys are VOLATILE by default.
+    bool Set(const string& nameSpace, const string& key, const string& value, const enumType* type);
+
+    // Only call these while holding the _adminLock, returns true if the value changed.
+    bool Update(const string& nameSpace, const string& key, const string& value, const enumType* type);
+    void Update(const string& nameSpace, const NameSpace& changes, std::vector<Notifier::Modification>& modifications);
+
+    // Only call this while holding the _adminLock.
+    KeyMap& Keys(const string& nameSpace);
+    void Flush();
+    void Compact();
+    bool Save(const string& content) const;
     bool CreateInternalDictionary(const string& currentSpace, const NameSpace& data);
     void CreateExternalDictionary(const string& currentSpace, NameSpace& data) const;
 
@@ -384,8 +642,14 @@ private:
     mutable Core::CriticalSection _adminLock;
     uint8_t _skipURL;
     Config _config;
+    Epoch _epoch;
+    std::atomic<uint32_t> _version;
     DictionaryMap _dictionary;
-    ObserverMap _observers;
+    Journal _journal;
+    Flusher _flusher;
+    string _storage;
+    bool _dirty;
+    Notifier _notifier;
 };
 }
 }
@@ -0,0 +1,361 @@
+#ifndef __DICTIONARY_HASHTABLE_H
+#define __DICTIONARY_HASHTABLE_H
+
+#include "Module.h"
+
+#include <atomic>
+#include <thread>
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Epoch based reclamation. Readers announce themselves in the counter of the current epoch, which is
+// striped over cache lines so concurrent readers do not share one. A writer that unlinked something
+// retires it, it is only deleted after the epoch moved on and all readers of the old epoch left.
+// Writers must be serialized by the user.
+class Epoch {
+private:
+    Epoch(const Epoch&) = delete;
+    Epoch& operator=(const Epoch&) = delete;
+
+    static constexpr uint8_t Stripes = 16;
+    static constexpr uint16_t RetireThreshold = 64;
+
+    struct alignas(64) Counter {
+        std::atomic<uint32_t> Readers;
+    };
+
+    typedef std::pair<void*, void (*)(void*)> Retired;
+
+public:
+    class Guard {
+    private:
+        Guard() = delete;
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    public:
+        Guard(const Epoch& epoch)
+            : _epoch(epoch)
+            , _counter(epoch.Enter())
+        {
+        }
+        ~Guard()
+        {
+            _epoch.Leave(_counter);
+        }
+
+    private:
+        const Epoch& _epoch;
+        std::atomic<uint32_t>& _counter;
+    };
+
+public:
+    Epoch()
+        : _current(0)
+        , _retired()
+    {
+        for (uint8_t index = 0; index < Stripes; index++) {
+            _counters[0][index].Readers = 0;
+            _counters[1][index].Readers = 0;
+        }
+    }
+    ~Epoch()
+    {
+        // Nobody is reading anymore.
+        Reclaim();
+    }
+
+public:
+    template <typename OBJECT>
+    void Retire(OBJECT* object)
+    {
+        _retired.push_back(Retired(object, &Destroy<OBJECT>));
+
+        if (_retired.size() >= RetireThreshold) {
+            Synchronize();
+        }
+    }
+    // Wait till the readers that might still see the retired objects are gone, and delete them.
+    void Synchronize()
+    {
+        uint32_t previous = _current.fetch_add(1);
+        Counter* counters = _counters[previous & 1];
+
+        for (uint8_t index = 0; index < Stripes; index++) {
+            while (counters[index].Readers.load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+
+        Reclaim();
+    }
+
+private:
+    template <typename OBJECT>
+    static void Destroy(void* object)
+    {
+        delete reinterpret_cast<OBJECT*>(object);
+    }
+    void Reclaim()
+    {
+        std::vector<Retired>::iterator index(_retired.begin());
+
+        while (index != _retired.end()) {
+            index->second(index->first);
+            index++;
+        }
+        _retired.clear();
+    }
+    std::atomic<uint32_t>& Enter() const
+    {
+        static std::atomic<uint8_t> threads(0);
+        static thread_local uint8_t stripe = (threads++ % Stripes);
+
+        std::atomic<uint32_t>* counter;
+        uint32_t epoch;
+
+        // If the epoch moved on in the mean time, the writer might not wait for us, try again.
+        do {
+            epoch = _current.load();
+            counter = &(_counters[epoch & 1][stripe].Readers);
+            counter->fetch_add(1);
+
+            if (_current.load() != epoch) {
+                counter->fetch_sub(1);
+                counter = nullptr;
+            }
+        } while (counter == nullptr);
+
+        return (*counter);
+    }
+    void Leave(std::atomic<uint32_t>& counter) const
+    {
+        counter.fetch_sub(1);
+    }
+
+private:
+    std::atomic<uint32_t> _current;
+    mutable Counter _counters[2][Stripes];
+    std::vector<Retired> _retired;
+};
+
+// Open addressing (linear probing) hash table that can be read without a lock. A published node is never
+// changed, a new value replaces the node and the old one is retired, growing replaces the slot array.
+// Nothing is ever removed, so a reader can stop probing at the first empty slot.
+// Readers must hold an Epoch::Guard, writers must be serialized by the user. The PAYLOAD must have a
+// Key() method, returning the string it is looked up by.
+template <typename PAYLOAD>
+class HashTableType {
+private:
+    HashTableType() = delete;
+    HashTableType(const HashTableType<PAYLOAD>&) = delete;
+    HashTableType<PAYLOAD>& operator=(const HashTableType<PAYLOAD>&) = delete;
+
+    static constexpr uint32_t MinimumCapacity = 16;
+
+public:
+    class Node {
+    private:
+        Node() = delete;
+        Node(const Node&) = delete;
+        Node& operator=(const Node&) = delete;
+
+    public:
+        Node(const size_t hash, const PAYLOAD& payload)
+            : Hash(hash)
+            , Payload(payload)
+        {
+        }
+        ~Node()
+        {
+        }
+
+    public:
+        const size_t Hash;
+        const PAYLOAD Payload;
+    };
+
+private:
+    class Table {
+    private:
+        Table() = delete;
+        Table(const Table&) = delete;
+        Table& operator=(const Table&) = delete;
+
+    public:
+        Table(const uint32_t capacity)
+            : Capacity(capacity)
+            , Slots(new std::atomic<Node*>[capacity])
+        {
+            for (uint32_t index = 0; index < Capacity; index++) {
+                Slots[index].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+        ~Table()
+        {
+            delete[] Slots;
+        }
+
+    public:
+        const uint32_t Capacity; //!< Always a power of 2.
+        std::atomic<Node*>* Slots;
+    };
+
+public:
+    // Walks the slot array that was current at construction.
+    class Iterator {
+    public:
+        Iterator(const HashTableType<PAYLOAD>& table)
+            : _table(table._table.load(std::memory_order_acquire))
+            , _index(~0)
+            , _current(nullptr)
+        {
+        }
+        ~Iterator()
+        {
+        }
+
+    public:
+        bool Next()
+        {
+            _current = nullptr;
+
+            while ((_current == nullptr) && (++_index < _table->Capacity)) {
+                _current = _table->Slots[_index].load(std::memory_order_acquire);
+            }
+
+            return (_current != nullptr);
+        }
+        inline const PAYLOAD& Current() const
+        {
+            ASSERT(_current != nullptr);
+
+            return (_current->Payload);
+        }
+
+    private:
+        const Table* _table;
+        uint32_t _index;
+        const Node* _current;
+    };
+
+public:
+    HashTableType(Epoch& epoch)
+        : _epoch(epoch)
+        , _table(new Table(MinimumCapacity))
+        , _count(0)
+    {
+    }
+    ~HashTableType()
+    {
+        Table* table = _table.load();
+
+        for (uint32_t index = 0; index < table->Capacity; index++) {
+            delete table->Slots[index].load();
+        }
+
+        delete table;
+    }
+
+public:
+    inline uint32_t Count() const
+    {
+        return (_count);
+    }
+
+    // Reader side, hold an Epoch::Guard for as long as the result is used.
+    const PAYLOAD* Find(const string& key) const
+    {
+        const Table* table = _table.load(std::memory_order_acquire);
+        const size_t hash = std::hash<string>()(key);
+        const uint32_t mask = table->Capacity - 1;
+        uint32_t index = static_cast<uint32_t>(hash) & mask;
+        const PAYLOAD* result = nullptr;
+        const Node* node;
+
+        while ((result == nullptr) && ((node = table->Slots[index].load(std::memory_order_acquire)) != nullptr)) {
+            if ((node->Hash == hash) && (node->Payload.Key() == key)) {
+                result = &(node->Payload);
+            }
+            index = (index + 1) & mask;
+        }
+
+        return (result);
+    }
+
+    // Writer side, returns true if the key was not in the table yet.
+    bool Set(const PAYLOAD& payload)
+    {
+        const size_t hash = std::hash<string>()(payload.Key());
+        Table* table = _table.load(std::memory_order_relaxed);
+        std::atomic<Node*>& slot(Slot(table, hash, payload.Key()));
+        Node* existing = slot.load(std::memory_order_relaxed);
+        bool added = (existing == nullptr);
+
+        if (added == false) {
+            slot.store(new Node(hash, payload), std::memory_order_release);
+            _epoch.Retire(existing);
+        }
+        else if (((_count + 1) * 10) > (table->Capacity * 7)) {
+            // Keep the load below 70%, so probe sequences stay short.
+            Table* grown = Grow(table);
+
+            Slot(grown, hash, payload.Key()).store(new Node(hash, payload), std::memory_order_relaxed);
+            _table.store(grown, std::memory_order_release);
+            _epoch.Retire(table);
+            _count++;
+        }
+        else {
+            slot.store(new Node(hash, payload), std::memory_order_release);
+            _count++;
+        }
+
+        return (added);
+    }
+
+private:
+    // The slot holding the key, or the empty slot where it should go.
+    static std::atomic<Node*>& Slot(Table* table, const size_t hash, const string& key)
+    {
+        const uint32_t mask = table->Capacity - 1;
+        uint32_t index = static_cast<uint32_t>(hash) & mask;
+        Node* node;
+
+        while (((node = table->Slots[index].load(std::memory_order_relaxed)) != nullptr) && ((node->Hash != hash) || (node->Payload.Key() != key))) {
+            index = (index + 1) & mask;
+        }
+
+        return (table->Slots[index]);
+    }
+    // The nodes move to the new slot array, only the old array is retired.
+    static Table* Grow(const Table* table)
+    {
+        Table* result = new Table(table->Capacity * 2);
+        const uint32_t mask = result->Capacity - 1;
+
+        for (uint32_t index = 0; index < table->Capacity; index++) {
+            Node* node = table->Slots[index].load(std::memory_order_relaxed);
+
+            if (node != nullptr) {
+                uint32_t position = static_cast<uint32_t>(node->Hash) & mask;
+
+                while (result->Slots[position].load(std::memory_order_relaxed) != nullptr) {
+                    position = (position + 1) & mask;
+                }
+                result->Slots[position].store(node, std::memory_order_relaxed);
+            }
+        }
+
+        return (result);
+    }
+
+private:
+    Epoch& _epoch;
+    std::atomic<Table*> _table;
+    uint32_t _count;
+};
+}
+}
+
+#endif // __DICTIONARY_HASHTABLE_H
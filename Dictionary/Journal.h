@@ -0,0 +1,320 @@
+#ifndef __DICTIONARY_JOURNAL_H
+#define __DICTIONARY_JOURNAL_H
+
+#include "Module.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Append only log of the changes to persistent keys, so they survive a crash. Every record is
+// written when it is added, it is synced (fdatasync) in batches by the owner, calling Sync().
+// A record is: length (uint32_t), checksum (uint32_t) and a payload of type (uint8_t), namespace and
+// key (uint16_t length + text) and value (uint32_t length + text), in host byte order.
+// While a snapshot is written, the log that it covers is kept as <name>.old.
+class Journal {
+private:
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    static constexpr uint32_t HeaderSize = 2 * sizeof(uint32_t);
+    static constexpr uint32_t MaxRecordSize = 16 * 1024 * 1024;
+
+public:
+    Journal()
+        : _lock()
+        , _fileName()
+        , _handle(-1)
+        , _size(0)
+        , _pending(false)
+        , _record()
+    {
+    }
+    ~Journal()
+    {
+        Close();
+    }
+
+public:
+    inline const string& FileName() const
+    {
+        return (_fileName);
+    }
+    inline uint32_t Size() const
+    {
+        return (_size);
+    }
+
+    // Calls action(nameSpace, key, value, type) for every intact record, in order. Returns the number of
+    // records, the length of the intact part of the file is returned in size.
+    template <typename ACTION>
+    static uint32_t Replay(const string& fileName, ACTION& action, uint32_t& size)
+    {
+        uint32_t result = 0;
+        int handle = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+
+        size = 0;
+
+        if (handle != -1) {
+            std::vector<uint8_t> payload;
+            uint32_t header[2];
+            bool intact = true;
+
+            while ((intact == true) && (::read(handle, header, sizeof(header)) == sizeof(header))) {
+                intact = ((header[0] <= MaxRecordSize) && (header[0] > (sizeof(uint8_t) + (2 * sizeof(uint16_t)) + sizeof(uint32_t))));
+
+                if (intact == true) {
+                    payload.resize(header[0]);
+                    intact = ((::read(handle, payload.data(), header[0]) == static_cast<ssize_t>(header[0])) && (Checksum(payload.data(), header[0]) == header[1]));
+                }
+
+                if (intact == true) {
+                    string nameSpace, key, value;
+                    uint32_t offset = sizeof(uint8_t);
+
+                    intact = ((Text<uint16_t>(payload, offset, nameSpace) == true) && (Text<uint16_t>(payload, offset, key) == true) && (Text<uint32_t>(payload, offset, value) == true));
+
+                    if (intact == true) {
+                        action(nameSpace, key, value, payload[0]);
+                        size += HeaderSize + header[0];
+                        result++;
+                    }
+                }
+            }
+
+            ::close(handle);
+        }
+
+        return (result);
+    }
+
+    // Opens the log to append to, anything after the intact part (size) was not completely written.
+    bool Open(const string& fileName, const uint32_t size)
+    {
+        _lock.Lock();
+
+        _fileName = fileName;
+        _handle = ::open(_fileName.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        _pending = false;
+        _size = 0;
+
+        if (_handle != -1) {
+            off_t end = ::lseek(_handle, 0, SEEK_END);
+
+            if (end <= static_cast<off_t>(size)) {
+                _size = static_cast<uint32_t>(end);
+            }
+            else if (::ftruncate(_handle, size) == 0) {
+                _size = size;
+            }
+        }
+        else {
+            TRACE_L1("Could not open journal %s, error %d", _fileName.c_str(), errno);
+        }
+
+        _lock.Unlock();
+
+        return (_handle != -1);
+    }
+    void Close()
+    {
+        _lock.Lock();
+
+        if (_handle != -1) {
+            if (_pending == true) {
+                ::fdatasync(_handle);
+            }
+            ::close(_handle);
+            _handle = -1;
+        }
+
+        _lock.Unlock();
+    }
+    // Written right away, so it is not lost if the process crashes, it is on disk after the next Sync().
+    void Append(const string& nameSpace, const string& key, const string& value, const uint8_t type)
+    {
+        uint32_t length = sizeof(uint8_t) + sizeof(uint16_t) + nameSpace.length() + sizeof(uint16_t) + key.length() + sizeof(uint32_t) + value.length();
+
+        _record.resize(HeaderSize + length);
+
+        uint32_t offset = HeaderSize;
+
+        _record[offset++] = type;
+        Store<uint16_t>(offset, nameSpace);
+        Store<uint16_t>(offset, key);
+        Store<uint32_t>(offset, value);
+
+        uint32_t header[2] = { length, Checksum(&(_record[HeaderSize]), length) };
+        ::memcpy(_record.data(), header, sizeof(header));
+
+        _lock.Lock();
+
+        if (_handle != -1) {
+            if (::write(_handle, _record.data(), _record.size()) == static_cast<ssize_t>(_record.size())) {
+                _size += _record.size();
+                _pending = true;
+            }
+            else {
+                TRACE_L1("Could not write to journal %s, error %d", _fileName.c_str(), errno);
+            }
+        }
+
+        _lock.Unlock();
+    }
+    // The sync is done on a duplicate of the handle, so appending does not wait for it.
+    void Sync()
+    {
+        int handle = -1;
+
+        _lock.Lock();
+
+        if ((_handle != -1) && (_pending == true)) {
+            handle = ::dup(_handle);
+            _pending = false;
+        }
+
+        _lock.Unlock();
+
+        if (handle != -1) {
+            ::fdatasync(handle);
+            ::close(handle);
+        }
+    }
+    // Continue in a new, empty, log. The records so far are kept in <name>.old till Retire() is called.
+    void Rotate()
+    {
+        _lock.Lock();
+
+        if (_handle != -1) {
+            const string old(_fileName + _T(".old"));
+
+            ::fdatasync(_handle);
+            ::close(_handle);
+
+            // A previous snapshot did not make it, keep its records as well.
+            if (::access(old.c_str(), F_OK) == 0) {
+                Concatenate(_fileName, _size, old);
+                ::unlink(_fileName.c_str());
+            }
+            else {
+                ::rename(_fileName.c_str(), old.c_str());
+            }
+
+            _handle = ::open(_fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+            _pending = false;
+            _size = 0;
+
+            // The rename and the new log are only durable once the directory is.
+            SyncDirectory(_fileName);
+        }
+
+        _lock.Unlock();
+    }
+    // The snapshot holds everything in <name>.old.
+    void Retire()
+    {
+        ::unlink((_fileName + _T(".old")).c_str());
+    }
+    // Makes the renames, creations and removals of files in the directory of the given file durable.
+    static void SyncDirectory(const string& fileName)
+    {
+        size_t slash = fileName.find_last_of('/');
+        const string directory(slash == string::npos ? string(_T(".")) : (slash == 0 ? string(_T("/")) : fileName.substr(0, slash)));
+        int handle = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+        if (handle != -1) {
+            ::fsync(handle);
+            ::close(handle);
+        }
+    }
+
+private:
+    static uint32_t Checksum(const uint8_t data[], const uint32_t length)
+    {
+        // FNV-1a
+        uint32_t result = 2166136261u;
+
+        for (uint32_t index = 0; index < length; index++) {
+            result = (result ^ data[index]) * 16777619u;
+        }
+
+        return (result);
+    }
+    template <typename LENGTH>
+    static bool Text(const std::vector<uint8_t>& payload, uint32_t& offset, string& text)
+    {
+        bool result = false;
+        LENGTH length;
+
+        if ((offset + sizeof(LENGTH)) <= payload.size()) {
+            ::memcpy(&length, &(payload[offset]), sizeof(LENGTH));
+            offset += sizeof(LENGTH);
+
+            if ((offset + length) <= payload.size()) {
+                text.assign(reinterpret_cast<const char*>(&(payload[offset])), length);
+                offset += length;
+                result = true;
+            }
+        }
+
+        return (result);
+    }
+    template <typename LENGTH>
+    void Store(uint32_t& offset, const string& text)
+    {
+        LENGTH length = static_cast<LENGTH>(text.length());
+
+        ::memcpy(&(_record[offset]), &length, sizeof(LENGTH));
+        offset += sizeof(LENGTH);
+        ::memcpy(&(_record[offset]), text.c_str(), length);
+        offset += length;
+    }
+    // Appends the first size bytes of from to to. A torn record at the end of to is cut off first,
+    // otherwise Replay() would stop there and never get to the appended records.
+    static void Concatenate(const string& from, const uint32_t size, const string& to)
+    {
+        auto skip = [](const string&, const string&, const string&, const uint8_t) {};
+        uint32_t intact = 0;
+
+        Replay(to, skip, intact);
+
+        int source = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+        int destination = ::open(to.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+
+        if ((source != -1) && (destination != -1) && (::ftruncate(destination, intact) == 0)) {
+            uint8_t buffer[4096];
+            uint32_t left = size;
+            ssize_t length;
+
+            while ((left > 0) && ((length = ::read(source, buffer, std::min(left, static_cast<uint32_t>(sizeof(buffer))))) > 0)) {
+                if (::write(destination, buffer, length) != length) {
+                    TRACE_L1("Could not write to journal %s, error %d", to.c_str(), errno);
+                }
+                left -= static_cast<uint32_t>(length);
+            }
+
+            ::fdatasync(destination);
+        }
+
+        if (source != -1) {
+            ::close(source);
+        }
+        if (destination != -1) {
+            ::close(destination);
+        }
+    }
+
+private:
+    Core::CriticalSection _lock;
+    string _fileName;
+    int _handle;
+    uint32_t _size;
+    bool _pending;
+    std::vector<uint8_t> _record;
+};
+}
+}
+
+#endif // __DICTIONARY_JOURNAL_H
@@ -0,0 +1,393 @@
+#ifndef __DICTIONARY_NOTIFIER_H
+#define __DICTIONARY_NOTIFIER_H
+
+#include "Module.h"
+#include <interfaces/IDictionary.h>
+
+#include <thread>
+#include <unordered_map>
+
+namespace WPEFramework {
+namespace Plugin {
+
+// Delivers the changes to the observers on a thread of its own, so a slow observer does not hold up the
+// writers. Every observer has its own queue, with one entry per key: if a key changes again before the
+// previous change was delivered, only the latest value is delivered. Observers are served round robin,
+// with at most "batch" changes at a time (0 is all that are pending). With a delay, the worker waits that
+// long after the first change, so a burst is coalesced and delivered to the namespace observers at once.
+class Notifier : public Core::Thread {
+private:
+    Notifier(const Notifier&) = delete;
+    Notifier& operator=(const Notifier&) = delete;
+
+    class Observer {
+    private:
+        Observer() = delete;
+        Observer(const Observer&) = delete;
+        Observer& operator=(const Observer&) = delete;
+
+    public:
+        struct Change {
+            string Value;
+            uint64_t Queued;
+        };
+        typedef std::unordered_map<string, Change> ChangeMap;
+
+    public:
+        Observer(const string& nameSpace, Exchange::IDictionary::INotification* sink)
+            : NameSpace(nameSpace)
+            , Sink(sink)
+            , Order()
+            , Pending()
+            , Delivered(0)
+            , Coalesced(0)
+            , Latency(0)
+            , MaxLatency(0)
+            , Removed(false)
+        {
+            Sink->AddRef();
+        }
+        ~Observer()
+        {
+            Sink->Release();
+        }
+
+    public:
+        const string NameSpace;
+        Exchange::IDictionary::INotification* const Sink;
+        std::list<string> Order; //!< Keys, in the order of their first pending change.
+        ChangeMap Pending;
+        uint32_t Delivered;
+        uint32_t Coalesced;
+        uint64_t Latency; //!< Total time the delivered changes were queued, in microseconds.
+        uint64_t MaxLatency;
+        bool Removed;
+    };
+
+    typedef std::pair<string, Observer::Change> Delivery;
+
+public:
+    struct Modification {
+        string NameSpace;
+        string Key;
+        string Value;
+    };
+
+    class Statistics {
+    public:
+        Statistics()
+            : NameSpace()
+            , Depth(0)
+            , Delivered(0)
+            , Coalesced(0)
+            , Latency(0)
+            , MaxLatency(0)
+        {
+        }
+        ~Statistics()
+        {
+        }
+
+    public:
+        string NameSpace;
+        uint32_t Depth;
+        uint32_t Delivered;
+        uint32_t Coalesced;
+        uint64_t Latency; //!< Average, in microseconds.
+        uint64_t MaxLatency;
+    };
+
+public:
+    Notifier()
+        : Core::Thread(Core::Thread::DefaultStackSize(), _T("DictionaryNotifier"))
+        , _lock()
+        , _observers()
+        , _next(0)
+        , _batch(0)
+        , _delay(0)
+        , _delivering(nullptr)
+        , _worker()
+        , _signal(false, true)
+        , _idle(false, true)
+        , _deliveries()
+    {
+    }
+    ~Notifier()
+    {
+        ASSERT((Core::Thread::State() == Core::Thread::STOPPED) || (Core::Thread::State() == Core::Thread::INITIALIZED));
+
+        std::vector<Observer*>::iterator index(_observers.begin());
+
+        while (index != _observers.end()) {
+            delete *index;
+            index++;
+        }
+    }
+
+public:
+    void Start(const uint16_t batch, const uint16_t delay)
+    {
+        _batch = batch;
+        _delay = delay;
+
+        Core::Thread::Run();
+    }
+    // Whatever is not delivered yet, is dropped.
+    void Terminate()
+    {
+        Core::Thread::Stop();
+
+        _signal.SetEvent();
+
+        Core::Thread::Wait(Core::Thread::STOPPED, Core::infinite);
+    }
+    void Register(const string& nameSpace, Exchange::IDictionary::INotification* sink)
+    {
+        _lock.Lock();
+
+#ifdef __DEBUG__
+        std::vector<Observer*>::const_iterator index(_observers.begin());
+
+        // DO NOT REGISTER THE SAME NOTIFICATION SINK ON THE SAME NAMESPACE MORE THAN ONCE. !!!!!!
+        while (index != _observers.end()) {
+            ASSERT(((*index)->Sink != sink) || (nameSpace != (*index)->NameSpace));
+
+            index++;
+        }
+#endif
+
+        _observers.push_back(new Observer(nameSpace, sink));
+
+        _lock.Unlock();
+    }
+    // Once this returns, the sink is not called anymore, unless it is called from within the sink.
+    void Unregister(const string& nameSpace, Exchange::IDictionary::INotification* sink)
+    {
+        _lock.Lock();
+
+        std::vector<Observer*>::iterator index(_observers.begin());
+
+        while ((index != _observers.end()) && (((*index)->Sink != sink) || ((*index)->NameSpace != nameSpace))) {
+            index++;
+        }
+
+        if (index != _observers.end()) {
+            Observer* observer = *index;
+
+            _observers.erase(index);
+
+            if ((observer == _delivering) && (std::this_thread::get_id() == _worker)) {
+                // Called from the sink, the worker cleans it up once the sink returns.
+                observer->Removed = true;
+            }
+            else {
+                while (observer == _delivering) {
+                    _idle.ResetEvent();
+                    _lock.Unlock();
+                    _idle.Lock(Core::infinite);
+                    _lock.Lock();
+                }
+
+                delete observer;
+            }
+        }
+
+        _lock.Unlock();
+    }
+    // Called by the writer, only queues the change.
+    void Modified(const string& nameSpace, const string& key, const string& value)
+    {
+        const uint64_t now = Core::Time::Now().Ticks();
+
+        _lock.Lock();
+
+        bool queued = Queue(now, nameSpace, key, value);
+
+        _lock.Unlock();
+
+        if (queued == true) {
+            _signal.SetEvent();
+        }
+    }
+    // All changes are queued at once, so the worker does not pick up part of them.
+    void Modified(const std::vector<Modification>& modifications)
+    {
+        const uint64_t now = Core::Time::Now().Ticks();
+        bool queued = false;
+
+        _lock.Lock();
+
+        std::vector<Modification>::const_iterator index(modifications.begin());
+
+        while (index != modifications.end()) {
+            queued = Queue(now, index->NameSpace, index->Key, index->Value) || queued;
+            index++;
+        }
+
+        _lock.Unlock();
+
+        if (queued == true) {
+            _signal.SetEvent();
+        }
+    }
+    void Snapshot(std::list<Statistics>& statistics) const
+    {
+        _lock.Lock();
+
+        std::vector<Observer*>::const_iterator index(_observers.begin());
+
+        while (index != _observers.end()) {
+            const Observer& observer(**index);
+            Statistics info;
+
+            info.NameSpace = observer.NameSpace;
+            info.Depth = static_cast<uint32_t>(observer.Pending.size());
+            info.Delivered = observer.Delivered;
+            info.Coalesced = observer.Coalesced;
+            info.Latency = (observer.Delivered == 0 ? 0 : observer.Latency / observer.Delivered);
+            info.MaxLatency = observer.MaxLatency;
+
+            statistics.push_back(info);
+            index++;
+        }
+
+        _lock.Unlock();
+    }
+
+private:
+    // Only call this while holding the _lock.
+    bool Queue(const uint64_t now, const string& nameSpace, const string& key, const string& value)
+    {
+        bool result = false;
+        std::vector<Observer*>::iterator index(_observers.begin());
+
+        while (index != _observers.end()) {
+            Observer& observer(**index);
+
+            if (observer.NameSpace == nameSpace) {
+                Observer::ChangeMap::iterator pending(observer.Pending.find(key));
+
+                if (pending != observer.Pending.end()) {
+                    // Keep its place in the queue and the time it was queued, only the value changes.
+                    pending->second.Value = value;
+                    observer.Coalesced++;
+                }
+                else {
+                    Observer::Change change;
+                    change.Value = value;
+                    change.Queued = now;
+                    observer.Pending.insert(std::pair<string, Observer::Change>(key, change));
+                    observer.Order.push_back(key);
+                }
+                result = true;
+            }
+            index++;
+        }
+
+        return (result);
+    }
+    virtual uint32_t Worker()
+    {
+        _worker = std::this_thread::get_id();
+
+        if (_signal.Lock(Core::infinite) == Core::ERROR_NONE) {
+            // Reset before draining, anything queued from now on signals again.
+            _signal.ResetEvent();
+
+            if ((_delay != 0) && (Core::Thread::IsRunning() == true)) {
+                SleepMs(_delay);
+            }
+
+            while ((Core::Thread::IsRunning() == true) && (Deliver() == true)) {
+                // Keep on going till all queues are empty.
+            }
+        }
+
+        return (0);
+    }
+    // Takes a batch from the next observer with pending changes, and delivers it without holding the lock.
+    bool Deliver()
+    {
+        Observer* observer = nullptr;
+
+        _lock.Lock();
+
+        for (uint32_t count = 0; (observer == nullptr) && (count < _observers.size()); count++) {
+            _next = (_next + 1) % _observers.size();
+
+            if (_observers[_next]->Order.empty() == false) {
+                observer = _observers[_next];
+            }
+        }
+
+        if (observer != nullptr) {
+            while ((observer->Order.empty() == false) && ((_batch == 0) || (_deliveries.size() < _batch))) {
+                Observer::ChangeMap::iterator pending(observer->Pending.find(observer->Order.front()));
+
+                ASSERT(pending != observer->Pending.end());
+
+                _deliveries.push_back(Delivery(pending->first, pending->second));
+                observer->Pending.erase(pending);
+                observer->Order.pop_front();
+            }
+
+            _delivering = observer;
+        }
+
+        _lock.Unlock();
+
+        if (observer != nullptr) {
+            uint64_t total = 0;
+            uint64_t max = 0;
+            uint32_t delivered = 0;
+            std::vector<Delivery>::const_iterator index(_deliveries.begin());
+
+            // The sink may unregister itself, it gets nothing after that. Removed is only set on this
+            // thread, so it can be checked without the lock.
+            while ((index != _deliveries.end()) && (observer->Removed == false)) {
+                observer->Sink->Modified(observer->NameSpace, index->first, index->second.Value);
+
+                uint64_t latency = Core::Time::Now().Ticks() - index->second.Queued;
+                total += latency;
+                max = std::max(max, latency);
+                delivered++;
+
+                index++;
+            }
+
+            _lock.Lock();
+
+            observer->Delivered += delivered;
+            observer->Latency += total;
+            observer->MaxLatency = std::max(observer->MaxLatency, max);
+            _delivering = nullptr;
+            _idle.SetEvent();
+
+            _lock.Unlock();
+
+            if (observer->Removed == true) {
+                delete observer;
+            }
+
+            _deliveries.clear();
+        }
+
+        return (observer != nullptr);
+    }
+
+private:
+    mutable Core::CriticalSection _lock;
+    std::vector<Observer*> _observers;
+    uint32_t _next;
+    uint16_t _batch;
+    uint16_t _delay;
+    Observer* _delivering;
+    std::thread::id _worker;
+    Core::Event _signal;
+    Core::Event _idle;
+    std::vector<Delivery> _deliveries;
+};
+}
+}
+
+#endif // __DICTIONARY_NOTIFIER_H
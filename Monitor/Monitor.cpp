@@ -8,6 +8,7 @@ namespace Plugin {
     static Core::ProxyPoolType<Web::JSONBodyType<Core::JSON::ArrayType<Monitor::Data> > > jsonBodyDataFactory(2);
     static Core::ProxyPoolType<Web::JSONBodyType<Monitor::Data> > jsonBodyParamFactory(2);
     static Core::ProxyPoolType<Web::JSONBodyType<Monitor::Data::MetaData> > jsonMemoryBodyDataFactory(2);
+    static Core::ProxyPoolType<Web::JSONBodyType<Monitor::Data::History> > jsonHistoryBodyDataFactory(2);
 
     /* virtual */ const string Monitor::Initialize(PluginHost::IShell* service)
     {
@@ -19,7 +20,7 @@ namespace Plugin {
         Core::JSON::ArrayType<Config::Entry>::Iterator index(_config.Observables.Elements());
 
         // Create a list of plugins to monitor..
-        _monitor->Open(service, index);
+        _monitor->Open(service, _config.ProbeTimeout.Value(), _config.SystemSampling.Value(), index);
 
         // During the registartion, all Plugins, currently active are reported to the sink.
         service->Register(_monitor);
@@ -50,6 +51,7 @@ namespace Plugin {
 
     // <GET> ../				Get all Memory Measurments
     // <GET> ../<Callsign>		Get the Memory Measurements for Callsign
+    // <GET> ../<Callsign>/history	Get the last Memory Measurements, percentiles and growth for Callsign
     // <PUT> ../<Callsign>		Reset the Memory measurements for Callsign
     /* virtual */ Core::ProxyType<Web::Response> Monitor::Process(const Web::Request& request)
     {
@@ -77,15 +79,26 @@ namespace Plugin {
                 }
             }
             else {
-                MetaData memoryInfo;
+                string callSign (index.Current().Text());
 
-                // Seems we only want 1 name
-                if (_monitor->Snapshot(index.Current().Text(), memoryInfo) == true) {
-                    Core::ProxyType<Web::JSONBodyType<Monitor::Data::MetaData> > response(jsonMemoryBodyDataFactory.Element());
+                if ((index.Next() == true) && (index.Current() == _T("history"))) {
+                    Core::ProxyType<Web::JSONBodyType<Monitor::Data::History> > response(jsonHistoryBodyDataFactory.Element());
 
-                    *response = memoryInfo;
+                    if (_monitor->History(callSign, *response) == true) {
+                        result->Body(Core::proxy_cast<Web::IBody>(response));
+                    }
+                }
+                else {
+                    MetaData memoryInfo;
 
-                    result->Body(Core::proxy_cast<Web::IBody>(response));
+                    // Seems we only want 1 name
+                    if (_monitor->Snapshot(callSign, memoryInfo) == true) {
+                        Core::ProxyType<Web::JSONBodyType<Monitor::Data::MetaData> > response(jsonMemoryBodyDataFactory.Element());
+
+                        *response = memoryInfo;
+
+                        result->Body(Core::proxy_cast<Web::IBody>(response));
+                    }
                 }
             }
 
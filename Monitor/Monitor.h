@@ -2,6 +2,8 @@
 #define __MONITOR_H
 
 #include "Module.h"
+#include "ProcessSampler.h"
+#include "TimerWheel.h"
 #include <interfaces/IMemory.h>
 
 #include<string>
@@ -46,6 +48,14 @@ namespace Plugin {
                 _shared.Set(memInterface->Shared());
                 _process.Set(memInterface->Processes());
             }
+            template <typename READING>
+            void Measure(const READING& reading)
+            {
+                _resident.Set(reading.Resident);
+                _allocated.Set(reading.Allocated);
+                _shared.Set(reading.Shared);
+                _process.Set(reading.Processes);
+            }
             void Operational (const bool operational) 
             {
                 _operational = operational;
@@ -88,6 +98,189 @@ namespace Plugin {
             bool _operational;
         };
 
+        // Fixed size ring of the last memory measurements of an observable. The samples are kept
+        // in one contiguous block, allocated once, so the cost per observable is known up front.
+        class History {
+        public:
+            struct Sample {
+                uint64_t Time;
+                uint64_t Resident;
+                uint64_t Allocated;
+                uint64_t Shared;
+                uint8_t Processes;
+            };
+
+            class Statistics {
+            public:
+                Statistics()
+                    : P50(0)
+                    , P95(0)
+                    , P99(0)
+                    , Growth(0)
+                {
+                }
+                ~Statistics()
+                {
+                }
+
+            public:
+                uint64_t P50;
+                uint64_t P95;
+                uint64_t P99;
+                int64_t Growth; //!< Least squares slope, in bytes per hour.
+            };
+
+        public:
+            History() = delete;
+            History& operator=(const History&) = delete;
+
+            History(const uint16_t capacity)
+                : _samples(capacity)
+                , _head(0)
+                , _count(0)
+            {
+            }
+            History(const History& copy)
+                : _samples(copy._samples)
+                , _head(copy._head)
+                , _count(copy._count)
+            {
+            }
+            ~History()
+            {
+            }
+
+        public:
+            inline uint16_t Capacity() const
+            {
+                return (static_cast<uint16_t>(_samples.size()));
+            }
+            inline uint16_t Count() const
+            {
+                return (_count);
+            }
+            // Index 0 is the oldest sample.
+            inline const Sample& operator[](const uint16_t index) const
+            {
+                ASSERT(index < _count);
+
+                return (_samples[(_head + _samples.size() - _count + index) % _samples.size()]);
+            }
+            inline void Clear()
+            {
+                _head = 0;
+                _count = 0;
+            }
+            // Number of (most recent) samples taken at or after the given time.
+            uint16_t Count(const uint64_t since) const
+            {
+                uint16_t result = 0;
+
+                while ((result < _count) && (operator[](_count - result - 1).Time >= since)) {
+                    result++;
+                }
+
+                return (result);
+            }
+            void Add(const uint64_t time, const MetaData& measurement)
+            {
+                if (_samples.size() != 0) {
+                    Sample& entry(_samples[_head]);
+
+                    entry.Time = time;
+                    entry.Resident = measurement.Resident().Last();
+                    entry.Allocated = measurement.Allocated().Last();
+                    entry.Shared = measurement.Shared().Last();
+                    entry.Processes = measurement.Process().Last();
+
+                    _head = static_cast<uint16_t>((_head + 1) % _samples.size());
+
+                    if (_count < _samples.size()) {
+                        _count++;
+                    }
+                }
+            }
+            inline Statistics Resident() const
+            {
+                return (Analyze(&Sample::Resident));
+            }
+            inline Statistics Allocated() const
+            {
+                return (Analyze(&Sample::Allocated));
+            }
+            inline Statistics Shared() const
+            {
+                return (Analyze(&Sample::Shared));
+            }
+            // Least squares slope of the given value over the last samples, in bytes per hour.
+            int64_t Growth(uint64_t Sample::*member, const uint16_t window) const
+            {
+                int64_t result = 0;
+                uint16_t count = std::min(window, _count);
+
+                if (count >= 2) {
+                    const uint16_t first = _count - count;
+                    const uint64_t base = operator[](first).Time;
+                    double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+
+                    for (uint16_t index = first; index < _count; index++) {
+                        const Sample& entry(operator[](index));
+                        double x = static_cast<double>(entry.Time - base) / (1000.0 * 1000.0 * 60.0 * 60.0);
+                        double y = static_cast<double>(entry.*member);
+
+                        sumX += x;
+                        sumY += y;
+                        sumXX += x * x;
+                        sumXY += x * y;
+                    }
+
+                    double divider = (count * sumXX) - (sumX * sumX);
+
+                    if (divider > 0) {
+                        result = static_cast<int64_t>(((count * sumXY) - (sumX * sumY)) / divider);
+                    }
+                }
+
+                return (result);
+            }
+
+        private:
+            Statistics Analyze(uint64_t Sample::*member) const
+            {
+                Statistics result;
+
+                if (_count != 0) {
+                    std::vector<uint64_t> values(_count);
+
+                    for (uint16_t index = 0; index < _count; index++) {
+                        values[index] = operator[](index).*member;
+                    }
+
+                    result.P50 = Percentile(values, 50);
+                    result.P95 = Percentile(values, 95);
+                    result.P99 = Percentile(values, 99);
+                    result.Growth = Growth(member, _count);
+                }
+
+                return (result);
+            }
+            // Nearest rank percentile, reorders the values.
+            static uint64_t Percentile(std::vector<uint64_t>& values, const uint8_t percentile)
+            {
+                uint32_t rank = ((values.size() * percentile) + 99) / 100;
+                std::vector<uint64_t>::iterator selected(values.begin() + (rank == 0 ? 0 : rank - 1));
+
+                std::nth_element(values.begin(), selected, values.end());
+
+                return (*selected);
+            }
+
+        private:
+            std::vector<Sample> _samples;
+            uint16_t _head;
+            uint16_t _count;
+        };
+
         class Data : public Core::JSON::Container {
         public:
             class MetaData : public Core::JSON::Container {
@@ -270,6 +463,155 @@ namespace Plugin {
                 Core::JSON::DecUInt32 Count;
             };
 
+            class History : public Core::JSON::Container {
+            public:
+                class Sample : public Core::JSON::Container {
+                private:
+                    Sample& operator=(const Sample&);
+
+                public:
+                    Sample()
+                        : Core::JSON::Container()
+                    {
+                        Add(_T("time"), &Time);
+                        Add(_T("resident"), &Resident);
+                        Add(_T("allocated"), &Allocated);
+                        Add(_T("shared"), &Shared);
+                        Add(_T("process"), &Process);
+                    }
+                    Sample(const Monitor::History::Sample& input)
+                        : Core::JSON::Container()
+                    {
+                        Add(_T("time"), &Time);
+                        Add(_T("resident"), &Resident);
+                        Add(_T("allocated"), &Allocated);
+                        Add(_T("shared"), &Shared);
+                        Add(_T("process"), &Process);
+
+                        Time = input.Time;
+                        Resident = input.Resident;
+                        Allocated = input.Allocated;
+                        Shared = input.Shared;
+                        Process = input.Processes;
+                    }
+                    Sample(const Sample& copy)
+                        : Core::JSON::Container()
+                        , Time(copy.Time)
+                        , Resident(copy.Resident)
+                        , Allocated(copy.Allocated)
+                        , Shared(copy.Shared)
+                        , Process(copy.Process)
+                    {
+                        Add(_T("time"), &Time);
+                        Add(_T("resident"), &Resident);
+                        Add(_T("allocated"), &Allocated);
+                        Add(_T("shared"), &Shared);
+                        Add(_T("process"), &Process);
+                    }
+                    ~Sample()
+                    {
+                    }
+
+                public:
+                    Core::JSON::DecUInt64 Time;
+                    Core::JSON::DecUInt64 Resident;
+                    Core::JSON::DecUInt64 Allocated;
+                    Core::JSON::DecUInt64 Shared;
+                    Core::JSON::DecUInt8 Process;
+                };
+                class Statistics : public Core::JSON::Container {
+                public:
+                    Statistics()
+                        : Core::JSON::Container()
+                    {
+                        Add(_T("p50"), &P50);
+                        Add(_T("p95"), &P95);
+                        Add(_T("p99"), &P99);
+                        Add(_T("growth"), &Growth);
+                    }
+                    Statistics(const Statistics& copy)
+                        : Core::JSON::Container()
+                        , P50(copy.P50)
+                        , P95(copy.P95)
+                        , P99(copy.P99)
+                        , Growth(copy.Growth)
+                    {
+                        Add(_T("p50"), &P50);
+                        Add(_T("p95"), &P95);
+                        Add(_T("p99"), &P99);
+                        Add(_T("growth"), &Growth);
+                    }
+                    ~Statistics()
+                    {
+                    }
+
+                public:
+                    Statistics& operator=(const Statistics& RHS)
+                    {
+                        P50 = RHS.P50;
+                        P95 = RHS.P95;
+                        P99 = RHS.P99;
+                        Growth = RHS.Growth;
+
+                        return (*this);
+                    }
+                    Statistics& operator=(const Monitor::History::Statistics& RHS)
+                    {
+                        P50 = RHS.P50;
+                        P95 = RHS.P95;
+                        P99 = RHS.P99;
+                        Growth = RHS.Growth;
+
+                        return (*this);
+                    }
+
+                public:
+                    Core::JSON::DecUInt64 P50;
+                    Core::JSON::DecUInt64 P95;
+                    Core::JSON::DecUInt64 P99;
+                    Core::JSON::DecSInt64 Growth; // Bytes per hour
+                };
+
+            private:
+                History(const History&);
+                History& operator=(const History&);
+
+            public:
+                History()
+                    : Core::JSON::Container()
+                {
+                    Add(_T("resident"), &Resident);
+                    Add(_T("allocated"), &Allocated);
+                    Add(_T("shared"), &Shared);
+                    Add(_T("samples"), &Samples);
+                }
+                ~History()
+                {
+                }
+
+            public:
+                History& operator=(const Monitor::History& RHS)
+                {
+                    Resident = RHS.Resident();
+                    Allocated = RHS.Allocated();
+                    Shared = RHS.Shared();
+
+                    Samples.Clear();
+
+                    for (uint16_t index = 0; index < RHS.Count(); index++) {
+                        Samples.Add(Sample(RHS[index]));
+                    }
+
+                    return (*this);
+                }
+
+            public:
+                Statistics Resident;
+                Statistics Allocated;
+                Statistics Shared;
+                Core::JSON::ArrayType<Sample> Samples;
+            };
+
         private:
             Data& operator=(const Data&);
 
@@ -326,6 +668,41 @@ namespace Plugin {
             Config& operator=(const Config&);
 
         public:
+            class Prediction : public Core::JSON::Container {
+            private:
+                Prediction& operator=(const Prediction& RHS);
+
+            public:
+                Prediction()
+                    : Core::JSON::Container()
+                    , Window(0)
+                    , Horizon(60 * 60)
+                    , Restart(false)
+                {
+                    Add(_T("window"), &Window);
+                    Add(_T("horizon"), &Horizon);
+                    Add(_T("restart"), &Restart);
+                }
+                Prediction(const Prediction& copy)
+                    : Core::JSON::Container()
+                    , Window(copy.Window)
+                    , Horizon(copy.Horizon)
+                    , Restart(copy.Restart)
+                {
+                    Add(_T("window"), &Window);
+                    Add(_T("horizon"), &Horizon);
+                    Add(_T("restart"), &Restart);
+                }
+                ~Prediction()
+                {
+                }
+
+            public:
+                Core::JSON::DecUInt16 Window; //!< Number of memory measurements in the trend, 0 disables the prediction.
+                Core::JSON::DecUInt32 Horizon; //!< Seconds, warn if the memorylimit is expected to be exceeded within this time.
+                Core::JSON::Boolean Restart; //!< Restart the plugin, once it is suspended, in stead of waiting for the limit.
+            };
+
             class Entry : public Core::JSON::Container {
             private:
                 Entry& operator=(const Entry& RHS);
@@ -333,12 +710,16 @@ namespace Plugin {
             public:
                 Entry()
                     : Core::JSON::Container()
+                    , History(64)
+                    , Prediction()
                 {
                     Add(_T("callsign"), &Callsign);
                     Add(_T("memory"), &MetaData);
                     Add(_T("memorylimit"), &MetaDataLimit);
                     Add(_T("operational"), &Operational);
                     Add(_T("restartlimit"), &RestartLimit);
+                    Add(_T("history"), &History);
+                    Add(_T("prediction"), &Prediction);
                 }
                 Entry(const Entry& copy)
                     : Core::JSON::Container()
@@ -347,12 +728,16 @@ namespace Plugin {
                     , MetaDataLimit(copy.MetaDataLimit)
                     , Operational(copy.Operational)
                     , RestartLimit(copy.RestartLimit)
+                    , History(copy.History)
+                    , Prediction(copy.Prediction)
                 {
                     Add(_T("callsign"), &Callsign);
                     Add(_T("memory"), &MetaData);
                     Add(_T("memorylimit"), &MetaDataLimit);
                     Add(_T("operational"), &Operational);
                     Add(_T("restartlimit"), &RestartLimit);
+                    Add(_T("history"), &History);
+                    Add(_T("prediction"), &Prediction);
                 }
                 ~Entry()
                 {
@@ -364,13 +749,19 @@ namespace Plugin {
                 Core::JSON::DecUInt32 MetaDataLimit;
                 Core::JSON::DecSInt32 Operational;
                 Core::JSON::DecSInt32 RestartLimit;
+                Core::JSON::DecUInt16 History; //!< Number of memory measurements kept.
+                Config::Prediction Prediction;
             };
  
         public:
             Config()
                 : Core::JSON::Container()
+                , ProbeTimeout(10)
+                , SystemSampling(false)
             {
                 Add(_T("observables"), &Observables);
+                Add(_T("probetimeout"), &ProbeTimeout);
+                Add(_T("systemsampling"), &SystemSampling);
             }
             ~Config()
             {
@@ -378,6 +769,8 @@ namespace Plugin {
 
         public:
             Core::JSON::ArrayType<Entry> Observables;
+            Core::JSON::DecUInt32 ProbeTimeout; //!< Seconds a probe may take, before the plugin is considered hanging.
+            Core::JSON::Boolean SystemSampling; //!< Measure out of process plugins through /proc and cgroups, in stead of IMemory.
         };
 
         class MonitorObjects : public PluginHost::IPlugin::INotification {
@@ -420,22 +813,43 @@ namespace Plugin {
                 enum evaluation {
                     SUCCESFULL      = 0x00,
                     NOT_OPERATIONAL = 0x01,
-                    EXCEEDED_MEMORY = 0x02
+                    EXCEEDED_MEMORY = 0x02,
+                    EXCEEDING_MEMORY = 0x04
                 };
 
+                enum check {
+                    NONE        = 0x00,
+                    MEMORY      = 0x01,
+                    OPERATIONAL = 0x02
+                };
+
+                // A trend over less samples than this is not trusted for a prediction.
+                static constexpr uint16_t MinimumPredictionSamples = 4;
+
             public:
-                MonitorObject(const bool actOnOperational, const uint32_t operationalInterval, const uint32_t memoryInterval, const uint64_t memoryThreshold, const uint64_t absTime, const uint32_t restartLimit)
+                MonitorObject(const bool actOnOperational, const uint32_t operationalInterval, const uint32_t memoryInterval, const uint64_t memoryThreshold, const uint64_t absTime, const uint32_t restartLimit, const uint16_t history, const uint16_t predictionWindow, const uint32_t predictionHorizon, const bool predictiveRestart)
                     : _operationalInterval(operationalInterval)
                     , _memoryInterval(memoryInterval)
                     , _memoryThreshold(memoryThreshold * 1024)
+                    , _predictionWindow(predictionWindow)
+                    , _predictionHorizon(predictionHorizon)
+                    , _predictiveRestart(predictiveRestart)
+                    , _predicted(false)
+                    , _exceedingIn(0)
+                    , _activated(0)
                     , _operationalSlots(operationalInterval)
                     , _memorySlots(memoryInterval)
                     , _nextSlot(absTime)
                     , _restartCount(0)
                     , _restartLimit(restartLimit)
                     , _measurement()
+                    , _history(history)
                     , _operationalEvaluate(actOnOperational)
                     , _source(nullptr)
+                    , _probing(0)
+                    , _hung(false)
+                    , _job()
+                    , _sampler()
                 {
                     ASSERT ((_operationalInterval != 0) || (_memoryInterval != 0));
 
@@ -450,15 +864,26 @@ namespace Plugin {
                     : _operationalInterval(copy._operationalInterval)
                     , _memoryInterval(copy._memoryInterval)
                     , _memoryThreshold(copy._memoryThreshold)
+                    , _predictionWindow(copy._predictionWindow)
+                    , _predictionHorizon(copy._predictionHorizon)
+                    , _predictiveRestart(copy._predictiveRestart)
+                    , _predicted(copy._predicted)
+                    , _exceedingIn(copy._exceedingIn)
+                    , _activated(copy._activated)
                     , _operationalSlots(copy._operationalSlots)
                     , _memorySlots(copy._memorySlots)
                     , _nextSlot(copy._nextSlot)
                     , _restartCount(copy._restartCount)
                     , _restartLimit(copy._restartLimit)
                     , _measurement(copy._measurement)
+                    , _history(copy._history)
                     , _operationalEvaluate(copy._operationalEvaluate)
                     , _source(copy._source)
                     , _interval(copy._interval)
+                    , _probing(copy._probing)
+                    , _hung(copy._hung)
+                    , _job(copy._job)
+                    , _sampler(copy._sampler)
                 {
                     if (_source != nullptr) {
                         _source->AddRef();
@@ -497,6 +922,24 @@ namespace Plugin {
                 {
                     return (_operationalEvaluate);
                 }
+                inline bool HasPredictiveRestart() const
+                {
+                    return (_predictiveRestart);
+                }
+                // Only report a predicted exceeding once, till the trend goes away again.
+                inline bool Predicted() const
+                {
+                    return (_predicted);
+                }
+                inline void Predicted(const bool predicted)
+                {
+                    _predicted = predicted;
+                }
+                // Seconds till the memorylimit is expected to be exceeded, valid if EXCEEDING_MEMORY was reported.
+                inline uint32_t ExceedingIn() const
+                {
+                    return (_exceedingIn);
+                }
                 inline uint32_t Interval() const
                 {
                     return (_interval);
@@ -505,6 +948,10 @@ namespace Plugin {
                 {
                     return (_measurement);
                 }
+                inline const Monitor::History& History() const
+                {
+                    return (_history);
+                }
                 inline uint64_t TimeSlot() const
                 {
                     return (_nextSlot);
@@ -512,10 +959,11 @@ namespace Plugin {
                 inline void Reset()
                 {
                     _measurement.Reset();
+                    _history.Clear();
                 }
                 inline void Retrigger(uint64_t currentSlot)
                 {
-                    while (_nextSlot < currentSlot) {
+                    while (_nextSlot <= currentSlot) {
                         _nextSlot += _interval;
                     }
                 }
@@ -526,57 +974,250 @@ namespace Plugin {
                         _source = nullptr;
                     }
 
+                    if (_sampler.IsValid() == true) {
+                        _sampler.Release();
+                    }
+
                     if (memory != nullptr) {
                         _source = memory;
                         _source->AddRef();
+
+                        // A new instance, the trend of the previous one does not apply.
+                        _activated = Core::Time::Now().Ticks();
+                        _predicted = false;
                     }
 
                     _measurement.Operational(_source != nullptr);
                 }
-                inline uint32_t Evaluate()
+                // The caller owns the returned reference, so it can be used without holding the lock.
+                inline Exchange::IMemory* Source() const
                 {
-                    uint32_t status(SUCCESFULL);
                     if (_source != nullptr) {
+                        _source->AddRef();
+                    }
+                    return (_source);
+                }
+                // Measure the memory through the kernel, set after Set(), as that drops the sampler.
+                inline void Sampler(const Core::ProxyType<ProcessSampler>& sampler)
+                {
+                    _sampler = sampler;
+                    _activated = Core::Time::Now().Ticks();
+                    _predicted = false;
+                }
+                inline const Core::ProxyType<ProcessSampler>& Sampler() const
+                {
+                    return (_sampler);
+                }
+                inline const Core::ProxyType<Core::IDispatchType<void>>& Job() const
+                {
+                    return (_job);
+                }
+                inline void Job(const Core::ProxyType<Core::IDispatchType<void>>& job)
+                {
+                    _job = job;
+                }
+                // Start time of the probe in progress, 0 if there is none.
+                inline uint64_t Probing() const
+                {
+                    return (_probing);
+                }
+                inline void Probing(const uint64_t now)
+                {
+                    _probing = now;
+                }
+                inline void Probed()
+                {
+                    _probing = 0;
+                    _hung = false;
+                }
+                // Only report a hanging probe once.
+                inline bool Hung() const
+                {
+                    return (_hung);
+                }
+                inline void Hung(const bool hung)
+                {
+                    _hung = hung;
+                }
+                // A probe is done in three steps, only the first and the last one under the lock: which checks are
+                // due (Due), reading them without the lock, as that calls into the plugin, and adding the results to
+                // the measurement and the history (Commit).
+                inline uint8_t Due(const bool measurable)
+                {
+                    uint8_t result(NONE);
+
+                    if (measurable == true) {
                         _operationalSlots -= _interval;
                         _memorySlots -= _interval;
 
+                        if ((_memoryInterval != 0) && (_memorySlots == 0)) {
+                            result |= MEMORY;
+                            _memorySlots = _memoryInterval;
+                        }
                         if ((_operationalInterval != 0) && (_operationalSlots == 0)) {
-                            bool operational = _source->IsOperational();
-                            _measurement.Operational(operational);
-                            if ((operational == false) && (_operationalEvaluate == true) ) {
-                                status |= NOT_OPERATIONAL;
-                                TRACE_L1("Status not operational. %d", __LINE__);
-                            }
+                            result |= OPERATIONAL;
                             _operationalSlots = _operationalInterval;
                         }
-                        if ((_memoryInterval != 0) && (_memorySlots == 0)) {
-                            _measurement.Measure(_source);
+                    }
+                    return (result);
+                }
+                // A check that was due, but could not be done, is done on the next probe.
+                inline void Undo(const uint8_t due)
+                {
+                    if ((due & MEMORY) != 0) {
+                        _memorySlots = _interval;
+                    }
+                    if ((due & OPERATIONAL) != 0) {
+                        _operationalSlots = _interval;
+                    }
+                }
+                // The sampler, if there is one, does not call into the plugin, so the memory is measured even if
+                // the plugin does not answer the operational check. Returns the checks that were done.
+                static uint8_t Read(const uint8_t due, Exchange::IMemory* source, ProcessSampler* sampler, Monitor::History::Sample& reading, bool& operational)
+                {
+                    uint8_t done(NONE);
+
+                    if ((due & MEMORY) != 0) {
+                        // If the plugin process is gone, the sampler has nothing to say about it.
+                        if ((sampler != nullptr) && (sampler->Sample() == true)) {
+                            reading.Resident = sampler->Resident();
+                            reading.Allocated = sampler->Allocated();
+                            reading.Shared = sampler->Shared();
+                            reading.Processes = sampler->Processes();
+                            done |= MEMORY;
+                        }
+                        else if (source != nullptr) {
+                            reading.Resident = source->Resident();
+                            reading.Allocated = source->Allocated();
+                            reading.Shared = source->Shared();
+                            reading.Processes = source->Processes();
+                            done |= MEMORY;
+                        }
+                    }
+                    if (((due & OPERATIONAL) != 0) && (source != nullptr)) {
+                        operational = source->IsOperational();
+                        done |= OPERATIONAL;
+                    }
+                    return (done);
+                }
+                inline uint32_t Commit(const uint8_t done, const Monitor::History::Sample& reading, const bool operational)
+                {
+                    uint32_t status(SUCCESFULL);
 
-                            if ( (_memoryThreshold != 0) && (_measurement.Resident().Last() > _memoryThreshold) ) {
-                                status |= EXCEEDED_MEMORY;
-                                TRACE_L1("Status MetaData Exceeded. %d", __LINE__);
-                            }
-                            _memorySlots = _memoryInterval;
+                    if ((done & MEMORY) != 0) {
+                        _measurement.Measure(reading);
+                        _history.Add(reading.Time, _measurement);
+
+                        if ( (_memoryThreshold != 0) && (_measurement.Resident().Last() > _memoryThreshold) ) {
+                            status |= EXCEEDED_MEMORY;
+                            TRACE_L1("Status MetaData Exceeded. %d", __LINE__);
+                        }
+                        else if ( (_memoryThreshold != 0) && (_predictionWindow != 0) && (Predict() == true) ) {
+                            status |= EXCEEDING_MEMORY;
+                            TRACE_L1("Status MetaData Exceeding in %d s. %d", _exceedingIn, __LINE__);
+                        }
+                        else {
+                            // The trend is gone, report it again if it comes back.
+                            _predicted = false;
+                        }
+                    }
+                    if ((done & OPERATIONAL) != 0) {
+                        _measurement.Operational(operational);
+                        if ((operational == false) && (_operationalEvaluate == true) ) {
+                            status |= NOT_OPERATIONAL;
+                            TRACE_L1("Status not operational. %d", __LINE__);
                         }
                     }
                     return (status);
                 }
 
+            private:
+                // Extrapolate the resident memory growth over the last samples of this instance.
+                bool Predict()
+                {
+                    bool result = false;
+                    uint16_t window = std::min(_predictionWindow, _history.Count(_activated));
+
+                    if (window >= MinimumPredictionSamples) {
+                        int64_t growth = _history.Growth(&Monitor::History::Sample::Resident, window);
+
+                        if (growth > 0) {
+                            uint64_t remaining = _memoryThreshold - _measurement.Resident().Last();
+                            uint64_t seconds = (remaining * 60 * 60) / static_cast<uint64_t>(growth);
+
+                            if (seconds <= _predictionHorizon) {
+                                _exceedingIn = static_cast<uint32_t>(seconds);
+                                result = true;
+                            }
+                        }
+                    }
+
+                    return (result);
+                }
+
             private:
                 const uint32_t _operationalInterval; //!< Interval (s) to check the monitored processes
                 const uint32_t _memoryInterval; //!<  Interval (s) for a memory measurement.
                 const uint64_t _memoryThreshold; //!< MetaData threshold in bytes for all processes.
+                const uint16_t _predictionWindow; //!< Number of samples used for the trend, 0 is no prediction.
+                const uint32_t _predictionHorizon; //!< Report if the threshold is expected to be exceeded within (s).
+                const bool _predictiveRestart; //!< Restart early, when the plugin is idle (suspended).
+                bool _predicted;
+                uint32_t _exceedingIn;
+                uint64_t _activated;
                 uint32_t _operationalSlots;
                 uint32_t _memorySlots;
                 uint64_t _nextSlot;
                 uint32_t _restartCount;
                 uint32_t _restartLimit;
                 MetaData _measurement;
+                Monitor::History _history;
                 bool _operationalEvaluate;
                 Exchange::IMemory* _source;
                 uint32_t _interval; //!< The lowest possible interval to check both memory and processes.
+                uint64_t _probing; //!< Start of the probe in progress, 0 if idle.
+                bool _hung;
+                Core::ProxyType<Core::IDispatchType<void>> _job; //!< Runs the probe of this observable.
+                Core::ProxyType<ProcessSampler> _sampler; //!< Set if the plugin is measured through the kernel.
             };
 
+            typedef std::map<string, MonitorObject> ObjectMap;
+            typedef ObjectMap::value_type Observable;
+
+            // Every observable has its own probe job, so the probes of different (out of process) plugins
+            // run concurrently and a plugin that does not answer only holds up its own probe.
+            class ProbeJob : public Core::IDispatchType<void> {
+            private:
+                ProbeJob() = delete;
+                ProbeJob(const ProbeJob& copy) = delete;
+                ProbeJob& operator=(const ProbeJob& RHS) = delete;
+
+            public:
+                ProbeJob(MonitorObjects* parent, Observable* observable)
+                    : _parent(*parent)
+                    , _observable(*observable)
+                {
+                    ASSERT (parent != nullptr);
+                    ASSERT (observable != nullptr);
+                }
+                virtual ~ProbeJob()
+                {
+                }
+
+            public:
+                virtual void Dispatch() override
+                {
+                    _parent.Evaluate(_observable);
+                }
+
+            private:
+                MonitorObjects& _parent;
+                Observable& _observable;
+            };
+
+            // Granularity of the probe schedule, probes are at most this late.
+            static constexpr uint64_t WheelResolution = 100 * 1000;
+
         public:
 			#ifdef __WIN32__ 
 			#pragma warning( disable : 4355 )
@@ -584,6 +1225,10 @@ namespace Plugin {
 			MonitorObjects()
                 : _adminLock()
                 , _monitor()
+                , _wheel(WheelResolution)
+                , _expired()
+                , _probeTimeout(0)
+                , _systemSampling(false)
                 , _job(Core::ProxyType<Job>::Create(this))
                 , _service(nullptr)
             {
@@ -611,7 +1256,7 @@ namespace Plugin {
                     index++;
                 }
             }
-            inline void Open(PluginHost::IShell* service, Core::JSON::ArrayType<Config::Entry>::Iterator& index)
+            inline void Open(PluginHost::IShell* service, const uint32_t probeTimeout, const bool systemSampling, Core::JSON::ArrayType<Config::Entry>::Iterator& index)
             {
                 ASSERT((service != nullptr) && (_service == nullptr));
 
@@ -622,6 +1267,10 @@ namespace Plugin {
 
                 _adminLock.Lock();
 
+                _probeTimeout = static_cast<uint64_t>(probeTimeout) * 1000 * 1000; // Move from Seconds to MicroSeconds
+                _systemSampling = systemSampling;
+                _wheel.Clear(baseTime);
+
                 while (index.Next() == true) {
                     Config::Entry& element(index.Current());
                     string callSign(element.Callsign.Value());
@@ -630,8 +1279,18 @@ namespace Plugin {
                     interval = interval * 1000 * 1000; // Move from Seconds to MicroSeconds
                     uint32_t memory(element.MetaData.Value() * 1000 * 1000);        // Move from Seconds to MicroSeconds
                     uint32_t restartLimit(element.RestartLimit.Value());
+                    uint16_t history(memory != 0 ? element.History.Value() : 0);
+                    uint16_t window(std::min(element.Prediction.Window.Value(), history));
                     if ( (interval != 0) || (memory !=0) ) {
-                        _monitor.insert(std::pair<string, MonitorObject>(callSign, MonitorObject(element.Operational.Value() >= 0, interval, memory, memoryThreshold, baseTime,restartLimit)));
+                        std::pair<ObjectMap::iterator, bool> added(_monitor.insert(std::pair<string, MonitorObject>(callSign, MonitorObject(element.Operational.Value() >= 0, interval, memory, memoryThreshold, baseTime, restartLimit, history, window, element.Prediction.Horizon.Value(), element.Prediction.Restart.Value()))));
+
+                        if (added.second == true) {
+                            // Map entries do not move, so the job and the wheel can refer to them.
+                            Observable& observable(*(added.first));
+
+                            observable.second.Job(Core::ProxyType<Core::IDispatchType<void>>(Core::ProxyType<ProbeJob>::Create(this, &observable)));
+                            _wheel.Insert(observable.second.TimeSlot(), &observable);
+                        }
                     }
                 }
 
@@ -645,7 +1304,16 @@ namespace Plugin {
 
                 PluginHost::WorkerPool::Instance().Revoke(_job);
 
+                // No new probes are started anymore, wait for the ones still running.
+                ObjectMap::iterator index(_monitor.begin());
+
+                while (index != _monitor.end()) {
+                    PluginHost::WorkerPool::Instance().Revoke(index->second.Job());
+                    index++;
+                }
+
                 _adminLock.Lock();
+                _wheel.Clear(0);
                 _monitor.clear();
                 _adminLock.Unlock();
                 _service->Release();
@@ -653,15 +1321,32 @@ namespace Plugin {
             }
             virtual void StateChange(PluginHost::IShell* service)
             {
+                // Only act on Activated or Deactivated...
+                PluginHost::IShell::state currentState(service->State());
+                Core::ProxyType<ProcessSampler> sampler;
+
+                // In process plugins can only be measured by themselves, through IMemory. Finding the hosting
+                // process walks all of /proc, so it is not done while holding the lock.
+                if ((_systemSampling == true) && (currentState == PluginHost::IShell::ACTIVATED)) {
+                    _adminLock.Lock();
+                    bool monitored(_monitor.find(service->Callsign()) != _monitor.end());
+                    _adminLock.Unlock();
+
+                    if (monitored == true) {
+                        uint32_t pid(ProcessSampler::Find(service->Callsign()));
+
+                        if (pid != 0) {
+                            sampler = Core::ProxyType<ProcessSampler>::Create(pid);
+                        }
+                    }
+                }
+
                 _adminLock.Lock();
 
                 std::map<string, MonitorObject>::iterator index(_monitor.find(service->Callsign()));
 
                 if (index != _monitor.end()) {
 
-                    // Only act on Activated or Deactivated...
-                    PluginHost::IShell::state currentState(service->State());
-
                     if (currentState == PluginHost::IShell::ACTIVATED) {
                         // Get the MetaData interface
                         Exchange::IMemory* memory = service->QueryInterface<Exchange::IMemory>();
@@ -670,6 +1355,10 @@ namespace Plugin {
                             index->second.Set(memory);
                             memory->Release();
                         }
+
+                        if (sampler.IsValid() == true) {
+                            index->second.Sampler(sampler);
+                        }
                     }
                     else if (currentState == PluginHost::IShell::DEACTIVATION) {
                         index->second.Set(nullptr);
@@ -728,6 +1417,23 @@ namespace Plugin {
 
                 return (found);
             }
+            bool History(const string& name, Monitor::Data::History& result)
+            {
+                bool found = false;
+
+                _adminLock.Lock();
+
+                std::map<string, MonitorObject>::iterator index(_monitor.find(name));
+
+                if (index != _monitor.end()) {
+                    result = index->second.History();
+                    found = true;
+                }
+
+                _adminLock.Unlock();
+
+                return (found);
+            }
             bool Reset(const string& name, Monitor::MetaData& result)
             {
                 bool found = false;
@@ -752,46 +1458,49 @@ namespace Plugin {
             END_INTERFACE_MAP
 
         private:
-            // Probe can be run in an unlocked state as the destruction of the observer list
-            // is always done if the thread that calls the Probe is blocked (paused)
+            // Only the observables that are due are taken from the wheel. Their probes are handed to the
+            // workerpool, so the plugins are probed concurrently. A probe that is still running when the
+            // observable is due again, and runs longer than the probe timeout, is reported as hanging.
             void Probe()
             {
                 uint64_t scheduledTime(Core::Time::Now().Ticks());
-                uint64_t nextSlot(static_cast<uint64_t>(~0));
+                std::list<string> hanging;
 
-                std::map<string, MonitorObject>::iterator index(_monitor.begin());
+                _adminLock.Lock();
 
-                // Go through the list of pending observations...
-                while (index != _monitor.end()) {
-                    MonitorObject& info(index->second);
+                _wheel.Expired(scheduledTime, _expired);
 
-                    if (info.TimeSlot() <= scheduledTime) {
-                        uint32_t value (info.Evaluate());
+                std::vector<Observable*>::iterator index(_expired.begin());
 
-                        if ( (value & (MonitorObject::NOT_OPERATIONAL|MonitorObject::EXCEEDED_MEMORY)) != 0 ) {
-                            PluginHost::IShell* plugin(_service->QueryInterfaceByCallsign<PluginHost::IShell>(index->first));
+                while (index != _expired.end()) {
+                    MonitorObject& info((*index)->second);
 
-                            if (plugin != nullptr) {
-                                Core::EnumerateType<PluginHost::IShell::reason> why (((value & MonitorObject::EXCEEDED_MEMORY) != 0) ? PluginHost::IShell::MEMORY_EXCEEDED : PluginHost::IShell::FAILURE);
+                    if (info.Probing() == 0) {
+                        info.Probing(scheduledTime);
+                        PluginHost::WorkerPool::Instance().Submit(info.Job());
+                    }
+                    else if (((scheduledTime - info.Probing()) >= _probeTimeout) && (info.Hung() == false)) {
+                        info.Hung(true);
+                        hanging.push_back((*index)->first);
+                    }
 
-                                const string message("{\"callsign\": \"" + plugin->Callsign() + "\", \"action\": \"Deactivate\", \"reason\": \"" + why.Data() + "\" }");
-                                SYSLOG(Trace::Fatal, (_T("FORCED Shutdown: %s by reason: %s."), plugin->Callsign().c_str(), why.Data()));
+                    info.Retrigger(scheduledTime);
+                    _wheel.Insert(info.TimeSlot(), *index);
 
-                                _service->Notify(message);
-                                
-                                PluginHost::WorkerPool::Instance().Submit(PluginHost::IShell::Job::Create(plugin, PluginHost::IShell::DEACTIVATED, why.Value()));
+                    index++;
+                }
 
-                                plugin->Release();
-                            }
-                        }
-                        info.Retrigger(scheduledTime);
-                    }
+                _expired.clear();
 
-                    if (info.TimeSlot() < nextSlot) {
-                        nextSlot = info.TimeSlot();
-                    }
+                uint64_t nextSlot(_wheel.Next());
 
-                    index++;
+                _adminLock.Unlock();
+
+                while (hanging.size() != 0) {
+                    SYSLOG(Trace::Warning, (_T("HANGING: %s did not answer the probe within %d seconds."), hanging.front().c_str(), static_cast<uint32_t>(_probeTimeout / (1000 * 1000))));
+
+                    Hanging(hanging.front());
+                    hanging.pop_front();
                 }
 
                 if (nextSlot != static_cast<uint64_t>(~0)) {
@@ -805,9 +1514,132 @@ namespace Plugin {
                 }
             }
 
+            // Runs on a workerpool thread, the calls to the plugin are done without holding the lock. What they
+            // return is added to the observable under the lock, as the snapshots read it.
+            void Evaluate(Observable& observable)
+            {
+                MonitorObject& info(observable.second);
+                Monitor::History::Sample reading;
+                bool operational(false);
+
+                ::memset(&reading, 0, sizeof(reading));
+
+                _adminLock.Lock();
+                Exchange::IMemory* source(info.Source());
+                Core::ProxyType<ProcessSampler> sampler(info.Sampler());
+                const uint8_t due(info.Due((source != nullptr) || (sampler.IsValid() == true)));
+                _adminLock.Unlock();
+
+                const uint8_t done(MonitorObject::Read(due, source, (sampler.IsValid() == true ? &(*sampler) : nullptr), reading, operational));
+                reading.Time = Core::Time::Now().Ticks();
+
+                if (source != nullptr) {
+                    source->Release();
+                }
+
+                _adminLock.Lock();
+                info.Undo(due & ~done);
+                uint32_t value(info.Commit(done, reading, operational));
+                _adminLock.Unlock();
+
+                if ( (value & (MonitorObject::NOT_OPERATIONAL|MonitorObject::EXCEEDED_MEMORY)) != 0 ) {
+                    Deactivate(observable.first, ((value & MonitorObject::EXCEEDED_MEMORY) != 0) ? PluginHost::IShell::MEMORY_EXCEEDED : PluginHost::IShell::FAILURE);
+                }
+                else if ((value & MonitorObject::EXCEEDING_MEMORY) != 0) {
+                    Predicted(observable.first, info);
+                }
+
+                _adminLock.Lock();
+                info.Probed();
+                _adminLock.Unlock();
+            }
+
+            void Hanging(const string& callsign)
+            {
+                const string message("{\"callsign\": \"" + callsign + "\", \"action\": \"Hanging\", \"seconds\": " + Core::NumberType<uint32_t>(static_cast<uint32_t>(_probeTimeout / (1000 * 1000))).Text() + " }");
+
+                _service->Notify(message);
+
+                _adminLock.Lock();
+
+                ObjectMap::iterator index(_monitor.find(callsign));
+                bool restart((index != _monitor.end()) && (index->second.HasRestartAllowed() == true));
+
+                _adminLock.Unlock();
+
+                // Same as not being operational, only restart it if that is allowed.
+                if (restart == true) {
+                    Deactivate(callsign, PluginHost::IShell::FAILURE);
+                }
+            }
+
+            void Deactivate(const string& callsign, const PluginHost::IShell::reason reason)
+            {
+                PluginHost::IShell* plugin(_service->QueryInterfaceByCallsign<PluginHost::IShell>(callsign));
+
+                if (plugin != nullptr) {
+                    Core::EnumerateType<PluginHost::IShell::reason> why (reason);
+
+                    const string message("{\"callsign\": \"" + plugin->Callsign() + "\", \"action\": \"Deactivate\", \"reason\": \"" + why.Data() + "\" }");
+                    SYSLOG(Trace::Fatal, (_T("FORCED Shutdown: %s by reason: %s."), plugin->Callsign().c_str(), why.Data()));
+
+                    _service->Notify(message);
+
+                    PluginHost::WorkerPool::Instance().Submit(PluginHost::IShell::Job::Create(plugin, PluginHost::IShell::DEACTIVATED, why.Value()));
+
+                    plugin->Release();
+                }
+            }
+
+            void Predicted(const string& callsign, MonitorObject& info)
+            {
+                // The probe and a new instance of the plugin both change the prediction, so test and set it
+                // under the lock, the notification is sent after it is released.
+                _adminLock.Lock();
+                const bool report(info.Predicted() == false);
+                const uint32_t exceedingIn(info.ExceedingIn());
+                info.Predicted(true);
+                _adminLock.Unlock();
+
+                if (report == true) {
+                    const string message("{\"callsign\": \"" + callsign + "\", \"action\": \"Predict\", \"reason\": \"" + Core::EnumerateType<PluginHost::IShell::reason>(PluginHost::IShell::MEMORY_EXCEEDED).Data() + "\", \"seconds\": " + Core::NumberType<uint32_t>(exceedingIn).Text() + " }");
+                    SYSLOG(Trace::Warning, (_T("PREDICTED: %s exceeds its memory limit in %d seconds."), callsign.c_str(), exceedingIn));
+
+                    _service->Notify(message);
+                }
+
+                if (info.HasPredictiveRestart() == true) {
+                    PluginHost::IShell* plugin(_service->QueryInterfaceByCallsign<PluginHost::IShell>(callsign));
+
+                    if (plugin != nullptr) {
+                        PluginHost::IStateControl* stateControl(plugin->QueryInterface<PluginHost::IStateControl>());
+
+                        // Only restart if nobody is looking, otherwise wait for the next evaluation.
+                        if (stateControl != nullptr) {
+                            if (stateControl->State() == PluginHost::IStateControl::SUSPENDED) {
+                                const string message("{\"callsign\": \"" + callsign + "\", \"action\": \"Deactivate\", \"reason\": \"Predicted\" }");
+                                SYSLOG(Trace::Warning, (_T("EARLY Shutdown: %s, it is suspended and expected to exceed its memory limit."), callsign.c_str()));
+
+                                _service->Notify(message);
+
+                                // Use MEMORY_EXCEEDED, so it is restarted as if it had reached the limit.
+                                PluginHost::WorkerPool::Instance().Submit(PluginHost::IShell::Job::Create(plugin, PluginHost::IShell::DEACTIVATED, PluginHost::IShell::MEMORY_EXCEEDED));
+                            }
+                            stateControl->Release();
+                        }
+
+                        plugin->Release();
+                    }
+                }
+            }
+
         private:
             Core::CriticalSection _adminLock;
-            std::map<string, MonitorObject> _monitor;
+            ObjectMap _monitor;
+            TimerWheelType<Observable> _wheel;
+            std::vector<Observable*> _expired;
+            uint64_t _probeTimeout;
+            bool _systemSampling;
             Core::ProxyType< Core::IDispatchType<void> > _job;
             PluginHost::IShell* _service;
         };
@@ -0,0 +1,436 @@
+#ifndef __MONITOR_PROCESSSAMPLER_H
+#define __MONITOR_PROCESSSAMPLER_H
+
+#include "Module.h"
+
+#ifndef __WIN32__
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+#ifndef __WIN32__
+    // Measures the memory of an out of process plugin straight from the kernel, so it does not take
+    // any calls into the plugin and it keeps working if the plugin does not respond.
+    // All files are opened once and read with pread, a sample costs a few syscalls per process:
+    //  - /proc/<pid>/statm for the allocated and resident memory,
+    //  - /proc/<pid>/smaps_rollup, if the kernel has it, for the shared memory,
+    //  - the process tree from /proc/<pid>/task/<pid>/children.
+    // If the plugin runs in a cgroup (v2) of its own, the processes are taken from cgroup.procs and the
+    // resident and shared memory from memory.stat, which also covers processes that are no longer
+    // children of the plugin process. The resident memory is taken as anon + file_mapped, as
+    // memory.current also counts the page cache of the files the plugin touched.
+    class ProcessSampler {
+    private:
+        ProcessSampler() = delete;
+        ProcessSampler(const ProcessSampler&) = delete;
+        ProcessSampler& operator=(const ProcessSampler&) = delete;
+
+        static constexpr uint16_t BufferSize = 4096;
+        static constexpr uint16_t MaxProcesses = 255;
+
+        struct Process {
+            uint32_t Id;
+            int Statm;
+            int Rollup;
+            int Children;
+        };
+
+    public:
+        ProcessSampler(const uint32_t pid)
+            : _main(pid)
+            , _pageSize(::sysconf(_SC_PAGESIZE))
+            , _processes()
+            , _memoryStat(-1)
+            , _cgroupProcs(-1)
+            , _allocated(0)
+            , _resident(0)
+            , _shared(0)
+        {
+            string path;
+
+            // Only a cgroup that is not shared with us says something about the plugin alone.
+            if ((CGroup(pid, path) == true) && (path != _T("/"))) {
+                string own;
+
+                if ((CGroup(::getpid(), own) == false) || (own != path)) {
+                    string base(_T("/sys/fs/cgroup") + path);
+
+                    _memoryStat = ::open((base + _T("/memory.stat")).c_str(), O_RDONLY | O_CLOEXEC);
+                    _cgroupProcs = ::open((base + _T("/cgroup.procs")).c_str(), O_RDONLY | O_CLOEXEC);
+                }
+            }
+        }
+        ~ProcessSampler()
+        {
+            Close(_processes);
+            Close(_memoryStat);
+            Close(_cgroupProcs);
+        }
+
+    public:
+        // Pid of the process hosting the given callsign, 0 if it is not hosted in a process of its own.
+        static uint32_t Find(const string& callsign)
+        {
+            uint32_t result = 0;
+            DIR* dir = ::opendir("/proc");
+
+            if (dir != nullptr) {
+                struct dirent* entry;
+
+                while ((result == 0) && ((entry = ::readdir(dir)) != nullptr)) {
+                    char* end;
+                    uint32_t pid = static_cast<uint32_t>(::strtoul(entry->d_name, &end, 10));
+
+                    if ((pid != 0) && (*end == '\0') && (IsHosting(pid, callsign) == true)) {
+                        result = pid;
+                    }
+                }
+
+                ::closedir(dir);
+            }
+
+            return (result);
+        }
+
+        inline uint32_t Id() const
+        {
+            return (_main);
+        }
+        inline uint64_t Allocated() const
+        {
+            return (_allocated);
+        }
+        inline uint64_t Resident() const
+        {
+            return (_resident);
+        }
+        inline uint64_t Shared() const
+        {
+            return (_shared);
+        }
+        inline uint8_t Processes() const
+        {
+            return (static_cast<uint8_t>(_processes.size()));
+        }
+
+        // Returns false if the plugin process is gone.
+        bool Sample()
+        {
+            Refresh();
+
+            bool result = false;
+
+            _allocated = 0;
+            _resident = 0;
+            _shared = 0;
+
+            std::vector<Process>::iterator index(_processes.begin());
+
+            while (index != _processes.end()) {
+                uint64_t size, resident, shared;
+
+                if (ReadStatm(index->Statm, size, resident, shared) == false) {
+                    // It died since the refresh, the next one opens it again if the pid is back, or leaves it out.
+                    Close(index->Statm);
+                    Close(index->Rollup);
+                    Close(index->Children);
+                    index = _processes.erase(index);
+                }
+                else {
+                    result = (result == true) || (index->Id == _main);
+                    _allocated += size * _pageSize;
+
+                    if (index->Rollup != -1) {
+                        uint16_t length = Read(index->Rollup);
+
+                        shared = (Field(length, "Shared_Clean:") + Field(length, "Shared_Dirty:")) * 1024;
+                    }
+                    else {
+                        shared *= _pageSize;
+                    }
+
+                    _resident += resident * _pageSize;
+                    _shared += shared;
+
+                    index++;
+                }
+            }
+
+            if (_memoryStat != -1) {
+                uint16_t length = Read(_memoryStat);
+
+                if (length != 0) {
+                    uint64_t mapped = Field(length, "file_mapped ");
+
+                    _resident = Field(length, "anon ") + mapped;
+                    _shared = Field(length, "shmem ") + mapped;
+                }
+            }
+
+            return (result);
+        }
+
+    private:
+        static bool IsHosting(const uint32_t pid, const string& callsign)
+        {
+            bool result = false;
+            char buffer[1024];
+            int fd = ::open((_T("/proc/") + Core::NumberType<uint32_t>(pid).Text() + _T("/cmdline")).c_str(), O_RDONLY | O_CLOEXEC);
+
+            if (fd != -1) {
+                ssize_t length = ::read(fd, buffer, sizeof(buffer) - 1);
+
+                if (length > 0) {
+                    const char* current = buffer;
+                    const char* end = &(buffer[length]);
+                    bool option = false;
+
+                    buffer[length] = '\0';
+
+                    // The hosting process gets the callsign as an argument: WPEProcess ... -C <callsign> ...
+                    while ((result == false) && (current < end)) {
+                        result = ((option == true) && (callsign == current));
+                        option = (::strcmp(current, "-C") == 0);
+                        current += ::strlen(current) + 1;
+                    }
+                }
+
+                ::close(fd);
+            }
+
+            return (result);
+        }
+        static bool CGroup(const uint32_t pid, string& path)
+        {
+            bool result = false;
+            char buffer[1024];
+            int fd = ::open((_T("/proc/") + Core::NumberType<uint32_t>(pid).Text() + _T("/cgroup")).c_str(), O_RDONLY | O_CLOEXEC);
+
+            if (fd != -1) {
+                ssize_t length = ::read(fd, buffer, sizeof(buffer) - 1);
+
+                if (length > 0) {
+                    buffer[length] = '\0';
+
+                    // The unified (v2) hierarchy is the line starting with 0::
+                    const char* line = (::strncmp(buffer, "0::", 3) == 0 ? buffer : ::strstr(buffer, "\n0::"));
+
+                    if (line != nullptr) {
+                        line += (line == buffer ? 3 : 4);
+                        path = string(line, ::strcspn(line, "\n"));
+                        result = (path.empty() == false);
+                    }
+                }
+
+                ::close(fd);
+            }
+
+            return (result);
+        }
+        static void Close(int& fd)
+        {
+            if (fd != -1) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        static void Close(std::vector<Process>& processes)
+        {
+            std::vector<Process>::iterator index(processes.begin());
+
+            while (index != processes.end()) {
+                Close(index->Statm);
+                Close(index->Rollup);
+                Close(index->Children);
+                index++;
+            }
+
+            processes.clear();
+        }
+        // Reads the file from the start, the content is in _buffer, 0 terminated.
+        uint16_t Read(const int fd)
+        {
+            ssize_t length = ::pread(fd, _buffer, BufferSize - 1, 0);
+
+            length = (length < 0 ? 0 : length);
+            _buffer[length] = '\0';
+
+            return (static_cast<uint16_t>(length));
+        }
+        bool ReadStatm(const int fd, uint64_t& size, uint64_t& resident, uint64_t& shared)
+        {
+            bool result = false;
+
+            if (Read(fd) != 0) {
+                char* current;
+
+                size = ::strtoull(_buffer, &current, 10);
+                resident = ::strtoull(current, &current, 10);
+                shared = ::strtoull(current, nullptr, 10);
+                result = true;
+            }
+
+            return (result);
+        }
+        // Value of a "<name> <value>" line in _buffer.
+        uint64_t Field(const uint16_t length, const char name[]) const
+        {
+            uint64_t result = 0;
+            const char* line = _buffer;
+            size_t size = ::strlen(name);
+
+            while ((line != nullptr) && (line < &(_buffer[length]))) {
+                if (::strncmp(line, name, size) == 0) {
+                    result = ::strtoull(&(line[size]), nullptr, 10);
+                    line = nullptr;
+                }
+                else {
+                    line = ::strchr(line, '\n');
+                    line = (line != nullptr ? line + 1 : nullptr);
+                }
+            }
+
+            return (result);
+        }
+        // Take the open files of a known process, or open them for a new one.
+        void Adopt(const uint32_t pid, std::vector<Process>& processes)
+        {
+            std::vector<Process>::iterator index(_processes.begin());
+
+            while ((index != _processes.end()) && (index->Id != pid)) {
+                index++;
+            }
+
+            if (index != _processes.end()) {
+                processes.push_back(*index);
+                index->Statm = -1;
+                index->Rollup = -1;
+                index->Children = -1;
+            }
+            else {
+                string base(_T("/proc/") + Core::NumberType<uint32_t>(pid).Text());
+                Process process;
+
+                process.Id = pid;
+                process.Statm = ::open((base + _T("/statm")).c_str(), O_RDONLY | O_CLOEXEC);
+                process.Rollup = ::open((base + _T("/smaps_rollup")).c_str(), O_RDONLY | O_CLOEXEC);
+                process.Children = (_cgroupProcs != -1 ? -1 : ::open((base + _T("/task/") + Core::NumberType<uint32_t>(pid).Text() + _T("/children")).c_str(), O_RDONLY | O_CLOEXEC));
+
+                if (process.Statm != -1) {
+                    processes.push_back(process);
+                }
+                else {
+                    // The process is gone already.
+                    Close(process.Rollup);
+                    Close(process.Children);
+                }
+            }
+        }
+        void Adopt(std::vector<Process>& processes)
+        {
+            char* current = _buffer;
+            uint32_t pid;
+
+            while (((pid = static_cast<uint32_t>(::strtoul(current, &current, 10))) != 0) && (processes.size() < MaxProcesses)) {
+                if (pid != _main) {
+                    Adopt(pid, processes);
+                }
+            }
+        }
+        void Refresh()
+        {
+            std::vector<Process> processes;
+
+            // The plugin process always goes first, if it is gone, so is the plugin.
+            Adopt(_main, processes);
+
+            if (processes.size() != 0) {
+                if (_cgroupProcs != -1) {
+                    Read(_cgroupProcs);
+                    Adopt(processes);
+                }
+                else {
+                    for (uint16_t index = 0; index < processes.size(); index++) {
+                        if (processes[index].Children != -1) {
+                            Read(processes[index].Children);
+                            Adopt(processes);
+                        }
+                    }
+                }
+            }
+
+            // Whatever was not adopted is gone.
+            Close(_processes);
+            _processes.swap(processes);
+        }
+
+    private:
+        const uint32_t _main;
+        const uint64_t _pageSize;
+        std::vector<Process> _processes;
+        int _memoryStat;
+        int _cgroupProcs;
+        uint64_t _allocated;
+        uint64_t _resident;
+        uint64_t _shared;
+        char _buffer[BufferSize];
+    };
+#else
+    // There is no /proc to take the measurements from, all plugins are measured through IMemory.
+    class ProcessSampler {
+    private:
+        ProcessSampler() = delete;
+        ProcessSampler(const ProcessSampler&) = delete;
+        ProcessSampler& operator=(const ProcessSampler&) = delete;
+
+    public:
+        ProcessSampler(const uint32_t pid)
+            : _main(pid)
+        {
+        }
+        ~ProcessSampler()
+        {
+        }
+
+    public:
+        static uint32_t Find(const string&)
+        {
+            return (0);
+        }
+        inline uint32_t Id() const
+        {
+            return (_main);
+        }
+        inline uint64_t Allocated() const
+        {
+            return (0);
+        }
+        inline uint64_t Resident() const
+        {
+            return (0);
+        }
+        inline uint64_t Shared() const
+        {
+            return (0);
+        }
+        inline uint8_t Processes() const
+        {
+            return (0);
+        }
+        bool Sample()
+        {
+            return (false);
+        }
+
+    private:
+        const uint32_t _main;
+    };
+#endif
+}
+}
+
+#endif // __MONITOR_PROCESSSAMPLER_H
@@ -0,0 +1,163 @@
+#ifndef __MONITOR_TIMERWHEEL_H
+#define __MONITOR_TIMERWHEEL_H
+
+#include "Module.h"
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Two level hierarchical timer wheel. Level 0 has a bucket per slot, for the next SLOTS slots, level 1
+    // has a bucket per SLOTS slots, for the next SLOTS * SLOTS slots. Anything further away is parked in an
+    // overflow list. Whenever level 0 wraps, the level 1 bucket of the new round is spread over level 0.
+    // Elements are never reported before their time, at most one slot (resolution) late.
+    template <typename ELEMENT, const uint16_t SLOTS = 256>
+    class TimerWheelType {
+    private:
+        TimerWheelType() = delete;
+        TimerWheelType(const TimerWheelType<ELEMENT, SLOTS>&) = delete;
+        TimerWheelType<ELEMENT, SLOTS>& operator=(const TimerWheelType<ELEMENT, SLOTS>&) = delete;
+
+        typedef std::pair<uint64_t, ELEMENT*> Entry;
+        typedef std::vector<Entry> Bucket;
+
+    public:
+        TimerWheelType(const uint64_t resolution)
+            : _resolution(resolution)
+            , _current(0)
+            , _count(0)
+            , _overflow()
+        {
+        }
+        ~TimerWheelType()
+        {
+        }
+
+    public:
+        inline uint32_t Count() const
+        {
+            return (_count);
+        }
+        void Clear(const uint64_t now)
+        {
+            for (uint16_t index = 0; index < SLOTS; index++) {
+                _level0[index].clear();
+                _level1[index].clear();
+            }
+            _overflow.clear();
+            _current = now / _resolution;
+            _count = 0;
+        }
+        void Insert(const uint64_t time, ELEMENT* element)
+        {
+            // Round up, so an element is never reported before its time.
+            uint64_t slot = (time + _resolution - 1) / _resolution;
+
+            Place(slot > _current ? slot : _current + 1, element);
+            _count++;
+        }
+        // Move all elements that are due at the given time to the expired list.
+        void Expired(const uint64_t now, std::vector<ELEMENT*>& expired)
+        {
+            uint64_t target = now / _resolution;
+
+            while ((_current < target) && (_count != 0)) {
+                _current++;
+
+                uint16_t index = static_cast<uint16_t>(_current % SLOTS);
+
+                if (index == 0) {
+                    Cascade();
+                }
+
+                Bucket& bucket(_level0[index]);
+
+                for (typename Bucket::const_iterator entry(bucket.begin()); entry != bucket.end(); entry++) {
+                    ASSERT(entry->first == _current);
+                    expired.push_back(entry->second);
+                }
+                _count -= static_cast<uint32_t>(bucket.size());
+                bucket.clear();
+            }
+
+            if (_count == 0) {
+                _current = (target > _current ? target : _current);
+            }
+        }
+        // Time of the next moment something might be due, ~0 if the wheel is empty.
+        uint64_t Next() const
+        {
+            uint64_t result = static_cast<uint64_t>(~0);
+
+            if (_count != 0) {
+                uint64_t slot = _current + 1;
+                uint64_t boundary = ((_current / SLOTS) + 1) * SLOTS;
+
+                while ((slot < boundary) && (_level0[slot % SLOTS].empty() == true)) {
+                    slot++;
+                }
+
+                // If level 0 is empty, wake up to spread the next round.
+                result = slot * _resolution;
+            }
+
+            return (result);
+        }
+
+    private:
+        void Place(const uint64_t slot, ELEMENT* element)
+        {
+            ASSERT(slot > _current);
+
+            if ((slot - _current) < SLOTS) {
+                _level0[slot % SLOTS].push_back(Entry(slot, element));
+            }
+            else if (((slot / SLOTS) - (_current / SLOTS)) < SLOTS) {
+                _level1[(slot / SLOTS) % SLOTS].push_back(Entry(slot, element));
+            }
+            else {
+                _overflow.push_back(Entry(slot, element));
+            }
+        }
+        void Cascade()
+        {
+            uint64_t round = _current / SLOTS;
+            Bucket moving;
+
+            moving.swap(_level1[round % SLOTS]);
+
+            // Whatever was too far away might fit in the wheel now.
+            typename Bucket::iterator index(_overflow.begin());
+
+            while (index != _overflow.end()) {
+                if (((index->first / SLOTS) - round) < SLOTS) {
+                    moving.push_back(*index);
+                    index = _overflow.erase(index);
+                }
+                else {
+                    index++;
+                }
+            }
+
+            for (typename Bucket::const_iterator entry(moving.begin()); entry != moving.end(); entry++) {
+                // Elements of this round are due at or after the current slot.
+                if (entry->first == _current) {
+                    _level0[_current % SLOTS].push_back(*entry);
+                }
+                else {
+                    Place(entry->first, entry->second);
+                }
+            }
+        }
+
+    private:
+        const uint64_t _resolution;
+        uint64_t _current;
+        uint32_t _count;
+        Bucket _level0[SLOTS];
+        Bucket _level1[SLOTS];
+        Bucket _overflow;
+    };
+}
+}
+
+#endif // __MONITOR_TIMERWHEEL_H
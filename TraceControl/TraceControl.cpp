@@ -1,5 +1,6 @@
 #include "TraceControl.h"
 #include "TraceOutput.h"
+#include "TraceFile.h"
 
 namespace WPEFramework {
 
@@ -39,19 +40,53 @@ namespace Plugin {
         _skipURL = static_cast<uint8_t>(_service->WebPrefix().length());
 
         if (((service->Background() == false) && (_config.Console.IsSet() == false) && (_config.SysLog.IsSet() == false)) || ((_config.Console.IsSet() == true) && (_config.Console.Value() == true))) {
-			_outputs.push_back(new Plugin::TraceOutput(false));
+			_outputs.push_back(new Plugin::TraceOutput(false, _config.Queue.Value()));
 
         }
         if (((service->Background() == true) && (_config.Console.IsSet() == false) && (_config.SysLog.IsSet() == false)) || ((_config.SysLog.IsSet() == true) && (_config.SysLog.Value() == true))) {
-			_outputs.push_back(new Plugin::TraceOutput(true));
+			_outputs.push_back(new Plugin::TraceOutput(true, _config.Queue.Value()));
 
         }
         if (_config.Remote.IsSet() == true) {
             Core::NodeId logNode(_config.Remote.Binding.Value().c_str(), _config.Remote.Port.Value());
 
-			_outputs.push_back(new Trace::TraceMedia(logNode));
+			_outputs.push_back(new Plugin::RemoteOutput(logNode, _config.Queue.Value()));
 
         }
+        if (_config.File.IsSet() == true) {
+            string fileName(_config.File.Name.Value());
+
+            // Relative names are stored in the persistent location of this plugin.
+            if ((fileName.empty() == false) && (fileName[0] != '/')) {
+                Core::Directory(_service->PersistentPath().c_str()).CreatePath();
+
+                fileName = _service->PersistentPath() + fileName;
+            }
+
+#ifndef __WIN32__
+			_outputs.push_back(new Plugin::TraceFile(fileName, _config.File.Size.Value() * 1024, _config.File.Count.Value(), _config.Queue.Value()));
+#else
+			TRACE_L1("Trace files are not supported on this platform, %s is not written.", fileName.c_str());
+#endif
+        }
+
+		Core::JSON::ArrayType<Config::Limit>::Iterator limit(_config.Limits.Elements());
+
+		while (limit.Next() == true)
+		{
+			_limits.Limit(
+				limit.Current().Module.Value(),
+				limit.Current().Category.Value(),
+				TraceLimits::Rule(limit.Current().Rate.Value(), limit.Current().Burst.Value(), limit.Current().Sample.Value()));
+		}
+
+		std::list<TraceSink*>::iterator index(_outputs.begin());
+
+		while (index != _outputs.end())
+		{
+			(*index)->Run();
+			index++;
+		}
 
 		_service->Register(&_observer);
 
@@ -73,6 +108,9 @@ namespace Plugin {
 
 		while (_outputs.size() != 0)
 		{
+			// Write out whatever is still queued, before the output is gone.
+			_outputs.front()->Terminate();
+
 			delete _outputs.front();
 
 			_outputs.pop_front();
@@ -94,6 +132,8 @@ namespace Plugin {
     // <PUT> ../[on,off]
     // <PUT> ../<ModuleName>/[on,off]
     // <PUT> ../<ModuleName>/<CategoryName>/[on,off]
+    // <PUT> ../<ModuleName>/limit?rate=<entries/s>&burst=<entries>&sample=<N>
+    // <PUT> ../<ModuleName>/<CategoryName>/limit?rate=<entries/s>&burst=<entries>&sample=<N>
     /* virtual */ Core::ProxyType<Web::Response> TraceControl::Process(const Web::Request& request)
     {
         ASSERT(_skipURL <= request.Path.length());
@@ -124,11 +164,26 @@ namespace Plugin {
 				while (categories.Next())
 				{
 					string categoryName(Core::ToString(categories.Category()));
+					Data::Trace setting(moduleName, categoryName, categories.State());
+					TraceLimits::Statistics info;
+
+					if (_limits.Get(moduleName, categoryName, info) == true)
+					{
+						setting.Limits(info);
+					}
 
-					response->Settings.Add(Data::Trace(moduleName, categoryName, categories.State()));
+					response->Settings.Add(setting);
 				}
             }
 
+			std::list<TraceSink*>::const_iterator output(_outputs.begin());
+
+			while (output != _outputs.end())
+			{
+				response->Outputs.Add(Data::Output((*output)->Name(), (*output)->Delivered(), (*output)->Dropped()));
+				output++;
+			}
+
             result->Body(Core::proxy_cast<Web::IBody>(response));
             result->ContentType = Web::MIME_JSON;
         }
@@ -162,11 +217,18 @@ namespace Plugin {
                                     (moduleName.length() != 0 ? moduleName : std::string(EMPTY_STRING)),
                                     (categoryName.length() != 0 ? categoryName : std::string(EMPTY_STRING)));
                             }
+                            else if (index.Current() == _T("limit")) {
+                                Limit(moduleName, categoryName, request);
+                            }
                             else {
                                 result->ErrorCode = Web::STATUS_BAD_REQUEST;
-                                result->Message = _T(" could not handle your request, last parameter should be [on,off].");
+                                result->Message = _T(" could not handle your request, last parameter should be [on,off,limit].");
                             }
                         }
+                        else if (categoryName == _T("limit")) {
+                            // Limit all categories of this module, that have no limit of their own.
+                            Limit(moduleName, std::string(EMPTY_STRING), request);
+                        }
                         else {
                             result->ErrorCode = Web::STATUS_BAD_REQUEST;
                             result->Message = _T(" could not handle your request, last parameter should be the category.");
@@ -193,14 +255,54 @@ namespace Plugin {
     }
 
 
+	void TraceControl::Limit(const string& module, const string& category, const Web::Request& request)
+	{
+		TraceLimits::Rule rule;
+
+		// No options, means no limits.
+		if (request.Query.IsSet() == true)
+		{
+			Core::URL::KeyValue options(request.Query.Value());
+
+			Core::NumberType<uint32_t> rate(options.Number<uint32_t>(_T("rate"), 0));
+			Core::NumberType<uint32_t> burst(options.Number<uint32_t>(_T("burst"), 0));
+			Core::NumberType<uint32_t> sample(options.Number<uint32_t>(_T("sample"), 0));
+
+			rule = TraceLimits::Rule(rate.Value(), burst.Value(), sample.Value());
+		}
+
+		_limits.Limit(module, category, rule);
+	}
+
 	void TraceControl::Dispatch(Observer::Source& information)
 	{
-		std::list<Trace::ITraceMedia*>::iterator index(_outputs.begin());
-		InformationWrapper wrapper(information);
+		// Categories above their rate, or not in the sample, are suppressed here.
+		if (_limits.Pass(information.Module(), information.Category(), information.Timestamp()) == true)
+		{
+			std::list<TraceSink*>::iterator index(_outputs.begin());
+
+			// Only copy the entry, the outputs format and write it on their own thread.
+			while (index != _outputs.end())
+			{
+				TraceEntry* entry = (*index)->Reserve();
+
+				if (entry != nullptr)
+				{
+					information.Copy(*entry);
+					(*index)->Publish();
+				}
+				index++;
+			}
+		}
+	}
+
+	void TraceControl::Signal()
+	{
+		std::list<TraceSink*>::iterator index(_outputs.begin());
 
 		while (index != _outputs.end())
 		{
-			(*index)->Output(information.FileName(), information.LineNumber(), information.ClassName(), &wrapper);
+			(*index)->Signal();
 			index++;
 		}
 	}
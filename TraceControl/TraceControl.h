@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Module.h"
+#include "TraceLimit.h"
+#include "TraceSink.h"
 
 namespace WPEFramework {
 	namespace Plugin {
@@ -291,6 +293,10 @@ namespace WPEFramework {
 					inline uint16_t Length () const {
 						return (_length);
 					}
+					inline void Copy(TraceEntry& entry) const
+					{
+						entry.Load(_traceBuffer, _module, _category, _classname, _information, _length);
+					}
 					void Flush()
 					{
 						_state = EMPTY;
@@ -563,6 +569,11 @@ namespace WPEFramework {
 					: Thread(Core::Thread::DefaultStackSize(), _T("TraceWorker"))
 					, _doorBell(Trace::TraceUnit::Instance().TraceAnnouncement())
 					, _buffers()
+					, _retired()
+					, _generation(1)
+					, _synchronized(0)
+					, _idle()
+					, _heap()
 					, _parent(parent)
 					, _refcount(0)
 				{
@@ -590,6 +601,16 @@ namespace WPEFramework {
 						_buffers.erase(_buffers.begin());
 					}
 
+					while (_retired.size() != 0) {
+						delete _retired.front();
+
+						_retired.pop_front();
+					}
+
+					_idle.clear();
+					_heap.clear();
+					_generation++;
+
 					_adminLock.Unlock();
 				}
 				virtual void Activated(RPC::IRemoteProcess* process)
@@ -600,8 +621,12 @@ namespace WPEFramework {
 
 					// By definition, get the buffer file from WPEFramework (local source)
 					_buffers.insert(std::pair<const uint32_t, Source*>(process->Id(), new Source(process)));
+					_generation++;
 
 					_adminLock.Unlock();
+
+					// Let the worker pick up the new source.
+					_doorBell.Ring();
 				}
 				virtual void Deactivated(RPC::IRemoteProcess* process)
 				{
@@ -611,11 +636,16 @@ namespace WPEFramework {
 
 					if (index != _buffers.end())
 					{
-						delete (index->second);
+						// The worker might be draining this source right now, it is deleted by
+						// the worker once it has synchronized with the new membership.
+						_retired.push_back(index->second);
 						_buffers.erase(index);
+						_generation++;
 					}
 
 					_adminLock.Unlock();
+
+					_doorBell.Ring();
 				}
 
 				void Set(const bool enabled, const std::string& module, const std::string& category)
@@ -686,115 +716,151 @@ namespace WPEFramework {
 						// Before we start we reset the flag, if new info is coming in, we will get a retrigger flag.
 						_doorBell.Acknowledge();
 
-						Source* selected;
-
-						uint64_t timeStamp;
-
 						do
 						{
-							selected = nullptr;
-
-							_adminLock.Lock();
-
-							timeStamp = static_cast<uint64_t>(~0);
-
-							std::map<const uint32_t, Source*>::iterator index(_buffers.begin());
-
-							while (index != _buffers.end()) {
+							// Processes came or went, this is the only moment the merge needs the admin lock.
+							// Checked once per batch, so a process that keeps on tracing does not hold it off.
+							if (_synchronized != _generation)
+							{
+								Synchronize();
+							}
 
-								Source::state state(index->second->Load());
+							// Sources that had nothing to offer might have something now, the ones that
+							// have an entry loaded are already in the heap, ordered by their timestamp.
+							Poll();
 
-								if (state == Source::LOADED)
-								{
-									if (index->second->Timestamp() < timeStamp)
-									{
-										timeStamp = index->second->Timestamp();
+							uint16_t batch = DrainBatch;
 
-										if (state == Source::LOADED)
-										{
-											selected = index->second;
-										}
-									}
-								}
-								else if (state == Source::FAILURE)
-								{
-									// Oops this requires recovery, so let's flush
-									index->second->Flush();
-								}
+							while ((IsRunning() == true) && (_heap.size() != 0) && (batch-- != 0))
+							{
+								std::pop_heap(_heap.begin(), _heap.end(), Later());
 
-								index++;
-							}
+								Source* selected = _heap.back().second;
 
-							if (selected != nullptr)
-							{
-								
+								_heap.pop_back();
 
 								// Oke, output this entry
 								_parent.Dispatch(*selected);
 
 								// Ready to load a new one..
 								selected->Clear();
-							} 
-							else if (timeStamp != static_cast<uint64_t>(~0)) {
-								// Looks like we are waiting for a message to be completed.
-								// Give up our slice, so the producer, can produce.
-								::SleepMs(0);
-							}
 
-							_adminLock.Unlock();
+								Schedule(*selected);
+							}
 
-						} while ((IsRunning() == true) && (timeStamp != static_cast<uint64_t>(~0)));
+							// Wake up the outputs once per batch, not for every entry.
+							_parent.Signal();
 
+						} while ((IsRunning() == true) && (_heap.size() != 0));
 					}
 
 					return (Core::infinite);
 				}
 
 			private:
-				Core::CriticalSection _adminLock;
-				Core::DoorBell& _doorBell;
-				std::map<const uint32_t, Source*> _buffers;
-				TraceControl& _parent;
-				mutable uint32_t _refcount;
-			};
+				// Number of entries merged before the idle sources are polled again, this bounds the
+				// time a newly filled buffer has to wait if another process keeps on producing.
+				static constexpr uint16_t DrainBatch = 64;
 
-			class InformationWrapper : public Trace::ITrace
-			{
-			private:
-				InformationWrapper() = delete;
-				InformationWrapper(const InformationWrapper& copy) = delete;
-				InformationWrapper& operator= (const InformationWrapper&) = delete;
+				typedef std::pair<uint64_t, Source*> HeapEntry;
 
-			public:
-				InformationWrapper(const TraceControl::Observer::Source& information)
-					: _info(information)
+				struct Later
 				{
-				}
-				~InformationWrapper()
+					inline bool operator()(const HeapEntry& lhs, const HeapEntry& rhs) const
+					{
+						return (lhs.first > rhs.first);
+					}
+				};
+
+				void Synchronize()
 				{
-				}
+					_adminLock.Lock();
 
+					_heap.clear();
+					_idle.clear();
 
-			public:
-				virtual const char* Category() const
-				{
-					return (_info.Category());
-				}
-				virtual const char* Module() const
-				{
-					return (_info.Module());
+					std::map<const uint32_t, Source*>::iterator index(_buffers.begin());
+
+					while (index != _buffers.end())
+					{
+						// Entries already loaded are not lost, the next Poll finds them again.
+						_idle.push_back(index->second);
+						index++;
+					}
+
+					while (_retired.size() != 0)
+					{
+						delete _retired.front();
+
+						_retired.pop_front();
+					}
+
+					_synchronized = _generation;
+
+					_adminLock.Unlock();
 				}
-				virtual const char* Data() const
+				void Poll()
 				{
-					return (_info.Information());
+					uint32_t index = 0;
+
+					while (index < _idle.size())
+					{
+						Source* source(_idle[index]);
+						Source::state state(source->Load());
+
+						if (state == Source::LOADED)
+						{
+							_heap.push_back(HeapEntry(source->Timestamp(), source));
+							std::push_heap(_heap.begin(), _heap.end(), Later());
+
+							_idle[index] = _idle.back();
+							_idle.pop_back();
+						}
+						else
+						{
+							if (state == Source::FAILURE)
+							{
+								// Oops this requires recovery, so let's flush
+								source->Flush();
+							}
+							index++;
+						}
+					}
 				}
-				virtual uint16_t Length() const
+				void Schedule(Source& source)
 				{
-					return (_info.Length());
+					Source::state state(source.Load());
+
+					if (state == Source::LOADED)
+					{
+						_heap.push_back(HeapEntry(source.Timestamp(), &source));
+						std::push_heap(_heap.begin(), _heap.end(), Later());
+					}
+					else
+					{
+						if (state == Source::FAILURE)
+						{
+							// Oops this requires recovery, so let's flush
+							source.Flush();
+						}
+						_idle.push_back(&source);
+					}
 				}
 
 			private:
-				const TraceControl::Observer::Source& _info;
+				Core::CriticalSection _adminLock;
+				Core::DoorBell& _doorBell;
+				std::map<const uint32_t, Source*> _buffers;
+				std::list<Source*> _retired;
+				volatile uint32_t _generation;
+				uint32_t _synchronized;
+
+				// Only touched by the worker thread.
+				std::vector<Source*> _idle;
+				std::vector<HeapEntry> _heap;
+
+				TraceControl& _parent;
+				mutable uint32_t _refcount;
 			};
 
 		public:
@@ -832,6 +898,98 @@ namespace WPEFramework {
 				Core::JSON::DecUInt16 Port;
 				Core::JSON::String Binding;
 			};
+			class FileNode : public Core::JSON::Container {
+			public:
+				FileNode()
+					: Core::JSON::Container()
+					, Name(_T("trace"))
+					, Size(1024)
+					, Count(4)
+				{
+					Add(_T("name"), &Name);
+					Add(_T("size"), &Size);
+					Add(_T("count"), &Count);
+				}
+				FileNode(const FileNode& copy)
+					: Core::JSON::Container()
+					, Name(copy.Name)
+					, Size(copy.Size)
+					, Count(copy.Count)
+				{
+					Add(_T("name"), &Name);
+					Add(_T("size"), &Size);
+					Add(_T("count"), &Count);
+				}
+				~FileNode()
+				{
+				}
+
+				FileNode& operator=(const FileNode& RHS)
+				{
+					Name = RHS.Name;
+					Size = RHS.Size;
+					Count = RHS.Count;
+
+					return (*this);
+				}
+
+			public:
+				Core::JSON::String Name;
+				Core::JSON::DecUInt32 Size; // In KB, per file
+				Core::JSON::DecUInt8 Count;
+			};
+			class Limit : public Core::JSON::Container {
+			public:
+				Limit()
+					: Core::JSON::Container()
+					, Module()
+					, Category()
+					, Rate(0)
+					, Burst(0)
+					, Sample(0)
+				{
+					Add(_T("module"), &Module);
+					Add(_T("category"), &Category);
+					Add(_T("rate"), &Rate);
+					Add(_T("burst"), &Burst);
+					Add(_T("sample"), &Sample);
+				}
+				Limit(const Limit& copy)
+					: Core::JSON::Container()
+					, Module(copy.Module)
+					, Category(copy.Category)
+					, Rate(copy.Rate)
+					, Burst(copy.Burst)
+					, Sample(copy.Sample)
+				{
+					Add(_T("module"), &Module);
+					Add(_T("category"), &Category);
+					Add(_T("rate"), &Rate);
+					Add(_T("burst"), &Burst);
+					Add(_T("sample"), &Sample);
+				}
+				~Limit()
+				{
+				}
+
+				Limit& operator=(const Limit& RHS)
+				{
+					Module = RHS.Module;
+					Category = RHS.Category;
+					Rate = RHS.Rate;
+					Burst = RHS.Burst;
+					Sample = RHS.Sample;
+
+					return (*this);
+				}
+
+			public:
+				Core::JSON::String Module;
+				Core::JSON::String Category; // Not set, all categories of the module
+				Core::JSON::DecUInt32 Rate; // Entries per second, 0 is unlimited
+				Core::JSON::DecUInt32 Burst;
+				Core::JSON::DecUInt32 Sample; // Pass 1 in N entries
+			};
 			class Config : public Core::JSON::Container {
 			private:
 				Config(const Config&);
@@ -843,10 +1001,16 @@ namespace WPEFramework {
 					, Console(false)
 					, SysLog(true)
 					, Remote()
+					, File()
+					, Queue(128)
+					, Limits()
 				{
 					Add(_T("console"), &Console);
 					Add(_T("syslog"), &SysLog);
 					Add(_T("remote"), &Remote);
+					Add(_T("file"), &File);
+					Add(_T("queue"), &Queue);
+					Add(_T("limits"), &Limits);
 				}
 				~Config()
 				{
@@ -856,6 +1020,9 @@ namespace WPEFramework {
 				Core::JSON::Boolean Console;
 				Core::JSON::Boolean SysLog;
 				NetworkNode Remote;
+				FileNode File;
+				Core::JSON::DecUInt16 Queue;
+				Core::JSON::ArrayType<Limit> Limits;
 			};
 			class Data : public Core::JSON::Container {
 			public:
@@ -870,6 +1037,11 @@ namespace WPEFramework {
 						Add(_T("module"), &Module);
 						Add(_T("category"), &Category);
 						Add(_T("state"), &State);
+						Add(_T("rate"), &Rate);
+						Add(_T("burst"), &Burst);
+						Add(_T("sample"), &Sample);
+						Add(_T("passed"), &Passed);
+						Add(_T("suppressed"), &Suppressed);
 					}
 					Trace(const string& moduleName, const string& categoryName, const state currentState)
 						: Core::JSON::Container()
@@ -877,6 +1049,11 @@ namespace WPEFramework {
 						Add(_T("module"), &Module);
 						Add(_T("category"), &Category);
 						Add(_T("state"), &State);
+						Add(_T("rate"), &Rate);
+						Add(_T("burst"), &Burst);
+						Add(_T("sample"), &Sample);
+						Add(_T("passed"), &Passed);
+						Add(_T("suppressed"), &Suppressed);
 
 						Module = moduleName;
 						Category = categoryName;
@@ -887,19 +1064,86 @@ namespace WPEFramework {
 						, Module(copy.Module)
 						, Category(copy.Category)
 						, State(copy.State)
+						, Rate(copy.Rate)
+						, Burst(copy.Burst)
+						, Sample(copy.Sample)
+						, Passed(copy.Passed)
+						, Suppressed(copy.Suppressed)
 					{
 						Add(_T("module"), &Module);
 						Add(_T("category"), &Category);
 						Add(_T("state"), &State);
+						Add(_T("rate"), &Rate);
+						Add(_T("burst"), &Burst);
+						Add(_T("sample"), &Sample);
+						Add(_T("passed"), &Passed);
+						Add(_T("suppressed"), &Suppressed);
 					}
 					~Trace()
 					{
 					}
 
+				public:
+					inline void Limits(const TraceLimits::Statistics& info)
+					{
+						Rate = info.Limit.Rate;
+						Burst = info.Limit.Burst;
+						Sample = info.Limit.Sample;
+						Passed = info.Passed;
+						Suppressed = info.Suppressed;
+					}
+
 				public:
 					Core::JSON::String Module;
 					Core::JSON::String Category;
 					Core::JSON::EnumType<state> State;
+					Core::JSON::DecUInt32 Rate;
+					Core::JSON::DecUInt32 Burst;
+					Core::JSON::DecUInt32 Sample;
+					Core::JSON::DecUInt32 Passed;
+					Core::JSON::DecUInt32 Suppressed;
+				};
+				class Output : public Core::JSON::Container {
+				private:
+					Output& operator=(const Output&);
+
+				public:
+					Output()
+						: Core::JSON::Container()
+					{
+						Add(_T("name"), &Name);
+						Add(_T("delivered"), &Delivered);
+						Add(_T("dropped"), &Dropped);
+					}
+					Output(const string& name, const uint32_t delivered, const uint32_t dropped)
+						: Core::JSON::Container()
+					{
+						Add(_T("name"), &Name);
+						Add(_T("delivered"), &Delivered);
+						Add(_T("dropped"), &Dropped);
+
+						Name = name;
+						Delivered = delivered;
+						Dropped = dropped;
+					}
+					Output(const Output& copy)
+						: Core::JSON::Container()
+						, Name(copy.Name)
+						, Delivered(copy.Delivered)
+						, Dropped(copy.Dropped)
+					{
+						Add(_T("name"), &Name);
+						Add(_T("delivered"), &Delivered);
+						Add(_T("dropped"), &Dropped);
+					}
+					~Output()
+					{
+					}
+
+				public:
+					Core::JSON::String Name;
+					Core::JSON::DecUInt32 Delivered;
+					Core::JSON::DecUInt32 Dropped;
 				};
 
 			private:
@@ -913,6 +1157,7 @@ namespace WPEFramework {
 					Add(_T("console"), &Console);
 					Add(_T("remote"), &Remote);
 					Add(_T("settings"), &Settings);
+					Add(_T("outputs"), &Outputs);
 				}
 				~Data()
 				{
@@ -922,6 +1167,7 @@ namespace WPEFramework {
 				Core::JSON::Boolean Console;
 				NetworkNode Remote;
 				Core::JSON::ArrayType<Trace> Settings;
+				Core::JSON::ArrayType<Output> Outputs;
 			};
 
 		public:
@@ -932,6 +1178,7 @@ namespace WPEFramework {
 				: _skipURL(0)
 				, _service(nullptr)
 				, _outputs()
+				, _limits()
 				, _observer(*this)
 			{
 			}
@@ -982,13 +1229,16 @@ namespace WPEFramework {
 			virtual Core::ProxyType<Web::Response> Process(const Web::Request& request);
 
 		private:
+			void Limit(const string& module, const string& category, const Web::Request& request);
 			void Dispatch(Observer::Source& information);
+			void Signal();
 
 		private:
 			uint8_t _skipURL;
 			PluginHost::IShell* _service;
 			Config _config;
-			std::list<Trace::ITraceMedia*> _outputs;
+			std::list<TraceSink*> _outputs;
+			TraceLimits _limits;
 			Observer _observer;
 		};
 	}
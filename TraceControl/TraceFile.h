@@ -0,0 +1,233 @@
+#pragma once
+
+#include "Module.h"
+#include "TraceFormat.h"
+#include "TraceSink.h"
+
+#ifndef __WIN32__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <unordered_map>
+
+namespace WPEFramework {
+namespace Plugin {
+
+#ifndef __WIN32__
+
+    // Writes the entries, unformatted, to size capped binary files: <name>.0 is the file being written,
+    // <name>.1 up to <name>.<count - 1> are the older ones. Use tracedecode to turn them into text.
+    class TraceFile : public TraceSink {
+    private:
+        TraceFile() = delete;
+        TraceFile(const TraceFile&) = delete;
+        TraceFile& operator=(const TraceFile&) = delete;
+
+        typedef std::unordered_map<string, uint16_t> StringMap;
+
+        // Worst case an entry interns 4 new strings, next to the entry itself.
+        static constexpr uint32_t EntrySize = (TraceFormat::EntryHeaderSize + TraceEntry::MaxSize) + (4 * (TraceFormat::StringHeaderSize + TraceEntry::MaxSize));
+        static constexpr uint32_t BufferSize = 64 * 1024;
+
+    public:
+        TraceFile(const string& fileName, const uint32_t maxSize, const uint8_t count, const uint16_t slots)
+            : TraceSink(_T("file"), slots)
+            , _fileName(fileName)
+            , _maxSize(maxSize)
+            , _count(count == 0 ? 1 : count)
+            , _handle(-1)
+            , _written(0)
+            , _strings()
+            , _added()
+            , _key()
+            , _used(0)
+            , _buffer(new uint8_t[BufferSize])
+        {
+            Open();
+        }
+        virtual ~TraceFile()
+        {
+            Close();
+
+            delete[] _buffer;
+        }
+
+    protected:
+        virtual void Output(const TraceEntry* entries[], const uint16_t count)
+        {
+            for (uint16_t index = 0; index < count; index++) {
+                const TraceEntry& entry(*(entries[index]));
+
+                if ((_used + EntrySize) > BufferSize) {
+                    Flush();
+                }
+
+                const uint32_t used = _used;
+                const uint32_t added = static_cast<uint32_t>(_added.size());
+
+                Add(entry);
+
+                // If it does not fit in this file anymore, take it back and start the next file with it. A file
+                // that holds nothing but the header gets it anyway.
+                if (((_written + _used) > _maxSize) && ((_written + used) > TraceFormat::HeaderSize)) {
+                    _used = used;
+                    Rollback(added);
+                    Flush();
+                    Rotate();
+                    Add(entry);
+                }
+            }
+
+            Flush();
+        }
+
+    private:
+        void Add(const TraceEntry& entry)
+        {
+            uint16_t file = Intern(entry.FileName());
+            uint16_t module = Intern(entry.Module());
+            uint16_t category = Intern(entry.Category());
+            uint16_t classname = Intern(entry.ClassName());
+            uint16_t length = entry.Length();
+            uint64_t ticks = entry.Timestamp();
+            uint32_t line = entry.LineNumber();
+
+            _buffer[_used++] = TraceFormat::ENTRY;
+            Append(&length, sizeof(length));
+            Append(&ticks, sizeof(ticks));
+            Append(&line, sizeof(line));
+            Append(&file, sizeof(file));
+            Append(&module, sizeof(module));
+            Append(&category, sizeof(category));
+            Append(&classname, sizeof(classname));
+            Append(entry.Information(), length);
+        }
+        inline void Append(const void* data, const uint16_t length)
+        {
+            ASSERT((_used + length) <= BufferSize);
+
+            ::memcpy(&(_buffer[_used]), data, length);
+            _used += length;
+        }
+        uint16_t Intern(const char text[])
+        {
+            uint16_t result;
+
+            // The key is reused so looking up an already known string does not allocate.
+            _key.assign(text);
+
+            StringMap::const_iterator index(_strings.find(_key));
+
+            if (index != _strings.end()) {
+                result = index->second;
+            }
+            else {
+                uint16_t length = static_cast<uint16_t>(_key.length());
+
+                result = static_cast<uint16_t>(_strings.size());
+                _strings.insert(std::pair<string, uint16_t>(_key, result));
+                _added.push_back(_key);
+
+                _buffer[_used++] = TraceFormat::STRING;
+                Append(&result, sizeof(result));
+                Append(&length, sizeof(length));
+                Append(_key.c_str(), length);
+            }
+
+            return (result);
+        }
+        // Forgets the strings interned after the given number of them, their records never made it to the file.
+        void Rollback(const uint32_t added)
+        {
+            while (_added.size() > added) {
+                _strings.erase(_added.back());
+                _added.pop_back();
+            }
+        }
+        void Flush()
+        {
+            if ((_handle != -1) && (_used != 0)) {
+                uint32_t offset = 0;
+
+                while (offset < _used) {
+                    ssize_t written = ::write(_handle, &(_buffer[offset]), _used - offset);
+
+                    if (written > 0) {
+                        offset += static_cast<uint32_t>(written);
+                    }
+                    else if ((written == 0) || (errno != EINTR)) {
+                        break;
+                    }
+                }
+
+                if (offset == _used) {
+                    _written += _used;
+                }
+                else {
+                    TRACE_L1("Could not write to trace file %s, error %d", _fileName.c_str(), errno);
+
+                    // Drop the buffer, cut off what did make it (a torn record) and forget the strings defined
+                    // in it, so the records that follow only use strings that are in the file.
+                    if ((offset != 0) && ((::ftruncate(_handle, _written) != 0) || (::lseek(_handle, _written, SEEK_SET) == -1))) {
+                        Close();
+                    }
+                    Rollback(0);
+                }
+            }
+            _added.clear();
+            _used = 0;
+        }
+        void Open()
+        {
+            _handle = ::open((_fileName + _T(".0")).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            _written = 0;
+            _strings.clear();
+            _added.clear();
+
+            if (_handle == -1) {
+                TRACE_L1("Could not create trace file %s, error %d", _fileName.c_str(), errno);
+            }
+            else {
+                Append(TraceFormat::Magic, sizeof(TraceFormat::Magic));
+                Append(&TraceFormat::Version, sizeof(TraceFormat::Version));
+                Append(&TraceFormat::ByteOrder, sizeof(TraceFormat::ByteOrder));
+                Flush();
+            }
+        }
+        void Close()
+        {
+            if (_handle != -1) {
+                ::close(_handle);
+                _handle = -1;
+            }
+        }
+        void Rotate()
+        {
+            Close();
+
+            // Shift all files one up, the oldest one is overwritten.
+            for (uint8_t index = _count - 1; index > 0; index--) {
+                string from(_fileName + '.' + Core::NumberType<uint8_t>(index - 1).Text());
+                string to(_fileName + '.' + Core::NumberType<uint8_t>(index).Text());
+
+                ::rename(from.c_str(), to.c_str());
+            }
+
+            Open();
+        }
+
+    private:
+        const string _fileName;
+        const uint32_t _maxSize;
+        const uint8_t _count;
+        int _handle;
+        uint32_t _written;
+        StringMap _strings;
+        std::vector<string> _added; //!< Strings interned since the last flush, in order.
+        string _key;
+        uint32_t _used;
+        uint8_t* _buffer;
+    };
+#endif
+}
+}
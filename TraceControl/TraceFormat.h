@@ -0,0 +1,35 @@
+#pragma once
+
+// Layout of the binary trace files written by the TraceControl file output. This header is shared with
+// the tracedecode tool, so it should not depend on anything from the framework.
+//
+// A file starts with a Header, followed by records. Every record starts with a one byte type:
+//   STRING: uint16 id, uint16 length, length characters (no terminator)
+//   ENTRY : uint16 length, uint64 clock ticks, uint32 line number, uint16 file/module/category/className id,
+//           length bytes of information
+// All file, module, category and class names are interned, the STRING record defining an id is always
+// written before the first ENTRY using it. Every file is self contained, ids start over after a rotation.
+// Values are written in the byte order of the device, the ByteOrder field allows the reader to detect that.
+
+#include <stdint.h>
+
+namespace WPEFramework {
+namespace Plugin {
+namespace TraceFormat {
+
+    static constexpr char Magic[4] = { 'W', 'T', 'R', 'C' };
+    static constexpr uint16_t Version = 1;
+    static constexpr uint16_t ByteOrder = 0x0102;
+
+    enum record : uint8_t {
+        STRING = 'S',
+        ENTRY = 'E'
+    };
+
+    static constexpr uint16_t HeaderSize = sizeof(Magic) + sizeof(uint16_t) + sizeof(uint16_t);
+    static constexpr uint16_t StringHeaderSize = 1 + sizeof(uint16_t) + sizeof(uint16_t);
+    static constexpr uint16_t EntryHeaderSize = 1 + sizeof(uint16_t) + sizeof(uint64_t) + sizeof(uint32_t) + (4 * sizeof(uint16_t));
+
+}
+}
+}
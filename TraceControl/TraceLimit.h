@@ -0,0 +1,325 @@
+#pragma once
+
+#include "Module.h"
+
+#include <atomic>
+#include <unordered_map>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Keeps a chatty module/category from flooding the outputs. Per module/category a 1-in-N sample ratio
+    // and a token bucket (rate entries per second, with a burst) can be set. A rule without a category
+    // applies to all categories of the module that do not have a rule of their own.
+    // The bucket is filled based on the timestamps of the entries, so no clock is read per entry.
+    // As long as no rule is set, entries pass without taking the lock or looking anything up.
+    class TraceLimits {
+    private:
+        TraceLimits(const TraceLimits&) = delete;
+        TraceLimits& operator=(const TraceLimits&) = delete;
+
+        static constexpr uint64_t TicksPerSecond = 1000 * 1000;
+
+    public:
+        class Rule {
+        public:
+            Rule()
+                : Rate(0)
+                , Burst(0)
+                , Sample(0)
+            {
+            }
+            Rule(const uint32_t rate, const uint32_t burst, const uint32_t sample)
+                : Rate(rate)
+                , Burst(burst)
+                , Sample(sample)
+            {
+            }
+            Rule(const Rule& copy)
+                : Rate(copy.Rate)
+                , Burst(copy.Burst)
+                , Sample(copy.Sample)
+            {
+            }
+            ~Rule()
+            {
+            }
+
+            Rule& operator=(const Rule& rhs)
+            {
+                Rate = rhs.Rate;
+                Burst = rhs.Burst;
+                Sample = rhs.Sample;
+
+                return (*this);
+            }
+
+        public:
+            inline bool IsLimited() const
+            {
+                return ((Rate != 0) || (Sample > 1));
+            }
+
+        public:
+            uint32_t Rate;
+            uint32_t Burst;
+            uint32_t Sample;
+        };
+        class Statistics {
+        public:
+            Statistics()
+                : Limit()
+                , Passed(0)
+                , Suppressed(0)
+            {
+            }
+            ~Statistics()
+            {
+            }
+
+        public:
+            Rule Limit;
+            uint32_t Passed;
+            uint32_t Suppressed;
+        };
+
+    private:
+        class Bucket {
+        public:
+            Bucket()
+                : _rule()
+                , _tokens(0)
+                , _last(0)
+                , _counter(0)
+                , _passed(0)
+                , _suppressed(0)
+            {
+            }
+            Bucket(const Rule& rule)
+                : _rule()
+                , _tokens(0)
+                , _last(0)
+                , _counter(0)
+                , _passed(0)
+                , _suppressed(0)
+            {
+                Limit(rule);
+            }
+            Bucket(const Bucket& copy)
+                : _rule(copy._rule)
+                , _tokens(copy._tokens)
+                , _last(copy._last)
+                , _counter(copy._counter)
+                , _passed(copy._passed)
+                , _suppressed(copy._suppressed)
+            {
+            }
+            ~Bucket()
+            {
+            }
+
+        public:
+            inline const Rule& Limit() const
+            {
+                return (_rule);
+            }
+            void Limit(const Rule& rule)
+            {
+                _rule = rule;
+
+                // Start with a full bucket.
+                _tokens = Capacity();
+                _last = 0;
+                _counter = 0;
+            }
+            inline uint32_t Passed() const
+            {
+                return (_passed);
+            }
+            inline uint32_t Suppressed() const
+            {
+                return (_suppressed);
+            }
+            bool Pass(const uint64_t timestamp)
+            {
+                bool result = true;
+
+                if (_rule.Sample > 1) {
+                    result = ((_counter++ % _rule.Sample) == 0);
+                }
+
+                if ((result == true) && (_rule.Rate != 0)) {
+                    // Tokens are kept in millionths, so the refill is exact for every rate.
+                    if (timestamp > _last) {
+                        if (_last != 0) {
+                            uint64_t elapsed = timestamp - _last;
+                            uint64_t capacity = Capacity();
+
+                            if (elapsed >= (capacity / _rule.Rate)) {
+                                _tokens = capacity;
+                            }
+                            else {
+                                _tokens = std::min(capacity, _tokens + (elapsed * _rule.Rate));
+                            }
+                        }
+                        _last = timestamp;
+                    }
+
+                    if (_tokens >= TicksPerSecond) {
+                        _tokens -= TicksPerSecond;
+                    }
+                    else {
+                        result = false;
+                    }
+                }
+
+                if (result == true) {
+                    _passed++;
+                }
+                else {
+                    _suppressed++;
+                }
+
+                return (result);
+            }
+
+        private:
+            inline uint64_t Capacity() const
+            {
+                return (static_cast<uint64_t>(_rule.Burst == 0 ? 1 : _rule.Burst) * TicksPerSecond);
+            }
+
+        private:
+            Rule _rule;
+            uint64_t _tokens;
+            uint64_t _last;
+            uint32_t _counter;
+            uint32_t _passed;
+            uint32_t _suppressed;
+        };
+
+        typedef std::map<string, Rule> RuleMap;
+        typedef std::unordered_map<string, Bucket> BucketMap;
+
+    public:
+        TraceLimits()
+            : _adminLock()
+            , _limited(false)
+            , _rules()
+            , _buckets()
+            , _key()
+        {
+        }
+        ~TraceLimits()
+        {
+        }
+
+    public:
+        // A rule that does not limit anything removes the rule.
+        void Limit(const string& module, const string& category, const Rule& rule)
+        {
+            _adminLock.Lock();
+
+            string key(Key(module, category));
+
+            if (rule.IsLimited() == true) {
+                _rules[key] = rule;
+            }
+            else {
+                _rules.erase(key);
+            }
+
+            // Buckets already in use that the rule applies to pick it up, their counters are kept. A rule for
+            // the whole module applies to the categories of the module that have no rule of their own.
+            BucketMap::iterator index(_buckets.begin());
+
+            while (index != _buckets.end()) {
+                size_t split = index->first.find('/');
+
+                if ((index->first.compare(0, split, module) == 0) && (split == module.length()) &&
+                    ((category.empty() == true ? (_rules.find(index->first) == _rules.end()) : (index->first == key)))) {
+                    index->second.Limit(Resolve(module, index->first.substr(split + 1)));
+                }
+                index++;
+            }
+
+            _limited.store(_rules.empty() == false, std::memory_order_release);
+
+            _adminLock.Unlock();
+        }
+        bool Get(const string& module, const string& category, Statistics& info) const
+        {
+            bool result = false;
+
+            _adminLock.Lock();
+
+            BucketMap::const_iterator index(_buckets.find(Key(module, category)));
+
+            if (index != _buckets.end()) {
+                info.Limit = index->second.Limit();
+                info.Passed = index->second.Passed();
+                info.Suppressed = index->second.Suppressed();
+                result = true;
+            }
+            else {
+                info.Limit = Resolve(module, category);
+                result = info.Limit.IsLimited();
+            }
+
+            _adminLock.Unlock();
+
+            return (result);
+        }
+
+        // Called from the observer thread, for every entry.
+        bool Pass(const char module[], const char category[], const uint64_t timestamp)
+        {
+            bool result = true;
+
+            if (_limited.load(std::memory_order_acquire) == true) {
+                _adminLock.Lock();
+
+                // The key is reused, so for a known category this does not allocate.
+                _key.assign(module);
+                _key += '/';
+                _key.append(category);
+
+                BucketMap::iterator index(_buckets.find(_key));
+
+                if (index == _buckets.end()) {
+                    index = _buckets.insert(std::pair<string, Bucket>(_key, Bucket(Resolve(module, category)))).first;
+                }
+
+                result = index->second.Pass(timestamp);
+
+                _adminLock.Unlock();
+            }
+
+            return (result);
+        }
+
+    private:
+        inline static string Key(const string& module, const string& category)
+        {
+            return (module + '/' + category);
+        }
+        Rule Resolve(const string& module, const string& category) const
+        {
+            RuleMap::const_iterator index(_rules.find(Key(module, category)));
+
+            if (index == _rules.end()) {
+                index = _rules.find(Key(module, EMPTY_STRING));
+            }
+
+            return (index != _rules.end() ? index->second : Rule());
+        }
+
+    private:
+        mutable Core::CriticalSection _adminLock;
+        std::atomic<bool> _limited; //!< Any rule set at all.
+        RuleMap _rules;
+        BucketMap _buckets;
+        string _key;
+    };
+}
+}
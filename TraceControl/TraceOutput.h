@@ -1,46 +1,213 @@
 #pragma once
 
 #include "Module.h"
+#include "TraceSink.h"
 
 #ifndef __WIN32__
 #include <syslog.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #endif
 
 namespace WPEFramework {
 namespace Plugin {
 
-    class TraceOutput : public Trace::ITraceMedia {
+    class TraceOutput : public TraceSink {
     private:
+    TraceOutput() = delete;
     TraceOutput(const TraceOutput&) = delete;
     TraceOutput& operator= (const TraceOutput&) = delete;
 
+    static constexpr uint16_t PrefixSize = 256;
+    static constexpr uint16_t MessageSize = 4096;
+    static constexpr uint64_t TicksPerSecond = 1000 * 1000;
+
     public:
-        TraceOutput(const bool syslogging)
-            : _syslogging(syslogging)
+        TraceOutput(const bool syslogging, const uint16_t slots)
+            : TraceSink(syslogging ? _T("syslog") : _T("console"), slots)
+            , _syslogging(syslogging)
+            , _second(~0)
+            , _time()
         {
     }
         virtual ~TraceOutput()
         {
     }
 
-    public:
-        virtual void Output(const char fileName[], const uint32_t lineNumber, const char className[], const Trace::ITrace* information)
+    protected:
+        virtual void Output(const TraceEntry* entries[], const uint16_t count)
         {
-        // Time to printf...
-            string time(Core::Time::Now().ToRFC1123(true));
-
 #ifndef __WIN32__
         if (_syslogging == true) {
-            syslog (LOG_NOTICE, "[%s]:[%s:%d]:[%s] %s: %s\n",time.c_str(), Core::FileNameOnly(fileName), lineNumber, Core::ClassNameOnly(className).Data(), information->Category(), information->Data());
-        } else
+            // One syslog call per batch, lines are only split over multiple messages if they do not fit.
+            uint16_t used = 0;
+
+            for (uint16_t index = 0; index < count; index++) {
+                uint16_t length = Prefix(*(entries[index]), _prefix[0]);
+
+                if ((used != 0) && ((used + length + entries[index]->Length() + 1) >= MessageSize)) {
+                    syslog (LOG_NOTICE, "%s", _message);
+                    used = 0;
+                }
+
+                int written = snprintf(&(_message[used]), MessageSize - used, "%s%s\n", _prefix[0], entries[index]->Information());
+                used += (written < 0 ? 0 : std::min(static_cast<uint16_t>(written), static_cast<uint16_t>(MessageSize - used - 1)));
+            }
+
+            if (used != 0) {
+                syslog (LOG_NOTICE, "%s", _message);
+            }
+        } else {
+            // Prefix, information and line feed per entry, the whole batch is written in one go.
+            static const char lineFeed = '\n';
+            uint16_t vectors = 0;
+
+            for (uint16_t index = 0; index < count; index++) {
+                _vectors[vectors].iov_base = _prefix[index];
+                _vectors[vectors].iov_len = Prefix(*(entries[index]), _prefix[index]);
+                vectors++;
+                _vectors[vectors].iov_base = const_cast<char*>(entries[index]->Information());
+                _vectors[vectors].iov_len = entries[index]->Length();
+                vectors++;
+                _vectors[vectors].iov_base = const_cast<char*>(&lineFeed);
+                _vectors[vectors].iov_len = 1;
+                vectors++;
+            }
+
+            // stdout might be shared with printf users, make sure their data goes first.
+            fflush(stdout);
+            Write(_vectors, vectors);
+        }
+#else
+        for (uint16_t index = 0; index < count; index++) {
+            Prefix(*(entries[index]), _prefix[0]);
+            printf ("%s%s\n", _prefix[0], entries[index]->Information());
+        }
 #endif
+    }
+
+    private:
+#ifndef __WIN32__
+        // A pipe or a terminal may take less than the whole batch, continue where it stopped, so no
+        // entry is lost or torn. If stdout is gone, there is nobody to report that to.
+        static void Write(struct iovec vectors[], uint16_t count)
         {
-            printf ("[%s]:[%s:%d]:[%s] %s: %s\n",time.c_str(), Core::FileNameOnly(fileName), lineNumber, Core::ClassNameOnly(className).Data(), information->Category(), information->Data());
+            while (count > 0) {
+                ssize_t written = ::writev(STDOUT_FILENO, vectors, count);
+
+                if (written < 0) {
+                    if (errno != EINTR) {
+                        break;
+                    }
+                } else {
+                    size_t left = static_cast<size_t>(written);
+
+                    while ((count > 0) && (left >= vectors->iov_len)) {
+                        left -= vectors->iov_len;
+                        vectors++;
+                        count--;
+                    }
+                    if (count > 0) {
+                        vectors->iov_base = static_cast<char*>(vectors->iov_base) + left;
+                        vectors->iov_len -= left;
+                    }
+                }
+            }
+        }
+#endif
+        uint16_t Prefix(const TraceEntry& entry, char buffer[])
+        {
+            uint64_t second = entry.Timestamp() / TicksPerSecond;
+
+            // Formatting the time is expensive, and it only changes once a second..
+            if (second != _second) {
+                _second = second;
+                _time = Core::Time(entry.Timestamp()).ToRFC1123(true);
+            }
+
+            int length = snprintf (buffer, PrefixSize, "[%s]:[%s:%d]:[%s] %s: ",_time.c_str(), Core::FileNameOnly(entry.FileName()), entry.LineNumber(), Core::ClassNameOnly(entry.ClassName()).Data(), entry.Category());
+
+            return (length < 0 ? 0 : std::min(static_cast<uint16_t>(length), static_cast<uint16_t>(PrefixSize - 1)));
         }
-    }
 
     private:
     bool _syslogging;
+    uint64_t _second;
+    string _time;
+    char _prefix[BatchSize][PrefixSize];
+#ifndef __WIN32__
+    char _message[MessageSize];
+    struct iovec _vectors[BatchSize * 3];
+#endif
+    };
+
+    // The TraceMedia sends the entries over UDP, it has no batch interface, but it is no longer
+    // called on the observer thread.
+    class RemoteOutput : public TraceSink {
+    private:
+        RemoteOutput() = delete;
+        RemoteOutput(const RemoteOutput&) = delete;
+        RemoteOutput& operator= (const RemoteOutput&) = delete;
+
+        class EntryWrapper : public Trace::ITrace {
+        private:
+            EntryWrapper() = delete;
+            EntryWrapper(const EntryWrapper&) = delete;
+            EntryWrapper& operator= (const EntryWrapper&) = delete;
+
+        public:
+            EntryWrapper(const TraceEntry& entry)
+                : _entry(entry)
+            {
+            }
+            ~EntryWrapper()
+            {
+            }
+
+        public:
+            virtual const char* Category() const
+            {
+                return (_entry.Category());
+            }
+            virtual const char* Module() const
+            {
+                return (_entry.Module());
+            }
+            virtual const char* Data() const
+            {
+                return (_entry.Information());
+            }
+            virtual uint16_t Length() const
+            {
+                return (_entry.Length());
+            }
+
+        private:
+            const TraceEntry& _entry;
+        };
+
+    public:
+        RemoteOutput(const Core::NodeId& node, const uint16_t slots)
+            : TraceSink(_T("remote"), slots)
+            , _media(node)
+        {
+        }
+        virtual ~RemoteOutput()
+        {
+        }
+
+    protected:
+        virtual void Output(const TraceEntry* entries[], const uint16_t count)
+        {
+            for (uint16_t index = 0; index < count; index++) {
+                EntryWrapper wrapper(*(entries[index]));
+
+                _media.Output(entries[index]->FileName(), entries[index]->LineNumber(), entries[index]->ClassName(), &wrapper);
+            }
+        }
+
+    private:
+        Trace::TraceMedia _media;
     };
 }
 }
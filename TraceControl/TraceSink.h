@@ -0,0 +1,233 @@
+#pragma once
+
+#include "Module.h"
+
+#include <atomic>
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // A copy of a single trace entry, as it was read from the cyclic buffer of a process. The layout of
+    // the raw buffer is the one written by the TraceUnit:
+    // length(2 bytes) - clock ticks (8 bytes) - line number (4 bytes) - file/module/category/className - information
+    class TraceEntry {
+    private:
+        TraceEntry(const TraceEntry&) = delete;
+        TraceEntry& operator=(const TraceEntry&) = delete;
+
+    public:
+        static constexpr uint16_t MaxSize = 1030;
+
+    public:
+        TraceEntry()
+            : _module(0)
+            , _category(0)
+            , _classname(0)
+            , _information(0)
+            , _length(0)
+        {
+            _buffer[0] = '\0';
+        }
+        ~TraceEntry()
+        {
+        }
+
+    public:
+        inline void Load(const uint8_t buffer[], const uint16_t module, const uint16_t category, const uint16_t classname, const uint16_t information, const uint16_t length)
+        {
+            uint16_t size = information + length;
+
+            ASSERT(size <= MaxSize);
+
+            ::memcpy(_buffer, buffer, size);
+            _buffer[size] = '\0';
+
+            _module = module;
+            _category = category;
+            _classname = classname;
+            _information = information;
+            _length = length;
+        }
+        inline uint64_t Timestamp() const
+        {
+            uint64_t stamp; ::memcpy(&stamp, &(_buffer[2]), sizeof(uint64_t));
+            return (stamp);
+        }
+        inline uint32_t LineNumber() const
+        {
+            uint32_t linenumber; ::memcpy(&linenumber, &(_buffer[10]), sizeof(uint32_t));
+            return (linenumber);
+        }
+        inline const char* FileName() const
+        {
+            return reinterpret_cast<const char*>(&_buffer[14]);
+        }
+        inline const char* Module() const
+        {
+            return reinterpret_cast<const char*>(&_buffer[_module]);
+        }
+        inline const char* Category() const
+        {
+            return reinterpret_cast<const char*>(&_buffer[_category]);
+        }
+        inline const char* ClassName() const
+        {
+            return reinterpret_cast<const char*>(&_buffer[_classname]);
+        }
+        inline const char* Information() const
+        {
+            return reinterpret_cast<const char*>(&_buffer[_information]);
+        }
+        inline uint16_t Length() const
+        {
+            return (_length);
+        }
+
+    private:
+        uint16_t _module;
+        uint16_t _category;
+        uint16_t _classname;
+        uint16_t _information;
+        uint16_t _length;
+        uint8_t _buffer[MaxSize + 1];
+    };
+
+    // Base for all trace outputs. The observer thread hands over entries through a preallocated
+    // single producer/single consumer ring, the sink drains that ring on its own thread in batches.
+    // If the sink can not keep up, entries are dropped (and counted) in stead of stalling the observer.
+    class TraceSink : public Core::Thread {
+    private:
+        TraceSink() = delete;
+        TraceSink(const TraceSink&) = delete;
+        TraceSink& operator=(const TraceSink&) = delete;
+
+    public:
+        static constexpr uint16_t BatchSize = 64;
+
+    public:
+        TraceSink(const string& name, const uint16_t slots)
+            : Core::Thread(Core::Thread::DefaultStackSize(), _T("TraceSink"))
+            , _name(name)
+            , _slots(Capacity(slots))
+            , _mask(Capacity(slots) - 1)
+            , _head(0)
+            , _tail(0)
+            , _delivered(0)
+            , _dropped(0)
+            , _signal(false, true)
+        {
+        }
+        virtual ~TraceSink()
+        {
+            ASSERT((Core::Thread::State() == Core::Thread::STOPPED) || (Core::Thread::State() == Core::Thread::INITIALIZED));
+        }
+
+    public:
+        inline const string& Name() const
+        {
+            return (_name);
+        }
+        inline uint32_t Delivered() const
+        {
+            return (_delivered.load(std::memory_order_relaxed));
+        }
+        inline uint32_t Dropped() const
+        {
+            return (_dropped.load(std::memory_order_relaxed));
+        }
+
+        // Producer side, only to be called from the observer thread. Reserve a slot, if there is
+        // one, fill it and Publish it. Signal wakes the sink, once per merged batch is sufficient.
+        inline TraceEntry* Reserve()
+        {
+            TraceEntry* result = nullptr;
+            uint32_t head = _head.load(std::memory_order_relaxed);
+
+            if ((head - _tail.load(std::memory_order_acquire)) < _slots.size()) {
+                result = &(_slots[head & _mask]);
+            }
+            else {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            return (result);
+        }
+        inline void Publish()
+        {
+            _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+        inline void Signal()
+        {
+            _signal.SetEvent();
+        }
+
+        // Stop the sink thread, whatever is still in the ring is written out first.
+        void Terminate()
+        {
+            Core::Thread::Stop();
+
+            _signal.SetEvent();
+
+            Core::Thread::Wait(Core::Thread::STOPPED, Core::infinite);
+        }
+
+    protected:
+        virtual void Output(const TraceEntry* entries[], const uint16_t count) = 0;
+
+    private:
+        static uint32_t Capacity(const uint16_t slots)
+        {
+            uint32_t result = 1;
+
+            while (result < slots) {
+                result <<= 1;
+            }
+            return (result);
+        }
+
+        virtual uint32_t Worker()
+        {
+            if (_signal.Lock(Core::infinite) == Core::ERROR_NONE) {
+                // Reset before draining, anything published from now on signals again.
+                _signal.ResetEvent();
+
+                Drain();
+            }
+
+            return (0);
+        }
+        void Drain()
+        {
+            uint32_t tail = _tail.load(std::memory_order_relaxed);
+            uint32_t head = _head.load(std::memory_order_acquire);
+
+            while (tail != head) {
+                uint16_t count = 0;
+
+                while ((tail != head) && (count < BatchSize)) {
+                    _batch[count++] = &(_slots[tail & _mask]);
+                    tail++;
+                }
+
+                Output(_batch, count);
+
+                // Only now the slots can be reused by the producer.
+                _tail.store(tail, std::memory_order_release);
+                _delivered.fetch_add(count, std::memory_order_relaxed);
+
+                head = _head.load(std::memory_order_acquire);
+            }
+        }
+
+    private:
+        const string _name;
+        std::vector<TraceEntry> _slots;
+        const uint32_t _mask;
+        std::atomic<uint32_t> _head;
+        std::atomic<uint32_t> _tail;
+        std::atomic<uint32_t> _delivered;
+        std::atomic<uint32_t> _dropped;
+        Core::Event _signal;
+        const TraceEntry* _batch[BatchSize];
+    };
+}
+}
@@ -0,0 +1,256 @@
+// tracedecode, turns the binary files written by the TraceControl file output into text.
+// It only depends on TraceFormat.h, so it can be build for the host, without the framework.
+//
+// usage: tracedecode [-m module] [-c category] [-g text] [-f from] [-t till] file...
+//   -m, -c  only show entries of this module/category
+//   -g      only show entries containing this text
+//   -f, -t  only show entries in this time range, in seconds since the epoch
+
+#include "../TraceFormat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+using namespace WPEFramework::Plugin;
+
+namespace {
+
+    struct Filter {
+        Filter()
+            : Module()
+            , Category()
+            , Text()
+            , From(0)
+            , Till(~0)
+        {
+        }
+
+        std::string Module;
+        std::string Category;
+        std::string Text;
+        uint64_t From;
+        uint64_t Till;
+    };
+
+    class Reader {
+    private:
+        Reader() = delete;
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+    public:
+        Reader(FILE* file)
+            : _file(file)
+            , _swap(false)
+        {
+        }
+        ~Reader()
+        {
+        }
+
+    public:
+        inline void Swap(const bool swap)
+        {
+            _swap = swap;
+        }
+        bool Read(void* buffer, const size_t length)
+        {
+            return (fread(buffer, 1, length, _file) == length);
+        }
+        template <typename TYPE>
+        bool Read(TYPE& value)
+        {
+            bool result = Read(&value, sizeof(TYPE));
+
+            if ((result == true) && (_swap == true)) {
+                uint8_t* bytes = reinterpret_cast<uint8_t*>(&value);
+
+                for (size_t index = 0; index < (sizeof(TYPE) / 2); index++) {
+                    uint8_t keep = bytes[index];
+                    bytes[index] = bytes[sizeof(TYPE) - 1 - index];
+                    bytes[sizeof(TYPE) - 1 - index] = keep;
+                }
+            }
+            return (result);
+        }
+
+    private:
+        FILE* _file;
+        bool _swap;
+    };
+
+    const char* FileNameOnly(const char fileName[])
+    {
+        const char* result = strrchr(fileName, '/');
+
+        return (result == nullptr ? fileName : result + 1);
+    }
+
+    std::string ClassNameOnly(const std::string& className)
+    {
+        // Strip the namespaces, keep the class name (and its template arguments).
+        size_t end = className.find('<');
+        size_t begin = className.rfind("::", end);
+
+        return (begin == std::string::npos ? className : className.substr(begin + 2));
+    }
+
+    bool Decode(const char fileName[], const Filter& filter)
+    {
+        FILE* file = fopen(fileName, "rb");
+
+        if (file == nullptr) {
+            fprintf(stderr, "tracedecode: could not open %s\n", fileName);
+            return (false);
+        }
+
+        Reader reader(file);
+        char magic[sizeof(TraceFormat::Magic)];
+        uint16_t version;
+        uint16_t byteOrder;
+        bool result = false;
+
+        if ((reader.Read(magic, sizeof(magic)) == false) || (memcmp(magic, TraceFormat::Magic, sizeof(magic)) != 0) || (reader.Read(version) == false) || (reader.Read(byteOrder) == false)) {
+            fprintf(stderr, "tracedecode: %s is not a trace file\n", fileName);
+        }
+        else {
+            if (byteOrder != TraceFormat::ByteOrder) {
+                reader.Swap(true);
+                version = static_cast<uint16_t>((version >> 8) | (version << 8));
+            }
+
+            if (version != TraceFormat::Version) {
+                fprintf(stderr, "tracedecode: %s has unsupported version %d\n", fileName, version);
+            }
+            else {
+                std::vector<std::string> strings;
+                std::vector<char> information;
+                uint8_t type;
+
+                result = true;
+
+                while ((result == true) && (reader.Read(type) == true)) {
+                    if (type == TraceFormat::STRING) {
+                        uint16_t id, length;
+
+                        result = (reader.Read(id) && reader.Read(length));
+
+                        if (result == true) {
+                            std::string text(length, '\0');
+
+                            result = ((length == 0) || (reader.Read(&text[0], length)));
+
+                            if (id >= strings.size()) {
+                                strings.resize(id + 1);
+                            }
+                            strings[id] = text;
+                        }
+                    }
+                    else if (type == TraceFormat::ENTRY) {
+                        uint16_t length, file, module, category, className;
+                        uint64_t ticks;
+                        uint32_t line;
+
+                        result = (reader.Read(length) && reader.Read(ticks) && reader.Read(line) && reader.Read(file) && reader.Read(module) && reader.Read(category) && reader.Read(className));
+
+                        if (result == true) {
+                            information.resize(length + 1);
+                            result = ((length == 0) || (reader.Read(information.data(), length)));
+                            information[length] = '\0';
+                        }
+
+                        if ((result == true) && ((file >= strings.size()) || (module >= strings.size()) || (category >= strings.size()) || (className >= strings.size()))) {
+                            fprintf(stderr, "tracedecode: %s refers to an undefined string\n", fileName);
+                            result = false;
+                        }
+
+                        // Ticks are in microseconds.
+                        uint64_t seconds = ticks / (1000 * 1000);
+
+                        if ((result == true) && (seconds >= filter.From) && (seconds <= filter.Till) && ((filter.Module.empty() == true) || (filter.Module == strings[module])) && ((filter.Category.empty() == true) || (filter.Category == strings[category])) && ((filter.Text.empty() == true) || (strstr(information.data(), filter.Text.c_str()) != nullptr))) {
+
+                            char timeText[64];
+                            time_t stamp = static_cast<time_t>(seconds);
+                            struct tm moment;
+
+                            gmtime_r(&stamp, &moment);
+                            strftime(timeText, sizeof(timeText), "%a, %d %b %Y %H:%M:%S", &moment);
+
+                            printf("[%s.%03u]:[%s:%u]:[%s] %s: %s\n",
+                                timeText,
+                                static_cast<uint32_t>((ticks / 1000) % 1000),
+                                FileNameOnly(strings[file].c_str()),
+                                line,
+                                ClassNameOnly(strings[className]).c_str(),
+                                strings[category].c_str(),
+                                information.data());
+                        }
+                    }
+                    else {
+                        fprintf(stderr, "tracedecode: %s has an unknown record type %d\n", fileName, type);
+                        result = false;
+                    }
+                }
+
+                if (result == false) {
+                    fprintf(stderr, "tracedecode: %s is truncated or corrupt\n", fileName);
+                }
+            }
+        }
+
+        fclose(file);
+
+        return (result);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Filter filter;
+    int option;
+
+    while ((option = getopt(argc, argv, "m:c:g:f:t:h")) != -1) {
+        switch (option) {
+        case 'm':
+            filter.Module = optarg;
+            break;
+        case 'c':
+            filter.Category = optarg;
+            break;
+        case 'g':
+            filter.Text = optarg;
+            break;
+        case 'f':
+            filter.From = strtoull(optarg, nullptr, 10);
+            break;
+        case 't':
+            filter.Till = strtoull(optarg, nullptr, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-m module] [-c category] [-g text] [-f from] [-t till] file...\n", argv[0]);
+            return (option == 'h' ? 0 : 1);
+        }
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-m module] [-c category] [-g text] [-f from] [-t till] file...\n", argv[0]);
+        return (1);
+    }
+
+    int result = 0;
+
+    // Pass the oldest file first (trace.3 trace.2 trace.1 trace.0) to get the entries in order.
+    for (int index = optind; index < argc; index++) {
+        if (Decode(argv[index], filter) == false) {
+            result = 1;
+        }
+    }
+
+    return (result);
+}
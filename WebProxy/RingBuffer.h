@@ -0,0 +1,102 @@
+#ifndef __PLUGINWEBPROXY_RINGBUFFER_H
+#define __PLUGINWEBPROXY_RINGBUFFER_H
+
+#include "Module.h"
+
+#include <atomic>
+
+namespace WPEFramework {
+	namespace Plugin {
+
+		// A ring for exactly one producer and one consumer, each running on a thread of its own, without a lock.
+		// Only the producer moves the head and only the consumer moves the tail. Data is copied in and out with
+		// (at most) two memcpy's, one for each side of the wrap. The size is rounded up to a power of two.
+		class RingBuffer {
+		private:
+			RingBuffer() = delete;
+			RingBuffer(const RingBuffer&) = delete;
+			RingBuffer& operator=(const RingBuffer&) = delete;
+
+		public:
+			RingBuffer(const uint32_t size)
+				: _size(RoundUp(size))
+				, _buffer(new uint8_t[_size])
+				, _head(0)
+				, _tail(0)
+			{
+			}
+			~RingBuffer()
+			{
+				delete[] _buffer;
+			}
+
+		public:
+			inline uint32_t Size() const
+			{
+				return (_size);
+			}
+			inline uint32_t Used() const
+			{
+				return (_head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire));
+			}
+			inline bool IsEmpty() const
+			{
+				return (Used() == 0);
+			}
+
+			// Only to be called by the producer, returns what fitted.
+			uint16_t Write(const uint8_t data[], const uint16_t length)
+			{
+				const uint32_t head = _head.load(std::memory_order_relaxed);
+				const uint32_t free = _size - (head - _tail.load(std::memory_order_acquire));
+				const uint32_t result = (length < free ? length : free);
+				const uint32_t offset = (head & (_size - 1));
+				const uint32_t first = (result < (_size - offset) ? result : (_size - offset));
+
+				::memcpy(&(_buffer[offset]), data, first);
+				::memcpy(_buffer, &(data[first]), result - first);
+
+				_head.store(head + result, std::memory_order_release);
+
+				return (static_cast<uint16_t>(result));
+			}
+
+			// Only to be called by the consumer, returns what was read.
+			uint16_t Read(uint8_t data[], const uint16_t length)
+			{
+				const uint32_t tail = _tail.load(std::memory_order_relaxed);
+				const uint32_t used = _head.load(std::memory_order_acquire) - tail;
+				const uint32_t result = (length < used ? length : used);
+				const uint32_t offset = (tail & (_size - 1));
+				const uint32_t first = (result < (_size - offset) ? result : (_size - offset));
+
+				::memcpy(data, &(_buffer[offset]), first);
+				::memcpy(&(data[first]), _buffer, result - first);
+
+				_tail.store(tail + result, std::memory_order_release);
+
+				return (static_cast<uint16_t>(result));
+			}
+
+		private:
+			static uint32_t RoundUp(const uint32_t size)
+			{
+				uint32_t result = 1;
+
+				while ((result < size) && (result < 0x80000000)) {
+					result <<= 1;
+				}
+
+				return (result);
+			}
+
+		private:
+			const uint32_t _size;
+			uint8_t* _buffer;
+			std::atomic<uint32_t> _head; //!< Written up to here, only moved by the producer.
+			std::atomic<uint32_t> _tail; //!< Read up to here, only moved by the consumer.
+		};
+	}
+}
+
+#endif // __PLUGINWEBPROXY_RINGBUFFER_H
@@ -1,5 +1,9 @@
 #include "WebProxy.h"
 
+#ifndef __WIN32__
+#include <termios.h>
+#endif
+
 namespace WPEFramework {
 
 ENUM_CONVERSION_BEGIN(Plugin::WebProxy::Config::Link::enumType)
@@ -44,6 +48,10 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 			{
 				return (_parent.StateChange());
 			}
+			inline void Throttle(const bool) const
+			{
+				// Nothing to do, once the ring is full, the link stops reading and TCP closes the window.
+			}
 
 		private:
 			WebProxy::Connector& _parent;
@@ -91,12 +99,16 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 
 			virtual uint16_t ReceiveData(uint8_t* dataFrame, const uint16_t receivedSize)
 			{
-				return (_parent.ReceiveData(dataFrame, receivedSize));
+				return (_parent.ReceiveDatagram(dataFrame, receivedSize));
 			}
 			virtual void StateChange()
 			{
 				return (_parent.StateChange());
 			}
+			inline void Throttle(const bool) const
+			{
+				// Datagrams are never held back.
+			}
 
 		private:
 			WebProxy::Connector& _parent;
@@ -139,6 +151,14 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 			{
 				return (_parent.StateChange());
 			}
+			// Ask the device to stop sending (XOFF). Only devices that do software flow control listen to it,
+			// for the others it is up to the hardware flow control of the port.
+			inline void Throttle(const bool paused) const
+			{
+				#ifndef __WIN32__
+				::tcflow(Core::SerialPort::Descriptor(), (paused == true ? TCIOFF : TCION));
+				#endif
+			}
 
 		private:
 			WebProxy::Connector& _parent;
@@ -156,13 +176,13 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 			#pragma warning( disable : 4355 )
 			#endif
 			inline ConnectorWrapper(PluginHost::Channel& channel, const uint32_t bufferSize)
-				: WebProxy::Connector(channel, &_streamType)
-				, _streamType(*this, bufferSize)
+				: WebProxy::Connector(channel, &_streamType, bufferSize)
+				, _streamType(*this, LinkBufferSize(bufferSize))
 			{
 			}
 			inline ConnectorWrapper(PluginHost::Channel& channel, const uint32_t bufferSize, const Core::NodeId& remoteId)
-				: WebProxy::Connector(channel, &_streamType)
-				, _streamType(*this, bufferSize, remoteId)
+				: WebProxy::Connector(channel, &_streamType, bufferSize)
+				, _streamType(*this, LinkBufferSize(bufferSize), remoteId)
 			{
 			}
 			inline ConnectorWrapper(
@@ -173,8 +193,8 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 				const Core::SerialPort::Parity parityE,
 				const Core::SerialPort::DataBits dataBits,
 				const Core::SerialPort::StopBits stopBits)
-				: WebProxy::Connector(channel, &_streamType)
-				, _streamType(*this, bufferSize, deviceName, baudrate, parityE, dataBits, stopBits)
+				: WebProxy::Connector(channel, &_streamType, bufferSize)
+				, _streamType(*this, LinkBufferSize(bufferSize), deviceName, baudrate, parityE, dataBits, stopBits)
 			{
 			}
 			#ifdef __WIN32__ 
@@ -190,6 +210,18 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 				return (_streamType);
 			}
 
+		protected:
+			virtual void Throttle(const bool paused) const
+			{
+				_streamType.Throttle(paused);
+			}
+
+		private:
+			static uint32_t LinkBufferSize(const uint32_t bufferSize)
+			{
+				return (bufferSize < WebProxy::Connector::MaxLinkBufferSize ? bufferSize : WebProxy::Connector::MaxLinkBufferSize);
+			}
+
 		private:
 			STREAMTYPE _streamType;
 		};
@@ -234,6 +266,8 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 			bool added = false;
 			Core::NodeId nodeId;
 
+			_adminLock.Lock();
+
 			// First do a cleanup of all "completely" closed channels.
 			std::map<const uint32_t, Connector*>::iterator connection(_connectionMap.begin());
 
@@ -260,23 +294,55 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 							}
 					}
 
+				_adminLock.Unlock();
+
 				return (added);
 			}
 
 			/* virtual */ void WebProxy::Detach(PluginHost::Channel& channel)
 			{
+				_adminLock.Lock();
+
 				// See if we can forward this info..
 				std::map<const uint32_t, Connector*>::iterator connection = _connectionMap.find(channel.Id());
 
 				if (connection != _connectionMap.end()) {
 					connection->second->Detach();
 				}
+
+				_adminLock.Unlock();
 			}
 
 			/* virtual */ string WebProxy::Information() const
 			{
-				// No additional info to report.
-				return (string());
+				string result;
+				Statistics statistics;
+
+				_adminLock.Lock();
+
+				std::map<const uint32_t, Connector*>::const_iterator index(_connectionMap.begin());
+
+				while (index != _connectionMap.end()) {
+					Statistics::Link link;
+
+					link.Id = index->first;
+					link.Remote = index->second->RemoteId();
+					link.Received = index->second->Received();
+					link.Sent = index->second->Sent();
+					link.Buffered = index->second->Buffered();
+					link.Dropped = index->second->Dropped();
+					link.Stalls = index->second->Stalls();
+					link.Paused = index->second->IsPaused();
+
+					statistics.Links.Add(link);
+					index++;
+				}
+
+				_adminLock.Unlock();
+
+				statistics.ToString(result);
+
+				return (result);
 			}
 
 			// IChannel methods
@@ -287,6 +353,8 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 			{
 				uint32_t result = length;
 
+				_adminLock.Lock();
+
 				// See if we can forward this info..
 				std::map<const uint32_t, Connector*>::iterator connection = _connectionMap.find(ID);
 
@@ -294,6 +362,8 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 					result = connection->second->ChannelReceive(data, length);
 				}
 
+				_adminLock.Unlock();
+
 				return (result);
 			}
 
@@ -303,6 +373,8 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 			{
 				uint32_t result = 0;
 
+				_adminLock.Lock();
+
 				// See if we can forward this info..
 				std::map<const uint32_t, Connector*>::const_iterator connection = _connectionMap.find(ID);
 
@@ -310,6 +382,8 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 					result = connection->second->ChannelSend(data, length);
 				}
 
+				_adminLock.Unlock();
+
 				return (result);
 			}
 
@@ -323,6 +397,7 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 				Core::SerialPort::DataBits dataBits(Core::SerialPort::DataBits::BITS_8);
 				Core::SerialPort::StopBits stopBits(Core::SerialPort::StopBits::BITS_1);
 				const string& options(channel.Query());
+				uint32_t bufferSize(Connector::DefaultBufferSize);
 				bool datagram(false);
 				bool text(false);
 
@@ -345,6 +420,9 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 							else if ((section.Current() == _T("device")) && (section.Next() == true)) {
 								device = section.Current();
 							}
+							else if ((section.Current() == _T("buffersize")) && (section.Next() == true)) {
+								bufferSize = Core::NumberType<uint32_t>(section.Current()).Value();
+							}
 						}
 					}
 				}
@@ -361,6 +439,10 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 						device = Core::TextFragment(linkInfo.Device.Value());
 						datagram = ((linkInfo.Type.IsSet() == true) && (linkInfo.Type.Value() == Config::Link::UDP));
 
+						if (linkInfo.BufferSize.IsSet() == true) {
+							bufferSize = linkInfo.BufferSize.Value();
+						}
+
 						if (linkInfo.Configuration.IsSet() == true) {
 							const Config::Link::Settings& configInfo(linkInfo.Configuration);
 
@@ -372,18 +454,22 @@ ENUM_CONVERSION_END(Core::SerialPort::Parity);
 					}
 				}
 
+				// Not so small it can not hold a single frame, nor so large a bad request eats the memory.
+				bufferSize = std::max(bufferSize, static_cast<uint32_t>(1024));
+				bufferSize = std::min(bufferSize, static_cast<uint32_t>(16 * 1024 * 1024));
+
 				if ((host.Length() > 0) && (device.Length() == 0)) {
 					Core::NodeId remote(host.Text().c_str());
 
 					if (datagram == true) {
-						result = new ConnectorWrapper<DatagramChannel>(channel, 1024, remote);
+						result = new ConnectorWrapper<DatagramChannel>(channel, bufferSize, remote);
 					}
 					else {
-						result = new ConnectorWrapper<StreamChannel>(channel, 1024, remote);
+						result = new ConnectorWrapper<StreamChannel>(channel, bufferSize, remote);
 					}
 				}
 				else if ((device.Length() > 0) && (host.Length() == 0)) {
-					result = new ConnectorWrapper<DeviceChannel>(channel, 1024, device.Text(), baudRate, parity, dataBits, stopBits);
+					result = new ConnectorWrapper<DeviceChannel>(channel, bufferSize, device.Text(), baudRate, parity, dataBits, stopBits);
 				}
 
 				if ((result != nullptr) && (text == true)) {
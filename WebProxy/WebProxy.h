@@ -2,6 +2,7 @@
 #define __PLUGINWEBPROXY_H
 
 #include "Module.h"
+#include "RingBuffer.h"
 
 namespace WPEFramework {
 	namespace Plugin {
@@ -18,12 +19,34 @@ namespace WPEFramework {
 				Connector& operator=(const Connector&) = delete;
 
 			public:
-				Connector(PluginHost::Channel& channel, Core::IStream* link)
+				// Size of the rings between the link and the channel, unless the link is configured otherwise.
+				static constexpr uint32_t DefaultBufferSize = 8 * 1024;
+
+				// The stream callbacks count in 16 bits, the link buffers are kept below that.
+				static constexpr uint32_t MaxLinkBufferSize = 32 * 1024;
+
+				// Percentages of the ring towards the channel. Above the high water mark the sender of the link is
+				// held back, till the channel took enough to get below the low water mark. What the link reads in
+				// the mean time still goes into the ring, the room above the mark is there for that.
+				static constexpr uint8_t HighWaterMark = 75;
+				static constexpr uint8_t LowWaterMark = 25;
+
+			public:
+				Connector(PluginHost::Channel& channel, Core::IStream* link, const uint32_t bufferSize)
 					: _link(link)
 					, _channel(&channel)
 					, _adminLock()
-					, _channelBuffer()
-					, _socketBuffer()
+					, _channelBuffer(bufferSize)
+					, _socketBuffer(bufferSize)
+					, _channelIdle(true)
+					, _socketIdle(true)
+					, _highWater(static_cast<uint32_t>((static_cast<uint64_t>(_channelBuffer.Size()) * HighWaterMark) / 100))
+					, _lowWater(static_cast<uint32_t>((static_cast<uint64_t>(_channelBuffer.Size()) * LowWaterMark) / 100))
+					, _paused(false)
+					, _received(0)
+					, _sent(0)
+					, _dropped(0)
+					, _stalls(0)
 				{
 				}
 				virtual ~Connector()
@@ -52,62 +75,95 @@ namespace WPEFramework {
 				{
 					return ((_channel == nullptr) && (_link->IsClosed()));
 				}
-				// Methods to extract and insert data into the socket buffers
+				inline bool IsPaused() const
+				{
+					return (_paused.load());
+				}
+				// Bytes waiting for the channel to pick them up.
+				inline uint32_t Buffered() const
+				{
+					return (_channelBuffer.Used());
+				}
+				// Bytes from the link to the channel.
+				inline uint64_t Received() const
+				{
+					return (_received.load(std::memory_order_relaxed));
+				}
+				// Bytes from the channel to the link.
+				inline uint64_t Sent() const
+				{
+					return (_sent.load(std::memory_order_relaxed));
+				}
+				// Datagrams that did not fit anymore.
+				inline uint32_t Dropped() const
+				{
+					return (_dropped.load(std::memory_order_relaxed));
+				}
+				// Times the sender of the link was held back.
+				inline uint32_t Stalls() const
+				{
+					return (_stalls.load(std::memory_order_relaxed));
+				}
+				// Methods to extract and insert data into the socket buffers. Each ring has one producer (the thread
+				// of the side the data comes from) and one consumer, so the data itself is moved without a lock.
 				uint16_t SendData(uint8_t* dataFrame, const uint16_t maxSendSize)
 				{
-					_adminLock.Lock();
-
-					uint16_t result = _socketBuffer.Read(dataFrame, maxSendSize);
+					uint16_t result = Drain(_socketBuffer, _socketIdle, dataFrame, maxSendSize);
 
-					_adminLock.Unlock();
+					_sent.fetch_add(result, std::memory_order_relaxed);
 
 					return (result);
 				}
 
+				// Only what does not fit in the ring at all, stays with the link, which stops reading once its own
+				// buffer is full. That pushes back on the sender (TCP window) instead of losing the data.
 				uint16_t ReceiveData(uint8_t* dataFrame, const uint16_t receivedSize)
 				{
-					_adminLock.Lock();
-
-					bool wasEmpty = _channelBuffer.IsEmpty();
-
 					uint16_t result = _channelBuffer.Write(dataFrame, receivedSize);
 
-					if (wasEmpty == true) {
-						// This is new data, there was nothing pending, trigger a request for a frambuffer.
-						_channel->RequestOutbound();
-					}
+					Forwarded(result);
 
-					_adminLock.Unlock();
+					if ((_paused.load() == false) && (_channelBuffer.Used() >= _highWater)) {
+						Pause();
+					}
 
 					return (result);
 				}
 
-				uint16_t ChannelSend(uint8_t* dataFrame, const uint16_t maxSendSize) const
+				// A datagram can not be held back, it is passed on as a whole or dropped, never cut short.
+				uint16_t ReceiveDatagram(uint8_t* dataFrame, const uint16_t receivedSize)
 				{
-					_adminLock.Lock();
+					if ((_channelBuffer.Size() - _channelBuffer.Used()) >= receivedSize) {
+						Forwarded(_channelBuffer.Write(dataFrame, receivedSize));
+					}
+					else {
+						_dropped.fetch_add(1, std::memory_order_relaxed);
+					}
 
-					uint16_t result = _channelBuffer.Read(dataFrame, maxSendSize);
+					return (receivedSize);
+				}
 
-					_adminLock.Unlock();
+				uint16_t ChannelSend(uint8_t* dataFrame, const uint16_t maxSendSize) const
+				{
+					uint16_t result = Drain(_channelBuffer, _channelIdle, dataFrame, maxSendSize);
+
+					if ((_paused.load() == true) && (_channelBuffer.Used() <= _lowWater) && (_paused.exchange(false) == true)) {
+						// Room enough again, let the sender of the link go.
+						Throttle(false);
+					}
 
 					return (result);
 				}
 
 				uint16_t ChannelReceive(const uint8_t* dataFrame, const uint16_t receivedSize)
 				{
-					_adminLock.Lock();
-
-					bool wasEmpty = _socketBuffer.IsEmpty();
-
 					uint16_t result = _socketBuffer.Write(dataFrame, receivedSize);
 
-					if (wasEmpty == true) {
-						// This is new data, there was nothing pending, trigger a request for a frambuffer.
+					if ((result != 0) && (_socketIdle.exchange(false) == true)) {
+						// The link ran out of data to send, trigger a request for a framebuffer.
 						_link->Trigger();
 					}
 
-					_adminLock.Unlock();
-
 					return (result);
 				}
 
@@ -140,12 +196,75 @@ namespace WPEFramework {
 					_adminLock.Unlock();
 				}
 
+			protected:
+				// Hold back (or let go) the sender of the link, if the link can.
+				virtual void Throttle(const bool paused) const = 0;
+
+			private:
+				void Forwarded(const uint16_t length)
+				{
+					if (length != 0) {
+						_received.fetch_add(length, std::memory_order_relaxed);
+
+						if (_channelIdle.exchange(false) == true) {
+							// The channel ran out of data to send, trigger a request for a framebuffer.
+							_adminLock.Lock();
+
+							if (_channel != nullptr) {
+								_channel->RequestOutbound();
+							}
+
+							_adminLock.Unlock();
+						}
+					}
+				}
+				// The link is throttled before the mark is set, whoever clears the mark, releases it. If the
+				// channel emptied the ring before it could see the mark, it is cleared here.
+				void Pause()
+				{
+					Throttle(true);
+
+					_paused.store(true);
+
+					if ((_channelBuffer.Used() <= _lowWater) && (_paused.exchange(false) == true)) {
+						Throttle(false);
+					}
+					else {
+						_stalls.fetch_add(1, std::memory_order_relaxed);
+					}
+				}
+				// The consumer marks a ring idle when it finds it empty, the producer that clears the mark, wakes
+				// it up. Data written between the empty read and the mark, is picked up here, rather than lost.
+				static uint16_t Drain(RingBuffer& buffer, std::atomic<bool>& idle, uint8_t* dataFrame, const uint16_t maxSize)
+				{
+					uint16_t result = buffer.Read(dataFrame, maxSize);
+
+					if (result == 0) {
+						idle.store(true);
+
+						if ((buffer.IsEmpty() == false) && (idle.exchange(false) == true)) {
+							result = buffer.Read(dataFrame, maxSize);
+						}
+					}
+
+					return (result);
+				}
+
 			private:
 				Core::IStream* _link;
 				PluginHost::Channel* _channel;
 				mutable Core::CriticalSection _adminLock;
-				Core::CyclicDataBuffer<Core::ScopedStorage<8192> > _channelBuffer;
-				Core::CyclicDataBuffer<Core::ScopedStorage<8192> > _socketBuffer;
+				mutable RingBuffer _channelBuffer; //!< From the link to the channel.
+				RingBuffer _socketBuffer; //!< From the channel to the link.
+				mutable std::atomic<bool> _channelIdle;
+				std::atomic<bool> _socketIdle;
+				const uint32_t _highWater;
+				const uint32_t _lowWater;
+				mutable std::atomic<bool> _paused;
+				std::atomic<uint64_t> _received;
+				std::atomic<uint64_t> _sent;
+				std::atomic<uint32_t> _dropped;
+				std::atomic<uint32_t> _stalls;
 			};
 			class Config : public Core::JSON::Container {
 			public:
@@ -226,6 +345,7 @@ namespace WPEFramework {
 						Add(_T("host"), &Host);
 						Add(_T("device"), &Device);
 						Add(_T("configuration"), &Configuration);
+						Add(_T("buffersize"), &BufferSize);
 					}
 					Link(const string& name, const enumType type, const bool text, const string host)
 						: Core::JSON::Container()
@@ -236,6 +356,7 @@ namespace WPEFramework {
 						Add(_T("host"), &Host);
 						Add(_T("device"), &Device);
 						Add(_T("configuration"), &Configuration);
+						Add(_T("buffersize"), &BufferSize);
 
 						Name = name;
 						Type = type;
@@ -254,6 +375,7 @@ namespace WPEFramework {
 						Add(_T("host"), &Host);
 						Add(_T("device"), &Device);
 						Add(_T("configuration"), &Configuration);
+						Add(_T("buffersize"), &BufferSize);
 
 						Name = name;
 						Type = type;
@@ -272,6 +394,7 @@ namespace WPEFramework {
 						, Host(copy.Host)
 						, Device(copy.Device)
 						, Configuration(copy.Configuration)
+						, BufferSize(copy.BufferSize)
 					{
 						Add(_T("name"), &Name);
 						Add(_T("type"), &Type);
@@ -279,6 +402,7 @@ namespace WPEFramework {
 						Add(_T("host"), &Host);
 						Add(_T("device"), &Device);
 						Add(_T("configuration"), &Configuration);
+						Add(_T("buffersize"), &BufferSize);
 					}
 					~Link()
 					{
@@ -291,6 +415,7 @@ namespace WPEFramework {
 					Core::JSON::String              Host;
 					Core::JSON::String              Device;
 					Settings                            Configuration;
+					Core::JSON::DecUInt32           BufferSize; // Size in bytes of the buffer in each direction.
 				};
 
 			private:
@@ -313,10 +438,82 @@ namespace WPEFramework {
 				Core::JSON::DecUInt16 Connections;
 				Core::JSON::ArrayType<Link> Links;
 			};
+			class Statistics : public Core::JSON::Container {
+			public:
+				class Link : public Core::JSON::Container {
+				private:
+					Link& operator=(const Link&);
+
+				public:
+					Link()
+						: Core::JSON::Container()
+					{
+						Add(_T("id"), &Id);
+						Add(_T("remote"), &Remote);
+						Add(_T("received"), &Received);
+						Add(_T("sent"), &Sent);
+						Add(_T("buffered"), &Buffered);
+						Add(_T("dropped"), &Dropped);
+						Add(_T("stalls"), &Stalls);
+						Add(_T("paused"), &Paused);
+					}
+					Link(const Link& copy)
+						: Core::JSON::Container()
+						, Id(copy.Id)
+						, Remote(copy.Remote)
+						, Received(copy.Received)
+						, Sent(copy.Sent)
+						, Buffered(copy.Buffered)
+						, Dropped(copy.Dropped)
+						, Stalls(copy.Stalls)
+						, Paused(copy.Paused)
+					{
+						Add(_T("id"), &Id);
+						Add(_T("remote"), &Remote);
+						Add(_T("received"), &Received);
+						Add(_T("sent"), &Sent);
+						Add(_T("buffered"), &Buffered);
+						Add(_T("dropped"), &Dropped);
+						Add(_T("stalls"), &Stalls);
+						Add(_T("paused"), &Paused);
+					}
+					~Link()
+					{
+					}
+
+				public:
+					Core::JSON::DecUInt32 Id;
+					Core::JSON::String    Remote;
+					Core::JSON::DecUInt64 Received; // Bytes from the link to the channel.
+					Core::JSON::DecUInt64 Sent; // Bytes from the channel to the link.
+					Core::JSON::DecUInt32 Buffered; // Bytes waiting for the channel.
+					Core::JSON::DecUInt32 Dropped; // Datagrams that did not fit.
+					Core::JSON::DecUInt32 Stalls; // Times the sender of the link was held back.
+					Core::JSON::Boolean   Paused;
+				};
+
+			private:
+				Statistics(const Statistics&);
+				Statistics& operator=(const Statistics&);
+
+			public:
+				Statistics()
+					: Core::JSON::Container()
+				{
+					Add(_T("links"), &Links);
+				}
+				~Statistics()
+				{
+				}
+
+			public:
+				Core::JSON::ArrayType<Link> Links;
+			};
 
 		public:
 			WebProxy()
-				: _connectionMap()
+				: _adminLock()
+				, _connectionMap()
 			{
 			}
 			virtual ~WebProxy()
@@ -354,6 +551,7 @@ namespace WPEFramework {
 
 			// Returns an interface to a JSON struct that can be used to return specific metadata information with respect
 			// to this plugin. This Metadata can be used by the MetData plugin to publish this information to the ouside world.
+			// Reports the traffic, and how often it had to be held back, for every connection.
 			virtual string Information() const;
 
 			//	IChannel methods
@@ -372,6 +570,7 @@ namespace WPEFramework {
 		private:
 			string _prefix;
 			uint32_t _maxConnections;
+			mutable Core::CriticalSection _adminLock;
 			std::map<const uint32_t, Connector*> _connectionMap;
 			std::map<const string, Config::Link> _linkInfo;
 		};
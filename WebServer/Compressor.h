@@ -0,0 +1,242 @@
+#ifndef __WEBSERVER_COMPRESSOR_H
+#define __WEBSERVER_COMPRESSOR_H
+
+#include "Module.h"
+
+#include <unordered_set>
+
+#ifndef __WIN32__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Compresses files (gzip) on a thread of its own, into a cache directory. The compressed file gets the
+    // modification time of the original, so it is easy to tell if it still belongs to it. A file is written
+    // under a temporary name and moved in place once it is complete, so it is never served half written.
+    // Windows builds do not link zlib, compression is not available there.
+    class Compressor : public Core::Thread {
+    private:
+        Compressor(const Compressor&) = delete;
+        Compressor& operator=(const Compressor&) = delete;
+
+        static constexpr uint16_t MaxPending = 32;
+        static constexpr uint32_t ChunkSize = 64 * 1024;
+
+        typedef std::pair<string, string> Job;
+
+    public:
+        Compressor()
+            : Core::Thread(Core::Thread::DefaultStackSize(), _T("WebServerCompressor"))
+            , _lock()
+            , _directory()
+            , _jobs()
+            , _pending()
+            , _signal(false, true)
+            , _compressed(0)
+            , _failed(0)
+        {
+        }
+        ~Compressor()
+        {
+            ASSERT((Core::Thread::State() == Core::Thread::STOPPED) || (Core::Thread::State() == Core::Thread::INITIALIZED));
+        }
+
+    public:
+        inline bool IsEnabled() const
+        {
+            return (_directory.empty() == false);
+        }
+        inline uint32_t Compressed() const
+        {
+            return (_compressed);
+        }
+        inline uint32_t Failed() const
+        {
+            return (_failed);
+        }
+        // The name the compressed version of a file (relative to the served root) gets in the cache.
+        string FileName(const string& relative) const
+        {
+            string result(_directory);
+
+            result.reserve(result.length() + relative.length() + 8);
+
+            // Flatten the path, escaping so two different paths never end up on the same name.
+            for (string::const_iterator index(relative.begin()); index != relative.end(); index++) {
+                if (*index == '%') {
+                    result += _T("%25");
+                }
+                else if (*index == '/') {
+                    result += _T("%2F");
+                }
+                else {
+                    result += *index;
+                }
+            }
+
+            return (result + _T(".gz"));
+        }
+        void Start(const string& directory)
+        {
+#ifndef __WIN32__
+            _directory = Core::Directory::Normalize(directory);
+
+            if ((Core::Directory(_directory.c_str()).CreatePath() == true) || (::access(_directory.c_str(), W_OK) == 0)) {
+                Core::Thread::Run();
+            }
+            else {
+                TRACE_L1("Could not create compression cache %s, compression disabled.", _directory.c_str());
+                _directory.clear();
+            }
+#else
+            TRACE_L1("Compression is not supported on this platform, %s is not used.", directory.c_str());
+#endif
+        }
+        void Terminate()
+        {
+            if (Core::Thread::State() != Core::Thread::INITIALIZED) {
+                Core::Thread::Stop();
+
+                _signal.SetEvent();
+
+                Core::Thread::Wait(Core::Thread::STOPPED, Core::infinite);
+            }
+        }
+        // Queue a file to be compressed, a file that is already queued, is not queued again.
+        void Submit(const string& source, const string& destination)
+        {
+            _lock.Lock();
+
+            if ((_pending.size() < MaxPending) && (_pending.insert(destination).second == true)) {
+                _jobs.push_back(Job(source, destination));
+                _signal.SetEvent();
+            }
+
+            _lock.Unlock();
+        }
+
+    private:
+        virtual uint32_t Worker()
+        {
+            Job job;
+            bool available = false;
+
+            _lock.Lock();
+
+            if (_jobs.empty() == false) {
+                job = _jobs.front();
+                _jobs.pop_front();
+                available = true;
+            }
+            else {
+                _signal.ResetEvent();
+            }
+
+            _lock.Unlock();
+
+            if (available == false) {
+                _signal.Lock(Core::infinite);
+            }
+            else {
+                if (Compress(job.first, job.second) == true) {
+                    _compressed++;
+                }
+                else {
+                    _failed++;
+                }
+
+                _lock.Lock();
+                _pending.erase(job.second);
+                _lock.Unlock();
+            }
+
+            return (0);
+        }
+        static bool Compress(const string& source, const string& destination)
+        {
+            bool result = false;
+#ifndef __WIN32__
+            const string temporary(destination + _T(".tmp"));
+            int input = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+            int output = (input != -1 ? ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1);
+            struct stat info;
+
+            if ((output != -1) && (::fstat(input, &info) == 0)) {
+                z_stream stream;
+
+                ::memset(&stream, 0, sizeof(stream));
+
+                // 15 + 16: the largest window, with a gzip header and trailer.
+                if (::deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) == Z_OK) {
+                    std::vector<uint8_t> in(ChunkSize);
+                    std::vector<uint8_t> out(ChunkSize);
+                    int flush = Z_NO_FLUSH;
+                    bool failed = false;
+
+                    while ((failed == false) && (flush != Z_FINISH)) {
+                        ssize_t length = ::read(input, in.data(), in.size());
+
+                        failed = (length < 0);
+                        flush = (length <= 0 ? Z_FINISH : Z_NO_FLUSH);
+                        stream.next_in = in.data();
+                        stream.avail_in = static_cast<uInt>(length < 0 ? 0 : length);
+
+                        do {
+                            stream.next_out = out.data();
+                            stream.avail_out = static_cast<uInt>(out.size());
+
+                            ::deflate(&stream, flush);
+
+                            size_t produced = out.size() - stream.avail_out;
+
+                            failed = failed || (::write(output, out.data(), produced) != static_cast<ssize_t>(produced));
+                        } while ((failed == false) && (stream.avail_out == 0));
+                    }
+
+                    ::deflateEnd(&stream);
+
+                    if (failed == false) {
+                        // Mark it as the compressed version of this version of the original.
+                        struct timespec times[2] = { info.st_atim, info.st_mtim };
+
+                        result = (::futimens(output, times) == 0) && (::fsync(output) == 0);
+                    }
+                }
+            }
+
+            if (output != -1) {
+                ::close(output);
+
+                if ((result == true) && (::rename(temporary.c_str(), destination.c_str()) != 0)) {
+                    result = false;
+                }
+                if (result == false) {
+                    ::unlink(temporary.c_str());
+                }
+            }
+            if (input != -1) {
+                ::close(input);
+            }
+#endif
+
+            return (result);
+        }
+
+    private:
+        Core::CriticalSection _lock;
+        string _directory;
+        std::list<Job> _jobs;
+        std::unordered_set<string> _pending;
+        Core::Event _signal;
+        uint32_t _compressed;
+        uint32_t _failed;
+    };
+}
+}
+
+#endif // __WEBSERVER_COMPRESSOR_H
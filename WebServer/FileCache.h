@@ -0,0 +1,590 @@
+#ifndef __WEBSERVER_FILECACHE_H
+#define __WEBSERVER_FILECACHE_H
+
+#include "Module.h"
+
+#include <sys/stat.h>
+#include <unordered_map>
+
+#ifndef __WIN32__
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Keeps the most recently served files in memory, up to a total size, so a hit does not touch the
+    // filesystem. Files that are too large to keep are remembered by their attributes only, files that do
+    // not exist are remembered as missing. The directories of the cached files are watched with inotify, any
+    // change to a cached file drops it from the cache, the next request looks it up again.
+    // Lookups are done from the socket thread, the inotify events come in on the resource monitor thread.
+    // Without inotify (Windows) a cached file can not be invalidated, so the cache is not available there.
+    class FileCache : public Core::IResource {
+    private:
+        FileCache(const FileCache&) = delete;
+        FileCache& operator=(const FileCache&) = delete;
+
+#ifndef __WIN32__
+        static constexpr uint32_t WatchMask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF;
+#endif
+
+    public:
+        // Never changes once it is created, a changed file is a new entry.
+        class Entry {
+        private:
+            Entry() = delete;
+            Entry(const Entry&) = delete;
+            Entry& operator=(const Entry&) = delete;
+
+            enum state {
+                MISSING,
+                DISK,
+                MEMORY
+            };
+
+        public:
+            Entry(const string& fileName)
+                : _fileName(fileName)
+                , _state(MISSING)
+                , _content()
+                , _size(0)
+                , _modified()
+                , _eTag()
+            {
+            }
+            Entry(const string& fileName, const struct stat& info)
+                : _fileName(fileName)
+                , _state(DISK)
+                , _content()
+                , _size(static_cast<uint64_t>(info.st_size))
+                , _modified(Modified(info))
+                , _eTag()
+            {
+                // Without the content, the file is identified by its inode, size and modification time.
+                TCHAR buffer[64];
+                ::snprintf(buffer, sizeof(buffer), _T("\"%llx-%llx-%llx\""), static_cast<unsigned long long>(info.st_ino), static_cast<unsigned long long>(_size), static_cast<unsigned long long>(_modified.Ticks()));
+                _eTag = buffer;
+            }
+            Entry(const string& fileName, const struct stat& info, string& content)
+                : _fileName(fileName)
+                , _state(MEMORY)
+                , _content()
+                , _size(content.length())
+                , _modified(Modified(info))
+                , _eTag()
+            {
+                _content.swap(content);
+
+                // A strong validator, it changes whenever the content changes.
+                uint64_t hash = 14695981039346656037ULL;
+
+                for (string::const_iterator index(_content.begin()); index != _content.end(); index++) {
+                    hash = (hash ^ static_cast<uint8_t>(*index)) * 1099511628211ULL;
+                }
+
+                TCHAR buffer[48];
+                ::snprintf(buffer, sizeof(buffer), _T("\"%016llx-%zx\""), static_cast<unsigned long long>(hash), _content.length());
+                _eTag = buffer;
+            }
+            ~Entry()
+            {
+            }
+
+        public:
+            inline const string& FileName() const
+            {
+                return (_fileName);
+            }
+            inline bool Exists() const
+            {
+                return (_state != MISSING);
+            }
+            // Only if the content is in memory, it can be served from the entry.
+            inline bool IsLoaded() const
+            {
+                return (_state == MEMORY);
+            }
+            inline const string& Content() const
+            {
+                return (_content);
+            }
+            inline uint64_t Size() const
+            {
+                return (_size);
+            }
+            // What it takes to keep this entry.
+            inline uint32_t Cost() const
+            {
+                return (static_cast<uint32_t>(_content.length() + _fileName.length() + sizeof(Entry)));
+            }
+            inline const Core::Time& Modified() const
+            {
+                return (_modified);
+            }
+            inline const string& ETag() const
+            {
+                return (_eTag);
+            }
+            // If-None-Match holds "*", or a comma separated list of quoted entity tags. It uses the weak
+            // comparison, a tag matches if it is equal to ours, with or without the W/ in front.
+            bool Matches(const string& tags) const
+            {
+                bool result = false;
+                size_t index = tags.find_first_not_of(_T(" \t,"));
+
+                if ((index != string::npos) && (tags[index] == '*')) {
+                    // Only on its own, it is not a wildcard in a list.
+                    result = (tags.find_first_not_of(_T(" \t"), index + 1) == string::npos);
+                }
+                else {
+                    while ((result == false) && (index != string::npos)) {
+                        if (tags.compare(index, 2, _T("W/")) == 0) {
+                            index += 2;
+                        }
+
+                        const size_t end = (((index < tags.length()) && (tags[index] == '"')) ? tags.find('"', index + 1) : string::npos);
+
+                        if (end != string::npos) {
+                            result = (tags.compare(index, end - index + 1, _eTag) == 0);
+                            index = tags.find(',', end + 1);
+                            index = (index != string::npos ? tags.find_first_not_of(_T(" \t,"), index) : index);
+                        }
+                        else {
+                            // Not a quoted tag, the rest of the list can not be trusted.
+                            index = string::npos;
+                        }
+                    }
+                }
+
+                return (result);
+            }
+
+        private:
+            static Core::Time Modified(const struct stat& info)
+            {
+#ifndef __WIN32__
+                return (Core::Time((static_cast<uint64_t>(info.st_mtim.tv_sec) * 1000000) + (info.st_mtim.tv_nsec / 1000)));
+#else
+                return (Core::Time(static_cast<uint64_t>(info.st_mtime) * 1000000));
+#endif
+            }
+
+        private:
+            const string _fileName;
+            const state _state;
+            string _content;
+            const uint64_t _size;
+            const Core::Time _modified;
+            string _eTag;
+        };
+
+        // Serves (part of) an entry straight from memory.
+        class Body : public Web::IBody {
+        private:
+            Body() = delete;
+            Body(const Body&) = delete;
+            Body& operator=(const Body&) = delete;
+
+        public:
+            Body(const Core::ProxyType<Entry>& entry)
+                : _entry(entry)
+                , _offset(0)
+                , _length(static_cast<uint32_t>(entry->Size()))
+                , _position(0)
+            {
+                ASSERT(entry->IsLoaded() == true);
+            }
+            Body(const Core::ProxyType<Entry>& entry, const uint32_t offset, const uint32_t length)
+                : _entry(entry)
+                , _offset(offset)
+                , _length(length)
+                , _position(0)
+            {
+                ASSERT(entry->IsLoaded() == true);
+                ASSERT((offset + length) <= entry->Size());
+            }
+            virtual ~Body()
+            {
+            }
+
+        public:
+            virtual uint32_t Serialize() const
+            {
+                _position = 0;
+                return (_length);
+            }
+            virtual uint32_t Deserialize()
+            {
+                return (0);
+            }
+            virtual void End() const
+            {
+            }
+            virtual uint16_t Serialize(uint8_t stream[], const uint16_t maxLength) const
+            {
+                uint16_t result = static_cast<uint16_t>(std::min(static_cast<uint32_t>(maxLength), _length - _position));
+
+                ::memcpy(stream, &(_entry->Content()[_offset + _position]), result);
+                _position += result;
+
+                return (result);
+            }
+            virtual uint16_t Deserialize(const uint8_t[], const uint16_t)
+            {
+                return (0);
+            }
+
+        private:
+            Core::ProxyType<Entry> _entry;
+            const uint32_t _offset;
+            const uint32_t _length;
+            mutable uint32_t _position;
+        };
+
+        class Statistics {
+        public:
+            Statistics()
+                : Hits(0)
+                , Misses(0)
+                , NotModified(0)
+                , Served(0)
+                , Entries(0)
+                , Size(0)
+            {
+            }
+            ~Statistics()
+            {
+            }
+
+        public:
+            uint32_t Hits;
+            uint32_t Misses;
+            uint32_t NotModified; //!< Conditional requests answered with a 304.
+            uint64_t Served; //!< Bytes sent from memory.
+            uint32_t Entries;
+            uint32_t Size;
+        };
+
+    private:
+        struct Node {
+            Core::ProxyType<Entry> Content;
+            std::list<string>::iterator Position;
+            int Watch;
+        };
+
+        typedef std::unordered_map<string, Node> EntryMap;
+        typedef std::unordered_map<int, std::list<string> > DirectoryMap;
+
+    public:
+        FileCache()
+            : _lock()
+            , _descriptor(-1)
+            , _capacity(0)
+            , _maxFileSize(0)
+            , _size(0)
+            , _generation(0)
+            , _entries()
+            , _lru()
+            , _directories()
+            , _statistics()
+        {
+        }
+        virtual ~FileCache()
+        {
+            Close();
+        }
+
+    public:
+        inline bool IsEnabled() const
+        {
+            return (_descriptor != -1);
+        }
+        // Sizes in bytes, a capacity of 0 disables the cache.
+        void Open(const uint32_t capacity, const uint32_t maxFileSize)
+        {
+            ASSERT(_descriptor == -1);
+
+            _capacity = capacity;
+            _maxFileSize = std::min(capacity, maxFileSize);
+
+            if (_capacity != 0) {
+#ifndef __WIN32__
+                _descriptor = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+                if (_descriptor != -1) {
+                    Core::ResourceMonitor::Instance().Register(*this);
+                }
+                else {
+                    TRACE_L1("Could not watch the files, the cache is disabled. Error: %d", errno);
+                }
+#else
+                TRACE_L1("Files can not be watched on this platform, the cache is disabled.");
+#endif
+            }
+        }
+        void Close()
+        {
+#ifndef __WIN32__
+            if (_descriptor != -1) {
+                Core::ResourceMonitor::Instance().Unregister(*this);
+
+                _lock.Lock();
+
+                ::close(_descriptor);
+                _descriptor = -1;
+                _entries.clear();
+                _lru.clear();
+                _directories.clear();
+                _size = 0;
+
+                _lock.Unlock();
+            }
+#endif
+        }
+
+        // Returns an invalid proxy if the file can not be cached (it is not a regular file, or it can not be
+        // watched), it should be served from disk.
+        Core::ProxyType<Entry> Find(const string& fileName)
+        {
+            Core::ProxyType<Entry> result;
+
+            if (_descriptor != -1) {
+                _lock.Lock();
+
+                EntryMap::iterator index(_entries.find(fileName));
+
+                if (index != _entries.end()) {
+                    result = index->second.Content;
+                    _lru.splice(_lru.begin(), _lru, index->second.Position);
+                    _statistics.Hits++;
+                }
+                else {
+                    _statistics.Misses++;
+                }
+
+                _lock.Unlock();
+
+                if (result.IsValid() == false) {
+                    result = Load(fileName);
+                }
+            }
+
+            return (result);
+        }
+        inline void NotModified()
+        {
+            _lock.Lock();
+            _statistics.NotModified++;
+            _lock.Unlock();
+        }
+        inline void Served(const uint32_t bytes)
+        {
+            _lock.Lock();
+            _statistics.Served += bytes;
+            _lock.Unlock();
+        }
+        void Snapshot(Statistics& statistics) const
+        {
+            _lock.Lock();
+
+            statistics = _statistics;
+            statistics.Entries = static_cast<uint32_t>(_entries.size());
+            statistics.Size = _size;
+
+            _lock.Unlock();
+        }
+
+        // Core::IResource, the inotify events.
+        virtual Core::IResource::handle Descriptor() const
+        {
+            return (_descriptor);
+        }
+        virtual uint16_t Events()
+        {
+            return (_descriptor != -1 ? POLLIN : 0);
+        }
+        virtual void Handle(const uint16_t events)
+        {
+#ifndef __WIN32__
+            if ((events & POLLIN) != 0) {
+                alignas(struct inotify_event) uint8_t buffer[4096];
+                ssize_t length;
+
+                _lock.Lock();
+
+                while ((length = ::read(_descriptor, buffer, sizeof(buffer))) > 0) {
+                    ssize_t offset = 0;
+
+                    while (offset < length) {
+                        const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(&(buffer[offset]));
+
+                        Invalidate(event->wd, event->mask, (event->len != 0 ? event->name : nullptr));
+
+                        offset += sizeof(struct inotify_event) + event->len;
+                    }
+                }
+
+                _lock.Unlock();
+            }
+#endif
+        }
+
+    private:
+        Core::ProxyType<Entry> Load(const string& fileName)
+        {
+            Core::ProxyType<Entry> result;
+#ifndef __WIN32__
+            const size_t slash = fileName.rfind('/');
+            const string directory(slash == string::npos ? string(_T(".")) : fileName.substr(0, slash + 1));
+
+            _lock.Lock();
+
+            // Watch before reading, so a change while reading is never missed.
+            const uint32_t generation = _generation;
+            const int watch = ::inotify_add_watch(_descriptor, directory.c_str(), WatchMask);
+
+            _lock.Unlock();
+
+            int handle = (watch != -1 ? ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC) : -1);
+
+            if (handle != -1) {
+                struct stat info;
+
+                if ((::fstat(handle, &info) == 0) && (S_ISREG(info.st_mode))) {
+                    if (static_cast<uint64_t>(info.st_size) > _maxFileSize) {
+                        result = Core::ProxyType<Entry>::Create(fileName, info);
+                    }
+                    else {
+                        string content(static_cast<size_t>(info.st_size), '\0');
+
+                        if ((content.empty() == true) || (::read(handle, &(content[0]), content.length()) == static_cast<ssize_t>(content.length()))) {
+                            result = Core::ProxyType<Entry>::Create(fileName, info, content);
+                        }
+                    }
+                }
+
+                ::close(handle);
+            }
+            else if ((watch != -1) && (errno == ENOENT)) {
+                result = Core::ProxyType<Entry>::Create(fileName);
+            }
+
+            _lock.Lock();
+
+            // If anything changed while reading, it might have been this file, serve it but do not keep it.
+            if ((result.IsValid() == true) && (generation == _generation) && (_descriptor != -1) && (_entries.find(fileName) == _entries.end())) {
+                Node node;
+
+                _lru.push_front(fileName);
+                node.Content = result;
+                node.Position = _lru.begin();
+                node.Watch = watch;
+
+                _entries.insert(std::pair<string, Node>(fileName, node));
+                _directories[watch].push_back(fileName);
+                _size += result->Cost();
+
+                while (_size > _capacity) {
+                    Remove(_lru.back());
+                }
+            }
+            else if ((watch != -1) && (_directories.find(watch) == _directories.end())) {
+                // Nothing of this directory is cached.
+                ::inotify_rm_watch(_descriptor, watch);
+            }
+
+            _lock.Unlock();
+#endif
+
+            return (result);
+        }
+        // Only call these while holding the _lock.
+        void Remove(const string& fileName)
+        {
+            EntryMap::iterator index(_entries.find(fileName));
+
+            ASSERT(index != _entries.end());
+
+            DirectoryMap::iterator directory(_directories.find(index->second.Watch));
+
+            if (directory != _directories.end()) {
+                directory->second.remove(fileName);
+
+                if (directory->second.empty() == true) {
+#ifndef __WIN32__
+                    ::inotify_rm_watch(_descriptor, directory->first);
+#endif
+                    _directories.erase(directory);
+                }
+            }
+
+            _size -= index->second.Content->Cost();
+            _lru.erase(index->second.Position);
+            _entries.erase(index);
+        }
+#ifndef __WIN32__
+        void Invalidate(const int watch, const uint32_t mask, const char name[])
+        {
+            _generation++;
+
+            if ((mask & IN_Q_OVERFLOW) != 0) {
+                // Events were lost, anything could have changed.
+                while (_lru.empty() == false) {
+                    Remove(_lru.back());
+                }
+            }
+            else {
+                DirectoryMap::iterator directory(_directories.find(watch));
+
+                if (directory != _directories.end()) {
+                    std::list<string> files;
+
+                    if ((name == nullptr) || ((mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) != 0)) {
+                        // The directory itself changed.
+                        files = directory->second;
+                    }
+                    else {
+                        const size_t length = ::strlen(name);
+                        std::list<string>::const_iterator index(directory->second.begin());
+
+                        while (index != directory->second.end()) {
+                            if ((index->length() > length) && (index->compare(index->length() - length, length, name) == 0) && ((*index)[index->length() - length - 1] == '/')) {
+                                files.push_back(*index);
+                            }
+                            index++;
+                        }
+                    }
+
+                    if ((mask & IN_IGNORED) != 0) {
+                        // The kernel dropped the watch, do not remove it again.
+                        _directories.erase(directory);
+                    }
+
+                    for (std::list<string>::const_iterator index(files.begin()); index != files.end(); index++) {
+                        if (_entries.find(*index) != _entries.end()) {
+                            Remove(*index);
+                        }
+                    }
+                }
+            }
+        }
+#endif
+
+    private:
+        mutable Core::CriticalSection _lock;
+        int _descriptor;
+        uint32_t _capacity;
+        uint32_t _maxFileSize;
+        uint32_t _size;
+        uint32_t _generation;
+        EntryMap _entries;
+        std::list<string> _lru;
+        DirectoryMap _directories;
+        Statistics _statistics;
+    };
+}
+}
+
+#endif // __WEBSERVER_FILECACHE_H
@@ -0,0 +1,138 @@
+#ifndef __WEBSERVER_MAPPEDBODY_H
+#define __WEBSERVER_MAPPEDBODY_H
+
+#include "Module.h"
+
+#ifndef __WIN32__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Sends (part of) a file from a memory mapping, the send buffer is filled straight from the page cache,
+    // without a read call for every chunk. The mapping holds on to the file that was opened, a file that is
+    // replaced (renamed over) while it is sent, is not affected. Do not truncate a file in place while it is
+    // served, the pages that are gone can not be read anymore.
+    // Windows has no mmap, the body is never valid there and the file is sent through a FileBody.
+    class MappedBody : public Web::IBody {
+    private:
+        MappedBody() = delete;
+        MappedBody(const MappedBody&) = delete;
+        MappedBody& operator=(const MappedBody&) = delete;
+
+    public:
+        MappedBody(const string& fileName)
+            : _data(nullptr)
+            , _mapped(0)
+            , _begin(0)
+            , _length(0)
+            , _position(0)
+        {
+            Map(fileName, 0, ~static_cast<uint64_t>(0));
+        }
+        MappedBody(const string& fileName, const uint64_t offset, const uint64_t length)
+            : _data(nullptr)
+            , _mapped(0)
+            , _begin(0)
+            , _length(0)
+            , _position(0)
+        {
+            Map(fileName, offset, length);
+        }
+        virtual ~MappedBody()
+        {
+#ifndef __WIN32__
+            if (_data != nullptr) {
+                ::munmap(_data, _mapped);
+            }
+#endif
+        }
+
+    public:
+        inline bool IsValid() const
+        {
+            return (_data != nullptr);
+        }
+        inline uint64_t Length() const
+        {
+            return (_length);
+        }
+
+        virtual uint32_t Serialize() const
+        {
+            _position = 0;
+            return (static_cast<uint32_t>(_length));
+        }
+        virtual uint32_t Deserialize()
+        {
+            return (0);
+        }
+        virtual void End() const
+        {
+        }
+        virtual uint16_t Serialize(uint8_t stream[], const uint16_t maxLength) const
+        {
+            uint16_t result = static_cast<uint16_t>(std::min(static_cast<uint64_t>(maxLength), _length - _position));
+
+            ::memcpy(stream, &(_data[_begin + _position]), result);
+            _position += result;
+
+            return (result);
+        }
+        virtual uint16_t Deserialize(const uint8_t[], const uint16_t)
+        {
+            return (0);
+        }
+
+    private:
+        void Map(const string& fileName, const uint64_t offset, const uint64_t size)
+        {
+#ifndef __WIN32__
+            int handle = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+
+            if (handle != -1) {
+                struct stat info;
+
+                if ((::fstat(handle, &info) == 0) && (S_ISREG(info.st_mode)) && (offset < static_cast<uint64_t>(info.st_size))) {
+                    // A mapping starts on a page boundary.
+                    const uint64_t page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+                    const uint64_t start = offset - (offset % page);
+                    const uint64_t length = std::min(size, static_cast<uint64_t>(info.st_size) - offset);
+
+                    // The body length is reported in 32 bits, larger parts are left to the FileBody.
+                    void* data = (length <= 0xFFFFFFFF ? ::mmap(nullptr, (offset - start) + length, PROT_READ, MAP_PRIVATE, handle, start) : MAP_FAILED);
+
+                    if (data != MAP_FAILED) {
+                        _length = length;
+                        _begin = offset - start;
+                        _mapped = _begin + _length;
+                        _data = static_cast<uint8_t*>(data);
+
+                        // It is read front to back, once.
+                        ::madvise(_data, _mapped, MADV_SEQUENTIAL);
+                    }
+                    else if (length <= 0xFFFFFFFF) {
+                        TRACE_L1("Could not map %s, error %d", fileName.c_str(), errno);
+                    }
+                }
+
+                ::close(handle);
+            }
+#endif
+        }
+
+    private:
+        uint8_t* _data;
+        uint64_t _mapped;
+        uint64_t _begin;
+        uint64_t _length;
+        mutable uint64_t _position;
+    };
+}
+}
+
+#endif // __WEBSERVER_MAPPEDBODY_H
@@ -0,0 +1,564 @@
+#ifndef __WEBSERVER_PROXYCACHE_H
+#define __WEBSERVER_PROXYCACHE_H
+
+#include "Module.h"
+
+#include <unordered_map>
+
+#ifndef __WIN32__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace WPEFramework {
+namespace Plugin {
+
+    // Keeps the responses of the proxied servers, so a request for the same resource is answered without going
+    // upstream, as long as the response is fresh (Cache-Control max-age, Expires, or a guess based on
+    // Last-Modified). A stale response is revalidated: the server is asked if it changed with If-None-Match or
+    // If-Modified-Since. Responses are dropped, least recently used first, to stay within the memory size. With
+    // a disk tier, they are moved to a directory instead, and only dropped once that is full too.
+    // It is only used under the ProxyMap lock.
+    class ProxyCache {
+    private:
+        ProxyCache(const ProxyCache&) = delete;
+        ProxyCache& operator=(const ProxyCache&) = delete;
+
+        static constexpr uint32_t Magic = 0x57504331; // "WPC1"
+        static constexpr uint64_t MaxHeuristic = 24ULL * 60 * 60 * 1000000; // A day, in microseconds.
+
+    public:
+        // Only the expiry changes, when the response is revalidated.
+        class Entry {
+        private:
+            Entry() = delete;
+            Entry(const Entry&) = delete;
+            Entry& operator=(const Entry&) = delete;
+
+            friend class ProxyCache;
+
+        public:
+            Entry(const string& key, const Web::Response& response, const uint64_t expiry)
+                : _key(key)
+                , _expiry(expiry)
+                , _contentType(response.ContentType.IsSet() == true ? static_cast<uint32_t>(response.ContentType.Value()) : ~static_cast<uint32_t>(0))
+                , _contentEncoding(response.ContentEncoding.IsSet() == true ? response.ContentEncoding.Value() : string())
+                , _cacheControl(response.CacheControl.IsSet() == true ? response.CacheControl.Value() : string())
+                , _eTag(response.ETag.IsSet() == true ? response.ETag.Value() : string())
+                , _modified(response.Modified.IsSet() == true ? response.Modified.Value().Ticks() : 0)
+                , _body()
+            {
+                Core::ProxyType<const Web::TextBody> body(response.Body<Web::TextBody>());
+
+                if (body.IsValid() == true) {
+                    _body = string(*body);
+                }
+            }
+            Entry(const string& key)
+                : _key(key)
+                , _expiry(0)
+                , _contentType(~static_cast<uint32_t>(0))
+                , _contentEncoding()
+                , _cacheControl()
+                , _eTag()
+                , _modified(0)
+                , _body()
+            {
+            }
+            ~Entry()
+            {
+            }
+
+        public:
+            inline const string& Key() const
+            {
+                return (_key);
+            }
+            inline bool IsFresh(const uint64_t now) const
+            {
+                return (now < _expiry);
+            }
+            inline bool HasValidator() const
+            {
+                return ((_eTag.empty() == false) || (_modified != 0));
+            }
+            inline void Expiry(const uint64_t expiry)
+            {
+                _expiry = expiry;
+            }
+            inline uint32_t Cost() const
+            {
+                return (static_cast<uint32_t>(_key.length() + _contentEncoding.length() + _cacheControl.length() + _eTag.length() + _body.length() + sizeof(Entry)));
+            }
+            // Ask the server if the response changed, rather than for the response itself. Without a validator
+            // there is nothing to ask, the request goes as is.
+            void Revalidate(Web::Request& request) const
+            {
+                if (_eTag.empty() == false) {
+                    request.IfNoneMatch = _eTag;
+                }
+                else if (_modified != 0) {
+                    request.IfModifiedSince = Core::Time(_modified);
+                }
+            }
+            void Fill(Web::Response& response, const Core::ProxyType<Web::TextBody>& body) const
+            {
+                response.ErrorCode = Web::STATUS_OK;
+                response.Message = _T("OK");
+
+                if (_contentType != ~static_cast<uint32_t>(0)) {
+                    response.ContentType = static_cast<Web::MIMETypes>(_contentType);
+                }
+                if (_contentEncoding.empty() == false) {
+                    response.ContentEncoding = _contentEncoding;
+                }
+                if (_cacheControl.empty() == false) {
+                    response.CacheControl = _cacheControl;
+                }
+                if (_eTag.empty() == false) {
+                    response.ETag = _eTag;
+                }
+                if (_modified != 0) {
+                    response.Modified = Core::Time(_modified);
+                }
+                if (_body.empty() == false) {
+                    *body = _body;
+                    response.Body<Web::TextBody>(body);
+                }
+            }
+
+        private:
+            void Serialize(string& buffer) const
+            {
+                Append(buffer, Magic);
+                Append(buffer, _key);
+                Append(buffer, _expiry);
+                Append(buffer, _contentType);
+                Append(buffer, _contentEncoding);
+                Append(buffer, _cacheControl);
+                Append(buffer, _eTag);
+                Append(buffer, _modified);
+                Append(buffer, _body);
+            }
+            bool Deserialize(const string& buffer)
+            {
+                uint32_t magic = 0;
+                string key;
+                size_t offset = 0;
+
+                return ((Extract(buffer, offset, magic) == true) && (magic == Magic) && (Extract(buffer, offset, key) == true) && (key == _key) && (Extract(buffer, offset, _expiry) == true) && (Extract(buffer, offset, _contentType) == true) && (Extract(buffer, offset, _contentEncoding) == true) && (Extract(buffer, offset, _cacheControl) == true) && (Extract(buffer, offset, _eTag) == true) && (Extract(buffer, offset, _modified) == true) && (Extract(buffer, offset, _body) == true) && (offset == buffer.length()));
+            }
+            template <typename TYPE>
+            static void Append(string& buffer, const TYPE value)
+            {
+                buffer.append(reinterpret_cast<const char*>(&value), sizeof(TYPE));
+            }
+            static void Append(string& buffer, const string& value)
+            {
+                Append(buffer, static_cast<uint32_t>(value.length()));
+                buffer.append(value);
+            }
+            template <typename TYPE>
+            static bool Extract(const string& buffer, size_t& offset, TYPE& value)
+            {
+                bool result = ((offset + sizeof(TYPE)) <= buffer.length());
+
+                if (result == true) {
+                    ::memcpy(&value, &(buffer[offset]), sizeof(TYPE));
+                    offset += sizeof(TYPE);
+                }
+
+                return (result);
+            }
+            static bool Extract(const string& buffer, size_t& offset, string& value)
+            {
+                uint32_t length = 0;
+                bool result = (Extract(buffer, offset, length) == true) && ((offset + length) <= buffer.length());
+
+                if (result == true) {
+                    value = buffer.substr(offset, length);
+                    offset += length;
+                }
+
+                return (result);
+            }
+
+        private:
+            const string _key;
+            uint64_t _expiry; //!< Ticks, it is fresh till then.
+            uint32_t _contentType;
+            string _contentEncoding;
+            string _cacheControl;
+            string _eTag;
+            uint64_t _modified; //!< Ticks, 0 if the server did not send it.
+            string _body;
+        };
+
+    private:
+        struct Node {
+            Core::ProxyType<Entry> Content;
+            std::list<string>::iterator Position;
+        };
+        // On disk, a file is named after the hash of the key, a key with the same hash overwrites it.
+        struct Stored {
+            string Key;
+            uint32_t Size;
+            std::list<uint64_t>::iterator Position;
+        };
+
+        typedef std::unordered_map<string, Node> EntryMap;
+        typedef std::unordered_map<uint64_t, Stored> StoredMap;
+
+    public:
+        ProxyCache()
+            : _capacity(0)
+            , _maxEntrySize(0)
+            , _size(0)
+            , _entries()
+            , _lru()
+            , _directory()
+            , _diskCapacity(0)
+            , _diskSize(0)
+            , _stored()
+            , _diskLru()
+        {
+        }
+        ~ProxyCache()
+        {
+        }
+
+    public:
+        inline bool IsEnabled() const
+        {
+            return (_capacity != 0);
+        }
+        // Sizes in bytes, a capacity of 0 disables the cache, a disk capacity of 0 keeps it in memory only.
+        // A response larger than an eighth of the memory is not kept.
+        void Open(const uint32_t capacity, const string& directory, const uint32_t diskCapacity)
+        {
+            _capacity = capacity;
+            _maxEntrySize = capacity / 8;
+
+#ifndef __WIN32__
+            if ((capacity != 0) && (diskCapacity != 0)) {
+                _directory = Core::Directory::Normalize(directory);
+
+                if ((Core::Directory(_directory.c_str()).CreatePath() == true) || (::access(_directory.c_str(), W_OK) == 0)) {
+                    _diskCapacity = diskCapacity;
+
+                    // What is left from a previous run is not indexed, start clean.
+                    Core::Directory leftovers(_directory.c_str(), _T("*.cache"));
+
+                    while (leftovers.Next() == true) {
+                        ::unlink(leftovers.Current().c_str());
+                    }
+                }
+                else {
+                    TRACE_L1("Could not create proxy cache %s, it is kept in memory only.", _directory.c_str());
+                    _directory.clear();
+                }
+            }
+#else
+            // The disk part is only used if it was opened, here it never is.
+            if ((capacity != 0) && (diskCapacity != 0)) {
+                TRACE_L1("The proxy cache is kept in memory only on this platform, %s is not used.", directory.c_str());
+            }
+#endif
+        }
+
+        Core::ProxyType<Entry> Find(const string& key)
+        {
+            Core::ProxyType<Entry> result;
+            EntryMap::iterator index(_entries.find(key));
+
+            if (index != _entries.end()) {
+                result = index->second.Content;
+                _lru.splice(_lru.begin(), _lru, index->second.Position);
+            }
+            else if (_diskCapacity != 0) {
+                StoredMap::iterator stored(_stored.find(Hash(key)));
+
+                if ((stored != _stored.end()) && (stored->second.Key == key)) {
+                    // Back to memory, it is used again.
+                    result = Load(key);
+                    Drop(stored);
+
+                    if (result.IsValid() == true) {
+                        Insert(result);
+                    }
+                }
+            }
+
+            return (result);
+        }
+        void Insert(const Core::ProxyType<Entry>& entry)
+        {
+            const uint32_t cost = entry->Cost();
+
+            Remove(entry->Key());
+
+            if (cost <= _maxEntrySize) {
+                _lru.push_front(entry->Key());
+
+                Node node = { entry, _lru.begin() };
+                _entries.insert(std::pair<string, Node>(entry->Key(), node));
+                _size += cost;
+
+                while (_size > _capacity) {
+                    Evict();
+                }
+            }
+        }
+        void Remove(const string& key)
+        {
+            EntryMap::iterator index(_entries.find(key));
+
+            if (index != _entries.end()) {
+                _size -= index->second.Content->Cost();
+                _lru.erase(index->second.Position);
+                _entries.erase(index);
+            }
+            else if (_diskCapacity != 0) {
+                StoredMap::iterator stored(_stored.find(Hash(key)));
+
+                if ((stored != _stored.end()) && (stored->second.Key == key)) {
+                    Drop(stored);
+                }
+            }
+        }
+
+        // What the client allows: it may not be answered from the cache if it asks for no-cache, or if it sent
+        // credentials, the response then depends on who asks. With no-store, the response may not be kept either.
+        static bool Reusable(const Web::Request& request, bool& store)
+        {
+            bool result = (request.WebToken.IsSet() == false);
+
+            store = true;
+
+            if (request.CacheControl.IsSet() == true) {
+                const string& directives(request.CacheControl.Value());
+
+                store = (Directive(directives, _T("no-store"), nullptr) == false);
+                result = (result == true) && (store == true) && (Directive(directives, _T("no-cache"), nullptr) == false);
+            }
+            else if (request.Pragma.IsSet() == true) {
+                // Only for HTTP/1.0 clients, Cache-Control takes precedence.
+                result = (result == true) && (Directive(request.Pragma.Value(), _T("no-cache"), nullptr) == false);
+            }
+
+            return (result);
+        }
+        // Till when a response may be served without asking the server. Returns false if it may not be kept:
+        // the server does not want it to be kept by a shared cache, it differs per client (Vary), or it is stale
+        // at once and can not be revalidated. The response to a request with credentials is only kept if the
+        // server says a shared cache may (public, s-maxage or must-revalidate).
+        static bool Freshness(const Web::Response& response, const bool authorized, const uint64_t now, uint64_t& expiry)
+        {
+            bool result = ((response.Vary.IsSet() == false) && ((authorized == false) || (response.CacheControl.IsSet() == true)));
+            bool explicitly = false;
+
+            expiry = now;
+
+            if ((result == true) && (response.CacheControl.IsSet() == true)) {
+                const string& directives(response.CacheControl.Value());
+                uint32_t seconds = 0;
+
+                const bool shared = ((authorized == false) || (Directive(directives, _T("public"), nullptr) == true) || (Directive(directives, _T("s-maxage"), &seconds) == true) || (Directive(directives, _T("must-revalidate"), nullptr) == true));
+
+                if ((shared == false) || (Directive(directives, _T("no-store"), nullptr) == true) || (Directive(directives, _T("private"), nullptr) == true)) {
+                    result = false;
+                }
+                else if (Directive(directives, _T("no-cache"), nullptr) == true) {
+                    explicitly = true;
+                }
+                else if ((Directive(directives, _T("s-maxage"), &seconds) == true) || (Directive(directives, _T("max-age"), &seconds) == true)) {
+                    expiry = now + (static_cast<uint64_t>(seconds) * 1000000);
+                    explicitly = true;
+                }
+            }
+
+            if ((result == true) && (explicitly == false)) {
+                if (response.Expires.IsSet() == true) {
+                    expiry = std::max(now, response.Expires.Value().Ticks());
+                }
+                else if ((response.Modified.IsSet() == true) && (response.Modified.Value().Ticks() < now)) {
+                    // No word from the server, a tenth of the time since it last changed.
+                    const uint64_t age = (now - response.Modified.Value().Ticks()) / 10;
+
+                    expiry = now + (age < MaxHeuristic ? age : MaxHeuristic);
+                }
+            }
+
+            return ((result == true) && ((expiry > now) || (response.ETag.IsSet() == true) || (response.Modified.IsSet() == true)));
+        }
+
+    private:
+        // Looks for a Cache-Control directive (case insensitive), and if asked for, its value in seconds.
+        static bool Directive(const string& directives, const TCHAR name[], uint32_t* seconds)
+        {
+            const size_t length = ::strlen(name);
+            bool found = false;
+            size_t start = 0;
+
+            while ((found == false) && (start < directives.length())) {
+                size_t end = directives.find(',', start);
+                const size_t first = directives.find_first_not_of(_T(" \t"), start);
+
+                if ((first != string::npos) && ((end == string::npos) || (first < end)) && (::strncasecmp(&(directives.c_str()[first]), name, length) == 0)) {
+                    const TCHAR next = directives.c_str()[first + length];
+
+                    if (seconds == nullptr) {
+                        found = ((next == '\0') || (next == ',') || (next == ' ') || (next == '\t') || (next == '='));
+                    }
+                    else if (next == '=') {
+                        const TCHAR* value = &(directives.c_str()[first + length + 1]);
+
+                        *seconds = static_cast<uint32_t>(::strtoul(value + (*value == '"' ? 1 : 0), nullptr, 10));
+                        found = true;
+                    }
+                }
+
+                start = (end == string::npos ? end : end + 1);
+            }
+
+            return (found);
+        }
+        static uint64_t Hash(const string& key)
+        {
+            uint64_t hash = 14695981039346656037ULL;
+
+            for (string::const_iterator index(key.begin()); index != key.end(); index++) {
+                hash = (hash ^ static_cast<uint8_t>(*index)) * 1099511628211ULL;
+            }
+
+            return (hash);
+        }
+        string FileName(const uint64_t hash) const
+        {
+            TCHAR buffer[32];
+            ::snprintf(buffer, sizeof(buffer), _T("%016llx.cache"), static_cast<unsigned long long>(hash));
+
+            return (_directory + buffer);
+        }
+        // The least recently used entry goes to disk, if there is a disk tier and it is worth keeping.
+        void Evict()
+        {
+            EntryMap::iterator index(_entries.find(_lru.back()));
+
+            ASSERT(index != _entries.end());
+
+            const Core::ProxyType<Entry> entry(index->second.Content);
+
+            _size -= entry->Cost();
+            _lru.pop_back();
+            _entries.erase(index);
+
+            if ((_diskCapacity != 0) && (entry->Cost() <= _diskCapacity) && ((entry->IsFresh(Core::Time::Now().Ticks()) == true) || (entry->HasValidator() == true))) {
+                Store(*entry);
+            }
+        }
+#ifndef __WIN32__
+        void Store(const Entry& entry)
+        {
+            string buffer;
+            const uint64_t hash = Hash(entry.Key());
+            const string fileName(FileName(hash));
+            const string temporary(fileName + _T(".tmp"));
+
+            entry.Serialize(buffer);
+
+            int handle = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+
+            if (handle != -1) {
+                const bool written = (::write(handle, buffer.data(), buffer.length()) == static_cast<ssize_t>(buffer.length()));
+
+                ::close(handle);
+
+                if ((written == true) && (::rename(temporary.c_str(), fileName.c_str()) == 0)) {
+                    StoredMap::iterator collision(_stored.find(hash));
+
+                    if (collision != _stored.end()) {
+                        _diskSize -= collision->second.Size;
+                        _diskLru.erase(collision->second.Position);
+                        _stored.erase(collision);
+                    }
+
+                    _diskLru.push_front(hash);
+
+                    Stored stored = { entry.Key(), static_cast<uint32_t>(buffer.length()), _diskLru.begin() };
+                    _stored.insert(std::pair<uint64_t, Stored>(hash, stored));
+                    _diskSize += stored.Size;
+
+                    while (_diskSize > _diskCapacity) {
+                        Drop(_stored.find(_diskLru.back()));
+                    }
+                }
+                else {
+                    ::unlink(temporary.c_str());
+                }
+            }
+        }
+        Core::ProxyType<Entry> Load(const string& key)
+        {
+            Core::ProxyType<Entry> result;
+            int handle = ::open(FileName(Hash(key)).c_str(), O_RDONLY | O_CLOEXEC);
+
+            if (handle != -1) {
+                struct stat info;
+
+                if (::fstat(handle, &info) == 0) {
+                    string buffer(static_cast<size_t>(info.st_size), '\0');
+
+                    if ((buffer.empty() == false) && (::read(handle, &(buffer[0]), buffer.length()) == static_cast<ssize_t>(buffer.length()))) {
+                        Core::ProxyType<Entry> entry(Core::ProxyType<Entry>::Create(key));
+
+                        if (entry->Deserialize(buffer) == true) {
+                            result = entry;
+                        }
+                    }
+                }
+
+                ::close(handle);
+            }
+
+            return (result);
+        }
+        void Drop(StoredMap::iterator index)
+        {
+            ASSERT(index != _stored.end());
+
+            ::unlink(FileName(index->first).c_str());
+            _diskSize -= index->second.Size;
+            _diskLru.erase(index->second.Position);
+            _stored.erase(index);
+        }
+#else
+        void Store(const Entry&)
+        {
+        }
+        Core::ProxyType<Entry> Load(const string&)
+        {
+            return (Core::ProxyType<Entry>());
+        }
+        void Drop(StoredMap::iterator)
+        {
+        }
+#endif
+
+    private:
+        uint32_t _capacity;
+        uint32_t _maxEntrySize;
+        uint32_t _size;
+        EntryMap _entries;
+        std::list<string> _lru;
+        string _directory;
+        uint32_t _diskCapacity;
+        uint32_t _diskSize;
+        StoredMap _stored;
+        std::list<uint64_t> _diskLru;
+    };
+}
+}
+
+#endif // __WEBSERVER_PROXYCACHE_H
@@ -1,7 +1,14 @@
 #include "Module.h"
+#include "Compressor.h"
+#include "FileCache.h"
+#include "MappedBody.h"
+#include "ProxyCache.h"
 #include <interfaces/IWebServer.h>
 #include <interfaces/IMemory.h>
 
+#include <memory>
+#include <unordered_map>
+
 namespace WPEFramework {
 namespace Plugin {
 
@@ -82,20 +89,32 @@ namespace Plugin {
                     , Path()
                     , Subst()
                     , Server()
+                    , Connections(1)
+                    , Pipeline(1)
+                    , Timeout(0)
                 {
                     Add(_T("path"), &Path);
                     Add(_T("subst"), &Subst);
                     Add(_T("server"), &Server);
+                    Add(_T("connections"), &Connections);
+                    Add(_T("pipeline"), &Pipeline);
+                    Add(_T("timeout"), &Timeout);
                 }
                 Proxy(const Proxy& copy)
                     : Core::JSON::Container()
                     , Path(copy.Path)
                     , Subst(copy.Subst)
                     , Server(copy.Server)
+                    , Connections(copy.Connections)
+                    , Pipeline(copy.Pipeline)
+                    , Timeout(copy.Timeout)
                 {
                     Add(_T("path"), &Path);
                     Add(_T("subst"), &Subst);
                     Add(_T("server"), &Server);
+                    Add(_T("connections"), &Connections);
+                    Add(_T("pipeline"), &Pipeline);
+                    Add(_T("timeout"), &Timeout);
                 }
                 virtual ~Proxy()
                 {
@@ -105,6 +124,9 @@ namespace Plugin {
                 Core::JSON::String Path;
                 Core::JSON::String Subst;
                 Core::JSON::String Server;
+                Core::JSON::DecUInt8 Connections; // Connections kept to the server.
+                Core::JSON::DecUInt8 Pipeline; // Requests that may be outstanding on a connection, 1 is no pipelining.
+                Core::JSON::DecUInt32 Timeout; // Time in ms to wait for a response, 0 waits forever.
             };
 
         public:
@@ -115,6 +137,16 @@ namespace Plugin {
                 , Interface()
                 , Path(_T("www"))
                 , IdleTime(180)
+                , CacheSize(2048)
+                , CacheFileSize(256)
+                , StatusPath()
+                , Precompressed(true)
+                , CompressionCache()
+                , SendBuffer(1024)
+                , ReceiveBuffer(1024)
+                , MapSize(64)
+                , ProxyCacheSize(0)
+                , ProxyCacheDisk(0)
             {
                 Add(_T("port"), &Port);
                 Add(_T("binding"), &Binding);
@@ -122,6 +154,16 @@ namespace Plugin {
                 Add(_T("path"), &Path);
                 Add(_T("idletime"), &IdleTime);
                 Add(_T("proxies"), &Proxies);
+                Add(_T("cachesize"), &CacheSize);
+                Add(_T("cachefilesize"), &CacheFileSize);
+                Add(_T("statuspath"), &StatusPath);
+                Add(_T("precompressed"), &Precompressed);
+                Add(_T("compressioncache"), &CompressionCache);
+                Add(_T("sendbuffer"), &SendBuffer);
+                Add(_T("receivebuffer"), &ReceiveBuffer);
+                Add(_T("mapsize"), &MapSize);
+                Add(_T("proxycachesize"), &ProxyCacheSize);
+                Add(_T("proxycachedisk"), &ProxyCacheDisk);
             }
             ~Config()
             {
@@ -134,6 +176,166 @@ namespace Plugin {
             Core::JSON::String Path;
             Core::JSON::DecUInt16 IdleTime;
             Core::JSON::ArrayType<Proxy> Proxies;
+            Core::JSON::DecUInt32 CacheSize; // Memory in KB for cached files, 0 disables the cache.
+            Core::JSON::DecUInt32 CacheFileSize; // Size in KB of the largest file that is cached.
+            Core::JSON::String StatusPath; // If set, the statistics are served as JSON on this path.
+            Core::JSON::Boolean Precompressed; // Serve <file>.br or <file>.gz if it exists and the client accepts it.
+            Core::JSON::String CompressionCache; // If set, files without a .gz are compressed into this directory.
+            Core::JSON::DecUInt16 SendBuffer; // Size in bytes of the send buffer of a connection.
+            Core::JSON::DecUInt16 ReceiveBuffer; // Size in bytes of the receive buffer of a connection.
+            Core::JSON::DecUInt32 MapSize; // Size in KB from which files are sent from a memory mapping, 0 never maps.
+            Core::JSON::DecUInt32 ProxyCacheSize; // Memory in KB for proxied responses, 0 disables the proxy cache.
+            Core::JSON::DecUInt32 ProxyCacheDisk; // Disk space in KB, in the persistent path, for responses that do not fit in memory.
+        };
+
+        class Statistics : public Core::JSON::Container {
+        private:
+            Statistics(const Statistics&) = delete;
+            Statistics& operator=(const Statistics&) = delete;
+
+        public:
+            class CacheData : public Core::JSON::Container {
+            private:
+                CacheData(const CacheData&) = delete;
+                CacheData& operator=(const CacheData&) = delete;
+
+            public:
+                CacheData()
+                    : Core::JSON::Container()
+                    , Hits(0)
+                    , Misses(0)
+                    , HitRate(0)
+                    , NotModified(0)
+                    , Served(0)
+                    , Entries(0)
+                    , Size(0)
+                {
+                    Add(_T("hits"), &Hits);
+                    Add(_T("misses"), &Misses);
+                    Add(_T("hitrate"), &HitRate);
+                    Add(_T("notmodified"), &NotModified);
+                    Add(_T("served"), &Served);
+                    Add(_T("entries"), &Entries);
+                    Add(_T("size"), &Size);
+                }
+                ~CacheData()
+                {
+                }
+
+            public:
+                void Set(const FileCache::Statistics& info)
+                {
+                    const uint32_t lookups = info.Hits + info.Misses;
+
+                    Hits = info.Hits;
+                    Misses = info.Misses;
+                    HitRate = static_cast<uint8_t>(lookups == 0 ? 0 : (static_cast<uint64_t>(info.Hits) * 100) / lookups);
+                    NotModified = info.NotModified;
+                    Served = info.Served;
+                    Entries = info.Entries;
+                    Size = info.Size;
+                }
+
+            public:
+                Core::JSON::DecUInt32 Hits;
+                Core::JSON::DecUInt32 Misses;
+                Core::JSON::DecUInt8 HitRate; // Percentage of the lookups served from memory.
+                Core::JSON::DecUInt32 NotModified;
+                Core::JSON::DecUInt64 Served; // Bytes served from memory.
+                Core::JSON::DecUInt32 Entries;
+                Core::JSON::DecUInt32 Size;
+            };
+
+            class CompressionData : public Core::JSON::Container {
+            private:
+                CompressionData(const CompressionData&) = delete;
+                CompressionData& operator=(const CompressionData&) = delete;
+
+            public:
+                CompressionData()
+                    : Core::JSON::Container()
+                    , Encoded(0)
+                    , Compressed(0)
+                    , Failed(0)
+                {
+                    Add(_T("encoded"), &Encoded);
+                    Add(_T("compressed"), &Compressed);
+                    Add(_T("failed"), &Failed);
+                }
+                ~CompressionData()
+                {
+                }
+
+            public:
+                Core::JSON::DecUInt32 Encoded; // Responses sent with a content encoding.
+                Core::JSON::DecUInt32 Compressed; // Files compressed into the compression cache.
+                Core::JSON::DecUInt32 Failed;
+            };
+
+            class ProxyData : public Core::JSON::Container {
+            private:
+                ProxyData& operator=(const ProxyData&) = delete;
+
+            public:
+                ProxyData()
+                    : Core::JSON::Container()
+                    , Path()
+                    , Hits(0)
+                    , Misses(0)
+                    , Revalidated(0)
+                    , Stored(0)
+                {
+                    Add(_T("path"), &Path);
+                    Add(_T("hits"), &Hits);
+                    Add(_T("misses"), &Misses);
+                    Add(_T("revalidated"), &Revalidated);
+                    Add(_T("stored"), &Stored);
+                }
+                ProxyData(const ProxyData& copy)
+                    : Core::JSON::Container()
+                    , Path(copy.Path)
+                    , Hits(copy.Hits)
+                    , Misses(copy.Misses)
+                    , Revalidated(copy.Revalidated)
+                    , Stored(copy.Stored)
+                {
+                    Add(_T("path"), &Path);
+                    Add(_T("hits"), &Hits);
+                    Add(_T("misses"), &Misses);
+                    Add(_T("revalidated"), &Revalidated);
+                    Add(_T("stored"), &Stored);
+                }
+                ~ProxyData()
+                {
+                }
+
+            public:
+                Core::JSON::String Path;
+                Core::JSON::DecUInt32 Hits; // Answered from the cache, without asking the server.
+                Core::JSON::DecUInt32 Misses;
+                Core::JSON::DecUInt32 Revalidated; // Answered from the cache, after the server said it did not change.
+                Core::JSON::DecUInt32 Stored;
+            };
+
+        public:
+            Statistics()
+                : Core::JSON::Container()
+                , Cache()
+                , Compression()
+                , Proxies()
+            {
+                Add(_T("cache"), &Cache);
+                Add(_T("compression"), &Compression);
+                Add(_T("proxies"), &Proxies);
+            }
+            ~Statistics()
+            {
+            }
+
+        public:
+            CacheData Cache;
+            CompressionData Compression;
+            Core::JSON::ArrayType<ProxyData> Proxies;
         };
 
         class RequestFactory {
@@ -179,90 +381,581 @@ namespace Plugin {
         };
 
         // IMPORTANT NOTE:
-        // There is no need to lock/unlock usage on this server as all action->response senarious take place on
-        // the communication thread from the SoketPortMonitor. There is only 1 such thread per process.
-        // Given this, make sure that all actions done by the ProxyMap are deterministic and short <100ms as it
-        // upholds all other network traffic.
+        // Requests are relayed and responses come in on the communication thread from the SocketPortMonitor. The
+        // timeouts are checked from a timer thread and proxies can be added or removed through the interface, so
+        // the ProxyMap is guarded by a lock. Make sure that all actions done under it are deterministic and
+        // short <100ms as it upholds all other network traffic.
         class ProxyMap {
         private:
+            static constexpr uint32_t TimeoutResolution = 100; // ms
+
+            class Route;
+
+            struct OutstandingMessage {
+                Core::ProxyType<Web::Request> Request; //!< Released once it is sent.
+                uint32_t Id;
+                uint64_t Deadline; //!< 0 if it does not time out.
+                bool Idempotent;
+                bool Authorized; //!< The request came with credentials.
+                string Key; //!< Set if the response can be cached.
+                Core::ProxyType<ProxyCache::Entry> Stale; //!< Set if the request asks the server to revalidate it.
+            };
+            struct Failure {
+                uint32_t Id;
+                bool TimedOut;
+            };
+
+            // One connection to the upstream server. Responses come back in the order the requests were sent.
             class OutgoingChannel : public Web::WebLinkType<Core::SocketStream, Web::Response, Web::Request, ResponseFactory> {
             private:
                 OutgoingChannel() = delete;
                 OutgoingChannel(const OutgoingChannel&) = delete;
                 OutgoingChannel& operator=(const OutgoingChannel&) = delete;
 
-                struct OutstandingMessage {
-                    Core::ProxyType<Web::Request> Request;
-                    uint32_t Id;
-                };
-
             public:
-                OutgoingChannel(const string& path, const string& replacement, ProxyMap& proxyMap, const Core::NodeId& remoteId)
+                OutgoingChannel(Route& route, const Core::NodeId& remoteId)
                     : Web::WebLinkType<Core::SocketStream, Web::Response, Web::Request, ResponseFactory>(2, false, remoteId.AnyInterface(), remoteId, 1024, 1024)
-                    , _path(path)
-                    , _replacement(replacement)
+                    , _route(route)
                     , _outstandingMessages()
-                    , _proxyMap(proxyMap)
+                    , _connecting(false)
+                    , _closing(false)
                 {
                 }
 
-                void ProxyRequest(Core::ProxyType<Web::Request>& request, uint32_t id)
+            public:
+                // All methods below are only called while holding the ProxyMap lock.
+                inline uint32_t Outstanding() const
+                {
+                    return (static_cast<uint32_t>(_outstandingMessages.size()));
+                }
+                inline bool IsClosing() const
+                {
+                    return (_closing);
+                }
+                void ProxyRequest(const OutstandingMessage& message)
                 {
+                    _outstandingMessages.push_back(message);
 
-                    OutstandingMessage message = { request, id };
+                    if (IsOpen() == true) {
+                        Submit(_outstandingMessages.back().Request);
+                    }
+                    else if (_connecting == false) {
+                        _connecting = true;
+                        Open(0);
+                    }
+                }
+                bool IsExpired(const uint64_t now) const
+                {
+                    std::list<OutstandingMessage>::const_iterator index(_outstandingMessages.begin());
 
-                    _outstandingMessages.push_back(message);
+                    while ((index != _outstandingMessages.end()) && ((index->Deadline == 0) || (index->Deadline > now))) {
+                        index++;
+                    }
 
-                    if (_outstandingMessages.size() == 1) {
-                        if (IsOpen() == false) {
-                            Open(0);
+                    return (index != _outstandingMessages.end());
+                }
+                // Gives up on everything that is outstanding. What was not sent yet can go to another connection,
+                // if it is safe to repeat, the rest is answered with an error.
+                void Abort(const uint64_t now, std::list<Failure>& failures, std::list<OutstandingMessage>& requeue)
+                {
+                    std::list<OutstandingMessage>::iterator index(_outstandingMessages.begin());
+
+                    while (index != _outstandingMessages.end()) {
+                        if ((index->Request.IsValid() == true) && (index->Idempotent == true)) {
+                            requeue.push_back(*index);
                         }
                         else {
-                            Submit(request);
+                            Failure failure = { index->Id, ((index->Deadline != 0) && (index->Deadline <= now)) };
+                            failures.push_back(failure);
                         }
+                        index++;
+                    }
+
+                    _outstandingMessages.clear();
+                }
+                // Nothing is sent over it anymore. Returns true if it still has to be closed, do that without
+                // holding the lock, closing reports back through StateChange().
+                bool Shutdown()
+                {
+                    bool result = (((IsOpen() == true) || (_connecting == true)) && (_closing == false));
+
+                    if (result == true) {
+                        _closing = true;
+                    }
+
+                    return (result);
+                }
+
+            public:
+                virtual void LinkBody(Core::ProxyType<Web::Response>& response)
+                {
+                    response->Body(_textBodies.Element());
+                }
+                virtual void Send(const Core::ProxyType<Web::Request>& request);
+                // Whenever there is a state change on the link, it is reported here.
+                virtual void StateChange();
+                virtual void Received(Core::ProxyType<Web::Response>& response);
+
+            private:
+                Route& _route;
+                std::list<OutstandingMessage> _outstandingMessages;
+                bool _connecting;
+                bool _closing;
+            };
+
+            // A proxied path, served by a pool of connections to the upstream server. A request goes to the
+            // connection with the least outstanding requests. Only if all connections are busy, and pipelining is
+            // enabled, a GET or HEAD is queued behind the requests on a connection. Otherwise it waits here.
+            class Route {
+            private:
+                Route() = delete;
+                Route(const Route&) = delete;
+                Route& operator=(const Route&) = delete;
+
+            public:
+                Route(ProxyMap& parent, const string& path, const string& replacement, const Core::NodeId& remoteId, const uint8_t connections, const uint8_t depth, const uint32_t timeout)
+                    : _parent(parent)
+                    , _path(path)
+                    , _replacement(replacement)
+                    , _remoteId(remoteId)
+                    , _connections(std::max(connections, static_cast<uint8_t>(1)))
+                    , _depth(std::max(depth, static_cast<uint8_t>(1)))
+                    , _timeout(timeout)
+                    , _channels()
+                    , _waiting()
+                    , _closed(false)
+                    , _hits(0)
+                    , _misses(0)
+                    , _revalidated(0)
+                    , _stored(0)
+                {
+                }
+                ~Route()
+                {
+                    std::vector<OutgoingChannel*> channels;
+                    std::list<Failure> failures;
+
+                    // Closing a channel reports back here, make sure nothing is relayed anymore.
+                    _parent.Lock();
+                    _closed = true;
+                    channels.swap(_channels);
+                    _parent.Unlock();
+
+                    std::vector<OutgoingChannel*>::iterator index(channels.begin());
+
+                    // What was outstanding on a channel that can be repeated, is put back in the waiting list
+                    // when it closes, so first the channels are gone, then everything left is answered.
+                    while (index != channels.end()) {
+                        (*index)->Close(Core::infinite);
+                        delete (*index);
+                        index++;
                     }
+
+                    _parent.Lock();
+
+                    for (std::list<OutstandingMessage>::const_iterator message(_waiting.begin()); message != _waiting.end(); message++) {
+                        Failure failure = { message->Id, false };
+                        failures.push_back(failure);
+                    }
+                    _waiting.clear();
+
+                    _parent.Unlock();
+
+                    _parent.Report(failures);
                 }
 
             public:
+                inline ProxyMap& Parent()
+                {
+                    return (_parent);
+                }
                 inline const string& Path() const
                 {
                     return (_path);
                 }
-                virtual void LinkBody(Core::ProxyType<Web::Response>& response)
+                inline const string& Replacement() const
                 {
-                    response->Body(_textBodies.Element());
+                    return (_replacement);
                 }
-                virtual void Send(const Core::ProxyType<Web::Request>& request)
+                // All methods below are only called while holding the ProxyMap lock.
+                // Returns false if the route was removed in the mean time. If the request is answered from the
+                // cache, the answer is in cached.
+                bool Relay(Core::ProxyType<Web::Request>& request, const uint32_t id, Core::ProxyType<Web::Response>& cached)
                 {
-                    std::list<OutstandingMessage>::iterator index(_outstandingMessages.begin());
+                    if (_closed == false) {
+                        OutstandingMessage message = { request, id, 0, ((request->Verb == Web::Request::HTTP_GET) || (request->Verb == Web::Request::HTTP_HEAD)), (request->WebToken.IsSet() == true), string(), Core::ProxyType<ProxyCache::Entry>() };
+                        ProxyCache& cache(_parent._cache);
+                        bool store = false;
+                        const bool reusable = ProxyCache::Reusable(*request, store);
+
+                        // A client that sends conditions of its own, gets an answer to those from the server.
+                        if ((cache.IsEnabled() == true) && (store == true) && (request->Verb == Web::Request::HTTP_GET) && (request->IfNoneMatch.IsSet() == false) && (request->IfModifiedSince.IsSet() == false)) {
+                            message.Key = _path + '\n' + request->Path + (request->Query.IsSet() == true ? '?' + request->Query.Value() : string());
+
+                            Core::ProxyType<ProxyCache::Entry> entry(reusable == true ? cache.Find(message.Key) : Core::ProxyType<ProxyCache::Entry>());
+
+                            if (entry.IsValid() == false) {
+                                _misses++;
+                            }
+                            else if (entry->IsFresh(Core::Time::Now().Ticks()) == true) {
+                                cached = _parent.Response(*entry);
+                                _hits++;
+                            }
+                            else {
+                                entry->Revalidate(*request);
+                                message.Stale = entry;
+                            }
+                        }
 
-                    while ((index != _outstandingMessages.end()) && (index->Request.IsValid() == false)) {
-                        index++;
+                        if (cached.IsValid() == false) {
+                            if (_timeout != 0) {
+                                message.Deadline = Core::Time::Now().Add(_timeout).Ticks();
+                                _parent.Schedule();
+                            }
+
+                            _waiting.push_back(message);
+
+                            Dispatch();
+                        }
                     }
 
-                    ASSERT(index != _outstandingMessages.end());
-                    ASSERT(index->Request == request);
+                    return (_closed == false);
+                }
+                // The response to a relayed request, keeps it if it can be cached. Returns what to send to the client.
+                Core::ProxyType<Web::Response> Completed(const OutstandingMessage& message, const Core::ProxyType<Web::Response>& response)
+                {
+                    Core::ProxyType<Web::Response> result(response);
+
+                    if (message.Key.empty() == false) {
+                        ProxyCache& cache(_parent._cache);
+                        const uint64_t now = Core::Time::Now().Ticks();
+                        uint64_t expiry = now;
+
+                        if ((message.Stale.IsValid() == true) && (response->ErrorCode == Web::STATUS_NOT_MODIFIED)) {
+                            // It did not change, it is fresh again for as long as the server says now.
+                            message.Stale->Expiry(ProxyCache::Freshness(*response, message.Authorized, now, expiry) == true ? expiry : now);
+                            cache.Insert(message.Stale);
+                            result = _parent.Response(*message.Stale);
+                            _revalidated++;
+                        }
+                        else {
+                            if (message.Stale.IsValid() == true) {
+                                _misses++;
+                            }
+
+                            if ((response->ErrorCode == Web::STATUS_OK) && (ProxyCache::Freshness(*response, message.Authorized, now, expiry) == true)) {
+                                cache.Insert(Core::ProxyType<ProxyCache::Entry>::Create(message.Key, *response, expiry));
+                                _stored++;
+                            }
+                            else {
+                                cache.Remove(message.Key);
+                            }
+                        }
+                    }
 
-                    index->Request.Release();
+                    return (result);
                 }
-                // Whenever there is a state change on the link, it is reported here.
-                virtual void StateChange()
+                void Snapshot(Statistics::ProxyData& data) const
                 {
-                    if (IsOpen() == true) {
+                    data.Path = _path;
+                    data.Hits = _hits;
+                    data.Misses = _misses;
+                    data.Revalidated = _revalidated;
+                    data.Stored = _stored;
+                }
+                void Dispatch()
+                {
+                    OutgoingChannel* channel = nullptr;
 
-                        if (!_outstandingMessages.empty()) {
-                            Submit(_outstandingMessages.front().Request);
+                    while ((_closed == false) && (_waiting.empty() == false) && ((channel = Select(_waiting.front().Idempotent)) != nullptr)) {
+                        channel->ProxyRequest(_waiting.front());
+                        _waiting.pop_front();
+                    }
+                }
+                void Requeue(std::list<OutstandingMessage>& messages)
+                {
+                    // They came in before anything that is waiting.
+                    _waiting.splice(_waiting.begin(), messages);
+                }
+                // Connections with an expired request are closed, nothing that is queued behind it can be answered
+                // anymore. They are added to closing, to be closed once the lock is released. Returns true if there
+                // are still requests that can time out.
+                bool Expired(const uint64_t now, std::list<Failure>& failures, std::list<OutgoingChannel*>& closing)
+                {
+                    std::list<OutstandingMessage> requeue;
+                    bool result = false;
+
+                    for (uint32_t index = 0; index < _channels.size(); index++) {
+                        OutgoingChannel& channel(*_channels[index]);
+
+                        if (channel.IsExpired(now) == true) {
+                            channel.Abort(now, failures, requeue);
+
+                            if (channel.Shutdown() == true) {
+                                closing.push_back(&channel);
+                            }
                         }
+                        result = result || (channel.Outstanding() != 0);
+                    }
+
+                    std::list<OutstandingMessage>::iterator index(_waiting.begin());
+
+                    while (index != _waiting.end()) {
+                        if ((index->Deadline != 0) && (index->Deadline <= now)) {
+                            Failure failure = { index->Id, true };
+                            failures.push_back(failure);
+                            index = _waiting.erase(index);
+                        }
+                        else {
+                            index++;
+                        }
+                    }
+
+                    Requeue(requeue);
+                    Dispatch();
+
+                    return ((_timeout != 0) && ((result == true) || (_waiting.empty() == false)));
+                }
+                // Nothing will be relayed anymore, answer everything that is waiting or outstanding.
+                void Abandon(std::list<Failure>& failures)
+                {
+                    std::list<OutstandingMessage> requeue;
+
+                    for (std::vector<OutgoingChannel*>::iterator index(_channels.begin()); index != _channels.end(); index++) {
+                        (*index)->Abort(0, failures, requeue);
+                    }
+
+                    requeue.splice(requeue.end(), _waiting);
+                    _closed = true;
+
+                    for (std::list<OutstandingMessage>::const_iterator index(requeue.begin()); index != requeue.end(); index++) {
+                        Failure failure = { index->Id, false };
+                        failures.push_back(failure);
                     }
                 }
-                virtual void Received(Core::ProxyType<Web::Response>& response);
 
             private:
+                OutgoingChannel* Select(const bool pipelined)
+                {
+                    OutgoingChannel* result = nullptr;
+
+                    for (std::vector<OutgoingChannel*>::iterator index(_channels.begin()); index != _channels.end(); index++) {
+                        if (((*index)->IsClosing() == false) && ((result == nullptr) || ((*index)->Outstanding() < result->Outstanding()))) {
+                            result = *index;
+                        }
+                    }
+
+                    if ((result == nullptr) || (result->Outstanding() != 0)) {
+                        if (_channels.size() < _connections) {
+                            result = new OutgoingChannel(*this, _remoteId);
+                            _channels.push_back(result);
+                        }
+                        else if ((result != nullptr) && ((pipelined == false) || (result->Outstanding() >= _depth))) {
+                            result = nullptr;
+                        }
+                    }
+
+                    return (result);
+                }
+
+            private:
+                ProxyMap& _parent;
                 const string _path;
                 const string _replacement;
+                const Core::NodeId _remoteId;
+                const uint8_t _connections;
+                const uint8_t _depth; //!< Requests that may be outstanding on a connection, 1 is no pipelining.
+                const uint32_t _timeout; //!< ms, 0 is no timeout.
+                std::vector<OutgoingChannel*> _channels;
+                std::list<OutstandingMessage> _waiting;
+                bool _closed;
+                uint32_t _hits;
+                uint32_t _misses;
+                uint32_t _revalidated;
+                uint32_t _stored;
+            };
 
-                std::list<OutstandingMessage> _outstandingMessages;
-                ProxyMap& _proxyMap;
+            // The routes in a path trie, compressed so a chain of segments without a route of its own is one edge.
+            // Finding the route for a path takes one pass over its segments and gives the longest route that
+            // matches on segment boundaries. A table never changes once it is built, a change in the routes
+            // builds a new one, so it can be searched without holding the ProxyMap lock. The routes it points to
+            // are only valid while it is the current table.
+            class RouteTable {
+            private:
+                RouteTable() = delete;
+                RouteTable(const RouteTable&) = delete;
+                RouteTable& operator=(const RouteTable&) = delete;
+
+                struct Node {
+                    std::vector<string> Label; //!< Segments on the edge from the parent.
+                    Route* Target;
+                    std::unordered_map<string, uint32_t> Children; //!< On the first segment of their label.
+                };
+
+            public:
+                RouteTable(const std::list<Route*>& routes)
+                    : _nodes(1)
+                {
+                    _nodes[0].Target = nullptr;
+
+                    for (std::list<Route*>::const_iterator index(routes.begin()); index != routes.end(); index++) {
+                        Insert(*index);
+                    }
+                }
+                ~RouteTable()
+                {
+                }
+
+            public:
+                // Returns the route, and how much of the path it matched.
+                Route* Find(const string& path, size_t& matched) const
+                {
+                    Route* result = _nodes[0].Target;
+                    uint32_t node = 0;
+                    size_t position = 0;
+                    string segment;
+                    bool found = true;
+
+                    matched = 0;
+
+                    while ((found == true) && (Segment(path, position, segment) == true)) {
+                        std::unordered_map<string, uint32_t>::const_iterator child(_nodes[node].Children.find(segment));
+
+                        found = (child != _nodes[node].Children.end());
+
+                        if (found == true) {
+                            const std::vector<string>& label(_nodes[child->second].Label);
+
+                            for (uint32_t index = 1; (found == true) && (index < label.size()); index++) {
+                                found = (Segment(path, position, segment) == true) && (segment == label[index]);
+                            }
+
+                            if (found == true) {
+                                node = child->second;
+
+                                if (_nodes[node].Target != nullptr) {
+                                    result = _nodes[node].Target;
+                                    matched = position;
+                                }
+                            }
+                        }
+                    }
+
+                    return (result);
+                }
+
+            private:
+                // Empty segments (a double or trailing slash) are skipped.
+                static bool Segment(const string& path, size_t& position, string& segment)
+                {
+                    size_t start = path.find_first_not_of('/', position);
+
+                    if (start != string::npos) {
+                        position = path.find('/', start);
+
+                        if (position == string::npos) {
+                            position = path.length();
+                        }
+                        segment = path.substr(start, position - start);
+                    }
+
+                    return (start != string::npos);
+                }
+                void Insert(Route* route)
+                {
+                    std::vector<string> segments;
+                    size_t position = 0;
+                    string segment;
+                    uint32_t node = 0;
+                    uint32_t offset = 0;
+
+                    while (Segment(route->Path(), position, segment) == true) {
+                        segments.push_back(segment);
+                    }
+
+                    while (offset < segments.size()) {
+                        std::unordered_map<string, uint32_t>::iterator child(_nodes[node].Children.find(segments[offset]));
+
+                        if (child == _nodes[node].Children.end()) {
+                            Node leaf;
+                            leaf.Label.assign(segments.begin() + offset, segments.end());
+                            leaf.Target = nullptr;
+
+                            _nodes[node].Children[segments[offset]] = static_cast<uint32_t>(_nodes.size());
+                            node = static_cast<uint32_t>(_nodes.size());
+                            offset = static_cast<uint32_t>(segments.size());
+                            _nodes.push_back(leaf);
+                        }
+                        else {
+                            uint32_t next = child->second;
+                            uint32_t common = 1;
+
+                            while (((offset + common) < segments.size()) && (common < _nodes[next].Label.size()) && (_nodes[next].Label[common] == segments[offset + common])) {
+                                common++;
+                            }
+
+                            if (common < _nodes[next].Label.size()) {
+                                // The route ends, or goes another way, halfway the edge: split it.
+                                Node split;
+                                split.Label.assign(_nodes[next].Label.begin(), _nodes[next].Label.begin() + common);
+                                split.Target = nullptr;
+                                split.Children[_nodes[next].Label[common]] = next;
+
+                                _nodes[next].Label.erase(_nodes[next].Label.begin(), _nodes[next].Label.begin() + common);
+                                child->second = static_cast<uint32_t>(_nodes.size());
+                                next = child->second;
+                                _nodes.push_back(split);
+                            }
+
+                            node = next;
+                            offset += common;
+                        }
+                    }
+
+                    // The first route on a path wins, as it did before.
+                    if (_nodes[node].Target == nullptr) {
+                        _nodes[node].Target = route;
+                    }
+                }
+
+            private:
+                std::vector<Node> _nodes;
+            };
+
+            class TimeHandler {
+            public:
+                TimeHandler()
+                    : _parent(nullptr)
+                {
+                }
+                TimeHandler(ProxyMap& parent)
+                    : _parent(&parent)
+                {
+                }
+                TimeHandler(const TimeHandler& copy)
+                    : _parent(copy._parent)
+                {
+                }
+                ~TimeHandler()
+                {
+                }
+
+                TimeHandler& operator=(const TimeHandler& RHS)
+                {
+                    _parent = RHS._parent;
+                    return (*this);
+                }
+
+            public:
+                uint64_t Timed(const uint64_t scheduledTime)
+                {
+                    ASSERT(_parent != nullptr);
+
+                    return (_parent->Timed(scheduledTime));
+                }
+
+            private:
+                ProxyMap* _parent;
             };
 
         private:
@@ -273,117 +966,293 @@ namespace Plugin {
         public:
             ProxyMap(ChannelMap& server)
                 : _server(server)
-                , _proxies()
+                , _adminLock()
+                , _closeLock()
+                , _routes()
+                , _table(std::make_shared<const RouteTable>(_routes))
+                , _cache()
+                , _timer(Core::Thread::DefaultStackSize(), _T("ProxyTimeouts"))
+                , _scheduled(false)
+            {
+            }
+            ~ProxyMap()
+            {
+                Destroy();
+            }
+
+        public:
+            void Create(Core::JSON::ArrayType<Config::Proxy>::ConstIterator& index)
+            {
+
+                index.Reset();
+
+                while (index.Next() == true) {
+
+                    const Config::Proxy& proxy(index.Current());
+                    const Core::NodeId address(proxy.Server.Value().c_str());
+
+                    if (address.IsValid() == true) {
+
+                        _adminLock.Lock();
+                        _routes.push_back(new Route(*this, proxy.Path.Value(), proxy.Subst.Value(), address, proxy.Connections.Value(), proxy.Pipeline.Value(), proxy.Timeout.Value()));
+                        Publish();
+                        _adminLock.Unlock();
+                    }
+                }
+            }
+
+            void Destroy()
+            {
+                std::list<Route*> routes;
+
+                // The channels are closed when they are deleted, do that without holding the lock.
+                _adminLock.Lock();
+                routes.swap(_routes);
+                Publish();
+                _adminLock.Unlock();
+
+                _closeLock.Lock();
+
+                while (routes.size() > 0) {
+                    delete routes.front();
+                    routes.pop_front();
+                }
+
+                _closeLock.Unlock();
+            }
+
+            bool Relay(Core::ProxyType<Web::Request>& request, uint32_t channelId)
             {
+                // Searching the table does not take the ProxyMap lock, it is not changed once it is published. Note
+                // that the atomic access to the shared_ptr is not lock free (libstdc++ protects it with a small
+                // pool of mutexes), it is only held for copying the pointer.
+                std::shared_ptr<const RouteTable> table(std::atomic_load(&_table));
+                size_t matched = 0;
+                Route* route = table->Find(request->Path, matched);
+                const bool result = (route != nullptr);
+
+                // If we didn't find relay instructions for this path, return false.
+                if (result == true) {
+                    Core::ProxyType<Web::Response> cached;
+                    bool relayed = false;
+
+                    _adminLock.Lock();
+
+                    // The routes of a replaced table may be gone already, look it up again in the current one.
+                    if (table != _table) {
+                        matched = 0;
+                        route = _table->Find(request->Path, matched);
+                    }
+
+                    if (route != nullptr) {
+                        const string& replacement(route->Replacement());
+
+                        // Without a substitute, the path is relayed as is.
+                        if (replacement.empty() == false) {
+                            string path(replacement);
+
+                            if ((path[path.length() - 1] == '/') && (matched < request->Path.length())) {
+                                path.erase(path.length() - 1);
+                            }
+                            path += request->Path.substr(matched);
+
+                            request->Path = (path.empty() == true ? string(_T("/")) : path);
+                        }
+
+                        relayed = route->Relay(request, channelId, cached);
+                    }
+
+                    _adminLock.Unlock();
+
+                    if (relayed == false) {
+                        // It was removed while we were looking it up.
+                        Failure failure = { channelId, false };
+                        Report(std::list<Failure>(1, failure));
+                    }
+                    else if (cached.IsValid() == true) {
+                        _server.Submit(channelId, cached);
+                    }
+                }
+
+                return (result);
             }
-            ~ProxyMap()
+
+            inline void AddProxy(const string& path, const string& subst, const string& address)
             {
-                // Clean up channels in map.
-                while (_proxies.size() > 0) {
-                    delete _proxies.front();
-                    _proxies.pop_front();
+                const Core::NodeId node(address.c_str());
+
+                if (node.IsValid() == true) {
+
+                    _adminLock.Lock();
+                    _routes.push_back(new Route(*this, path, subst, node, 1, 1, 0));
+                    Publish();
+                    _adminLock.Unlock();
                 }
             }
-
-        public:
-            void Create(Core::JSON::ArrayType<Config::Proxy>::ConstIterator& index)
+            inline void RemoveProxy(const string& path)
             {
+                Route* route = nullptr;
+                std::list<Failure> failures;
 
-                index.Reset();
+                _adminLock.Lock();
 
-                while (index.Next() == true) {
+                std::list<Route*>::iterator index(_routes.begin());
 
-                    const string& path(index.Current().Path.Value());
-                    const string& subst(index.Current().Subst.Value());
-                    const Core::NodeId address(index.Current().Server.Value().c_str());
+                while ((index != _routes.end()) && ((*index)->Path() != path)) {
 
-                    if (address.IsValid() == true) {
+                    index++;
+                }
 
-                        _proxies.push_back(new OutgoingChannel(path, subst, *this, address));
-                    }
+                if (index != _routes.end()) {
+
+                    route = (*index);
+                    route->Abandon(failures);
+                    _routes.erase(index);
+                    Publish();
                 }
-            }
 
-            void Destroy()
-            {
+                _adminLock.Unlock();
 
-                std::list<OutgoingChannel*>::iterator index(_proxies.begin());
+                Report(failures);
 
-                while (index != _proxies.end()) {
+                if (route != nullptr) {
+                    _closeLock.Lock();
+                    delete route;
+                    _closeLock.Unlock();
+                }
+            }
+            inline void Submit(uint32_t channelId, Core::ProxyType<Web::Response>& response)
+            {
+                _server.Submit(channelId, response);
+            }
+            // Sizes in bytes, a capacity of 0 disables the cache.
+            void Cache(const uint32_t capacity, const string& directory, const uint32_t diskCapacity)
+            {
+                _adminLock.Lock();
+                _cache.Open(capacity, directory, diskCapacity);
+                _adminLock.Unlock();
+            }
+            void Snapshot(Statistics& statistics) const
+            {
+                _adminLock.Lock();
 
-                    delete (*index);
+                for (std::list<Route*>::const_iterator index(_routes.begin()); index != _routes.end(); index++) {
+                    Statistics::ProxyData data;
 
-                    index++;
+                    (*index)->Snapshot(data);
+                    statistics.Proxies.Add(data);
                 }
-                _proxies.clear();
+
+                _adminLock.Unlock();
             }
 
-            bool Relay(Core::ProxyType<Web::Request>& request, uint32_t channelId)
+        private:
+            inline void Lock() const
+            {
+                _adminLock.Lock();
+            }
+            inline void Unlock() const
             {
+                _adminLock.Unlock();
+            }
+            Core::ProxyType<Web::Response> Response(const ProxyCache::Entry& entry) const
+            {
+                Core::ProxyType<Web::Response> result(PluginHost::Factories::Instance().Response());
 
-                bool found = false;
-                const string& originalPath = request->Path;
-                std::list<OutgoingChannel*>::iterator index(_proxies.begin());
-                string proxyPath;
+                entry.Fill(*result, _textBodies.Element());
+
+                return (result);
+            }
+            // Builds a new table from the routes, the replaced one is freed by whoever holds on to it last. Only
+            // call this while holding the lock.
+            void Publish()
+            {
+                std::atomic_store(&_table, std::shared_ptr<const RouteTable>(std::make_shared<const RouteTable>(_routes)));
+            }
+            // Only call this while holding the lock.
+            void Schedule()
+            {
+                if (_scheduled == false) {
+                    Core::Time NextTick(Core::Time::Now());
 
-                while ((found == false) && (index != _proxies.end())) {
+                    NextTick.Add(TimeoutResolution);
 
-                    proxyPath = (*index)->Path();
+                    _scheduled = true;
+                    _timer.Schedule(NextTick.Ticks(), TimeHandler(*this));
+                }
+            }
+            // Answers the requests that could not be relayed. Do not call this while holding the lock.
+            void Report(const std::list<Failure>& failures)
+            {
+                std::list<Failure>::const_iterator index(failures.begin());
 
-                    uint32_t checkSize(proxyPath.length());
+                while (index != failures.end()) {
+                    Core::ProxyType<Web::Response> response(PluginHost::Factories::Instance().Response());
 
-                    // If path starts with mapped string, we should relay.
-                    if (((originalPath.length() == checkSize) || ((originalPath.length() > checkSize) && (originalPath[checkSize] == '/'))) && (originalPath.compare(0, checkSize, proxyPath) == 0)) {
-                        found = true;
+                    if (index->TimedOut == true) {
+                        response->ErrorCode = Web::STATUS_GATEWAY_TIMEOUT;
+                        response->Message = _T("Gateway Timeout");
                     }
                     else {
-                        index++;
+                        response->ErrorCode = Web::STATUS_BAD_GATEWAY;
+                        response->Message = _T("Bad Gateway");
                     }
+
+                    _server.Submit(index->Id, response);
+                    index++;
                 }
+            }
+            uint64_t Timed(const uint64_t scheduledTime)
+            {
+                uint64_t result = 0;
+                bool pending = false;
+                std::list<Failure> failures;
+                std::list<OutgoingChannel*> closing;
 
-                // If we didn't find relay instructions for this path, return false.
-                if (found == true) {
+                // A route, and its channels, is not deleted till the expired channels are closed.
+                _closeLock.Lock();
+                _adminLock.Lock();
 
-                    request->Path = (proxyPath + request->Path.substr(proxyPath.length()));
+                const uint64_t now = Core::Time::Now().Ticks();
 
-                    (*index)->ProxyRequest(request, channelId);
+                for (std::list<Route*>::iterator index(_routes.begin()); index != _routes.end(); index++) {
+                    pending = (*index)->Expired(now, failures, closing) || pending;
                 }
 
-                return (found);
-            }
-
-            inline void AddProxy(const string& path, const string& subst, const string& address)
-            {
-                const Core::NodeId node(address.c_str());
+                // Only keep on checking as long as there is something that can time out.
+                _scheduled = pending;
 
-                if (node.IsValid() == true) {
+                _adminLock.Unlock();
 
-                    _proxies.push_back(new OutgoingChannel(path, subst, *this, node));
+                while (closing.size() > 0) {
+                    closing.front()->Close(0);
+                    closing.pop_front();
                 }
-            }
-            inline void RemoveProxy(const string& path)
-            {
-                std::list<OutgoingChannel*>::iterator index(_proxies.begin());
 
-                while ((index != _proxies.end()) && ((*index)->Path() != path)) {
+                _closeLock.Unlock();
 
-                    index++;
-                }
+                Report(failures);
+
+                if (pending == true) {
+                    Core::Time NextTick(Core::Time::Now());
 
-                if (index != _proxies.end()) {
+                    NextTick.Add(TimeoutResolution);
 
-                    delete (*index);
-                    _proxies.erase(index);
+                    result = NextTick.Ticks();
                 }
-            }
-            inline void Submit(uint32_t channelId, Core::ProxyType<Web::Response>& response)
-            {
-                _server.Submit(channelId, response);
+
+                return (result);
             }
 
         private:
             ChannelMap& _server;
-            std::list<OutgoingChannel*> _proxies;
+            mutable Core::CriticalSection _adminLock;
+            Core::CriticalSection _closeLock; //!< Taken before the _adminLock, keeps the routes alive while their channels are closed.
+            std::list<Route*> _routes;
+            std::shared_ptr<const RouteTable> _table;
+            ProxyCache _cache;
+            Core::TimerType<TimeHandler> _timer;
+            bool _scheduled;
         };
 
         class IncomingChannel : public Web::WebLinkType<Core::SocketStream, Web::Request, Web::Response, RequestFactory> {
@@ -392,13 +1261,14 @@ namespace Plugin {
             IncomingChannel(const IncomingChannel& copy) = delete;
             IncomingChannel& operator=(const IncomingChannel&) = delete;
 
+            enum range {
+                WHOLE,
+                PARTIAL,
+                UNSATISFIABLE
+            };
+
         public:
-            IncomingChannel(const SOCKET& connector, const Core::NodeId& remoteId, Core::SocketServerType<IncomingChannel>* parent)
-                : Web::WebLinkType<Core::SocketStream, Web::Request, Web::Response, RequestFactory>(2, false, connector, remoteId, 1024, 1024)
-                , _id(0)
-                , _parent(static_cast<ChannelMap&>(*parent))
-            {
-            }
+            IncomingChannel(const SOCKET& connector, const Core::NodeId& remoteId, Core::SocketServerType<IncomingChannel>* parent);
             virtual ~IncomingChannel()
             {
             }
@@ -426,6 +1296,11 @@ namespace Plugin {
             }
             virtual void Received(Core::ProxyType<Web::Request>& request);
 
+            static bool IsNotModified(const Web::Request& request, const FileCache::Entry& entry);
+            static range Requested(const Web::Request& request, const FileCache::Entry& entry, uint64_t& offset, uint64_t& length);
+            static Core::ProxyType<Web::IBody> Part(const Core::ProxyType<FileCache::Entry>& entry, const uint64_t offset, const uint64_t length);
+            Core::ProxyType<Web::IBody> Content(const string& fileName, const uint64_t size) const;
+
         private:
             friend class Core::SocketServerType<IncomingChannel>;
 
@@ -493,6 +1368,14 @@ namespace Plugin {
                 , _connectionCheckTimer(0)
                 , _cleanupTimer(Core::Thread::DefaultStackSize(), _T("ConnectionChecker"))
                 , _proxyMap(*this)
+                , _fileCache()
+                , _statusPath()
+                , _precompressed(false)
+                , _compressor()
+                , _encoded(0)
+                , _sendBufferSize(1024)
+                , _receiveBufferSize(1024)
+                , _mapSize(0)
             {
             }
 #ifdef __WIN32__
@@ -514,10 +1397,12 @@ namespace Plugin {
 
                 // Cleanup the closed sockets we created..
                 Cleanup();
+
+                _compressor.Terminate();
             }
 
         public:
-            inline uint32_t Configure(const string& prefixPath, const Config& configuration)
+            inline uint32_t Configure(const string& prefixPath, const string& persistentPath, const Config& configuration)
             {
                 Core::NodeId accessor;
                 uint32_t result(Core::ERROR_INCOMPLETE_CONFIG);
@@ -532,6 +1417,22 @@ namespace Plugin {
                 }
 
                 _proxyMap.Create(index);
+                _proxyMap.Cache(configuration.ProxyCacheSize.Value() * 1024, persistentPath + _T("proxycache/"), configuration.ProxyCacheDisk.Value() * 1024);
+
+                _fileCache.Open(configuration.CacheSize.Value() * 1024, configuration.CacheFileSize.Value() * 1024);
+                _statusPath = configuration.StatusPath.Value();
+                _sendBufferSize = std::max(configuration.SendBuffer.Value(), static_cast<uint16_t>(256));
+                _receiveBufferSize = std::max(configuration.ReceiveBuffer.Value(), static_cast<uint16_t>(256));
+                _mapSize = static_cast<uint64_t>(configuration.MapSize.Value()) * 1024;
+
+                // Negotiating the encoding depends on the cache, to know which versions exist without looking.
+                if (_fileCache.IsEnabled() == true) {
+                    _precompressed = configuration.Precompressed.Value();
+
+                    if (configuration.CompressionCache.Value().empty() == false) {
+                        _compressor.Start(configuration.CompressionCache.Value());
+                    }
+                }
 
                 if (configuration.Interface.Value().empty() == false) {
                     Core::NodeId selectedNode = Plugin::Config::IPV4UnicastNode(configuration.Interface.Value());
@@ -599,6 +1500,50 @@ namespace Plugin {
             {
                 return (_accessor);
             }
+            inline FileCache& Cache()
+            {
+                return (_fileCache);
+            }
+            inline bool IsStatusPath(const string& path) const
+            {
+                return ((_statusPath.empty() == false) && (path == _statusPath));
+            }
+            inline uint16_t SendBufferSize() const
+            {
+                return (_sendBufferSize);
+            }
+            inline uint16_t ReceiveBufferSize() const
+            {
+                return (_receiveBufferSize);
+            }
+            inline bool IsMapped(const uint64_t size) const
+            {
+                return ((_mapSize != 0) && (size >= _mapSize));
+            }
+            inline bool IsNegotiating() const
+            {
+                return ((_precompressed == true) || (_compressor.IsEnabled() == true));
+            }
+            inline void Encoded()
+            {
+                _encoded++;
+            }
+            void Status(string& text) const
+            {
+                Statistics statistics;
+                FileCache::Statistics cache;
+
+                _fileCache.Snapshot(cache);
+                statistics.Cache.Set(cache);
+                statistics.Compression.Encoded = _encoded;
+                statistics.Compression.Compressed = _compressor.Compressed();
+                statistics.Compression.Failed = _compressor.Failed();
+
+                _proxyMap.Snapshot(statistics);
+
+                statistics.ToString(text);
+            }
+            Core::ProxyType<FileCache::Entry> Representation(const Web::Request& request, const string& fileName, const TCHAR*& encoding);
             void Close(IncomingChannel& data)
             {
             }
@@ -645,6 +1590,14 @@ namespace Plugin {
             uint32_t _connectionCheckTimer;
             Core::TimerType<TimeHandler> _cleanupTimer;
             ProxyMap _proxyMap;
+            FileCache _fileCache;
+            string _statusPath;
+            bool _precompressed;
+            Compressor _compressor;
+            uint32_t _encoded;
+            uint16_t _sendBufferSize;
+            uint16_t _receiveBufferSize;
+            uint64_t _mapSize;
         };
 
     private:
@@ -669,7 +1622,7 @@ namespace Plugin {
             Config config;
             config.FromString(service->ConfigLine());
 
-            uint32_t result(_channelServer.Configure(service->DataPath(), config));
+            uint32_t result(_channelServer.Configure(service->DataPath(), service->PersistentPath(), config));
 
             if (result == Core::ERROR_NONE) {
 
@@ -746,6 +1699,37 @@ namespace Plugin {
 
     SERVICE_REGISTRATION(WebServerImplementation, 1, 0);
 
+    WebServerImplementation::IncomingChannel::IncomingChannel(const SOCKET& connector, const Core::NodeId& remoteId, Core::SocketServerType<IncomingChannel>* parent)
+        : Web::WebLinkType<Core::SocketStream, Web::Request, Web::Response, RequestFactory>(2, false, connector, remoteId, static_cast<ChannelMap*>(parent)->SendBufferSize(), static_cast<ChannelMap*>(parent)->ReceiveBufferSize())
+        , _id(0)
+        , _parent(static_cast<ChannelMap&>(*parent))
+    {
+    }
+
+    // Large files are sent from a memory mapping, the send buffer is filled from the page cache without a read
+    // for every chunk. Smaller files, or files that can not be mapped, are read through a FileBody.
+    Core::ProxyType<Web::IBody> WebServerImplementation::IncomingChannel::Content(const string& fileName, const uint64_t size) const
+    {
+        Core::ProxyType<Web::IBody> result;
+
+        if (_parent.IsMapped(size) == true) {
+            Core::ProxyType<MappedBody> mappedBody(Core::ProxyType<MappedBody>::Create(fileName));
+
+            if (mappedBody->IsValid() == true) {
+                result = Core::proxy_cast<Web::IBody>(mappedBody);
+            }
+        }
+
+        if (result.IsValid() == false) {
+            Core::ProxyType<Web::FileBody> fileBody(PluginHost::Factories::Instance().FileBody());
+
+            *fileBody = fileName;
+            result = Core::proxy_cast<Web::IBody>(fileBody);
+        }
+
+        return (result);
+    }
+
     /* virtual */ void WebServerImplementation::IncomingChannel::Received(Core::ProxyType<Web::Request>& request)
     {
 
@@ -755,47 +1739,421 @@ namespace Plugin {
         if (_parent.Relay(request, Id()) == false) {
 
             Core::ProxyType<Web::Response> response(PluginHost::Factories::Instance().Response());
-            Core::ProxyType<Web::FileBody> fileBody(PluginHost::Factories::Instance().FileBody());
-
-            // If so, don't deal with it ourselves.
-            Web::MIMETypes result;
-            string fileToService = _parent.PrefixPath();
-
-            if (Web::MIMETypeForFile(request->Path, fileToService, result) == false) {
 
-                string fullPath = fileToService + _T("index.html");
+            if (_parent.IsStatusPath(request->Path) == true) {
+                Core::ProxyType<Web::TextBody> body(_textBodies.Element());
 
-                // No filename gives, be default, we go for the index.html page..
-                *fileBody = fileToService + _T("index.html");
-                response->ContentType = Web::MIME_HTML;
-                response->Body<Web::FileBody>(fileBody);
+                _parent.Status(*body);
+                response->ContentType = Web::MIME_JSON;
+                response->Body<Web::TextBody>(body);
             }
             else {
-                *fileBody = fileToService;
+                // If so, don't deal with it ourselves.
+                Web::MIMETypes result;
+                string fileToService = _parent.PrefixPath();
+
+                if (Web::MIMETypeForFile(request->Path, fileToService, result) == false) {
+                    // No filename gives, be default, we go for the index.html page..
+                    fileToService += _T("index.html");
+                    result = Web::MIME_HTML;
+                }
+
+                FileCache& cache(_parent.Cache());
+                const TCHAR* encoding = nullptr;
+                Core::ProxyType<FileCache::Entry> entry(_parent.Representation(*request, fileToService, encoding));
+
                 response->ContentType = result;
-                response->Body<Web::FileBody>(fileBody);
+
+                if (_parent.IsNegotiating() == true) {
+                    response->Vary = _T("Accept-Encoding");
+                }
+
+#ifndef __WIN32__
+                if (entry.IsValid() == false) {
+                    // Without the cache, the attributes are looked up for every request.
+                    struct stat info;
+
+                    if ((::stat(fileToService.c_str(), &info) == 0) && (S_ISREG(info.st_mode))) {
+                        entry = Core::ProxyType<FileCache::Entry>::Create(fileToService, info);
+                    }
+                }
+#endif
+
+                if ((entry.IsValid() == false) || (entry->Exists() == false)) {
+                    Core::ProxyType<Web::FileBody> fileBody(PluginHost::Factories::Instance().FileBody());
+
+                    *fileBody = fileToService;
+                    response->Body<Web::FileBody>(fileBody);
+                }
+                else {
+                    response->ETag = entry->ETag();
+                    response->Modified = entry->Modified();
+                    response->AcceptRanges = _T("bytes");
+
+                    if (encoding != nullptr) {
+                        response->ContentEncoding = encoding;
+                        _parent.Encoded();
+                    }
+
+                    if (IsNotModified(*request, *entry) == true) {
+                        response->ErrorCode = Web::STATUS_NOT_MODIFIED;
+                        response->Message = _T("Not Modified");
+                        cache.NotModified();
+                    }
+                    else {
+                        uint64_t offset = 0;
+                        uint64_t length = entry->Size();
+                        const range requested = Requested(*request, *entry, offset, length);
+
+                        if (requested == UNSATISFIABLE) {
+                            TCHAR buffer[48];
+                            ::snprintf(buffer, sizeof(buffer), _T("bytes */%llu"), static_cast<unsigned long long>(entry->Size()));
+
+                            response->ErrorCode = Web::STATUS_REQUESTED_RANGE_NOT_SATISFIABLE;
+                            response->Message = _T("Range Not Satisfiable");
+                            response->ContentRange = buffer;
+                        }
+                        else {
+                            Core::ProxyType<Web::IBody> body;
+
+                            if (requested == PARTIAL) {
+                                body = Part(entry, offset, length);
+                            }
+
+                            if (body.IsValid() == true) {
+                                TCHAR buffer[80];
+                                ::snprintf(buffer, sizeof(buffer), _T("bytes %llu-%llu/%llu"), static_cast<unsigned long long>(offset), static_cast<unsigned long long>(offset + length - 1), static_cast<unsigned long long>(entry->Size()));
+
+                                response->ErrorCode = Web::STATUS_PARTIAL_CONTENT;
+                                response->Message = _T("Partial Content");
+                                response->ContentRange = buffer;
+                            }
+                            else if (entry->IsLoaded() == true) {
+                                length = entry->Size();
+                                body = Core::proxy_cast<Web::IBody>(Core::ProxyType<FileCache::Body>::Create(entry));
+                            }
+                            else {
+                                body = Content(entry->FileName(), entry->Size());
+                            }
+
+                            if (entry->IsLoaded() == true) {
+                                cache.Served(static_cast<uint32_t>(length));
+                            }
+
+                            response->Body(body);
+                        }
+                    }
+                }
             }
             Submit(response);
         }
     }
 
+    // The weight (0..1000) the Accept-Encoding header gives to a content coding, 0 if it is not acceptable.
+    static uint16_t Quality(const string& accepted, const TCHAR coding[])
+    {
+        uint16_t result = 0;
+        uint16_t wildcard = 0;
+        bool found = false;
+        size_t start = 0;
+
+        while ((found == false) && (start < accepted.length())) {
+            size_t end = accepted.find(',', start);
+            const string element(accepted.substr(start, (end == string::npos ? string::npos : end - start)));
+            const size_t first = element.find_first_not_of(_T(" \t"));
+            const size_t last = element.find_first_of(_T(" \t;"), first);
+            const string name(first == string::npos ? string() : element.substr(first, (last == string::npos ? string::npos : last - first)));
+            const size_t q = element.find(_T("q="));
+            const uint16_t weight = (q == string::npos ? 1000 : static_cast<uint16_t>(::atof(&(element.c_str()[q + 2])) * 1000));
+
+            if (name == coding) {
+                result = weight;
+                found = true;
+            }
+            else if (name == _T("*")) {
+                wildcard = weight;
+            }
+
+            start = (end == string::npos ? end : end + 1);
+        }
+
+        return (found == true ? result : wildcard);
+    }
+
+    // Only text like files gain from being compressed.
+    static bool IsCompressible(const string& fileName)
+    {
+        static const TCHAR* extensions[] = { _T(".html"), _T(".htm"), _T(".js"), _T(".mjs"), _T(".css"), _T(".json"), _T(".svg"), _T(".txt"), _T(".xml"), _T(".map"), _T(".wasm") };
+        bool result = false;
+        const size_t dot = fileName.rfind('.');
+
+        if ((dot != string::npos) && (fileName.find('/', dot) == string::npos)) {
+            const string extension(fileName.substr(dot));
+
+            for (uint8_t index = 0; (result == false) && (index < (sizeof(extensions) / sizeof(extensions[0]))); index++) {
+                result = (extension == extensions[index]);
+            }
+        }
+
+        return (result);
+    }
+
+    // The version of the file to send: a precompressed sibling (<file>.br, <file>.gz), the compressed version in
+    // the compression cache or the file itself. Files that are not compressed yet are queued for the compressor,
+    // till it is done, the file itself is sent.
+    Core::ProxyType<FileCache::Entry> WebServerImplementation::ChannelMap::Representation(const Web::Request& request, const string& fileName, const TCHAR*& encoding)
+    {
+        static constexpr uint32_t MinimumCompressSize = 1024;
+
+        Core::ProxyType<FileCache::Entry> result;
+
+        encoding = nullptr;
+
+        if ((IsNegotiating() == true) && (request.AcceptEncoding.IsSet() == true)) {
+            const string& accepted(request.AcceptEncoding.Value());
+            const uint16_t brotli = Quality(accepted, _T("br"));
+            const uint16_t gzip = Quality(accepted, _T("gzip"));
+            const TCHAR* codings[2][2] = { { _T("br"), _T(".br") }, { _T("gzip"), _T(".gz") } };
+            const uint8_t order = (brotli >= gzip ? 0 : 1);
+
+            for (uint8_t index = 0; (encoding == nullptr) && (_precompressed == true) && (index < 2); index++) {
+                const uint8_t coding = (order + index) % 2;
+
+                if ((coding == 0 ? brotli : gzip) != 0) {
+                    Core::ProxyType<FileCache::Entry> sibling(_fileCache.Find(fileName + codings[coding][1]));
+
+                    if ((sibling.IsValid() == true) && (sibling->Exists() == true)) {
+                        result = sibling;
+                        encoding = codings[coding][0];
+                    }
+                }
+            }
+
+            if ((encoding == nullptr) && (gzip != 0) && (_compressor.IsEnabled() == true) && (IsCompressible(fileName) == true)) {
+                result = _fileCache.Find(fileName);
+
+                if ((result.IsValid() == true) && (result->Exists() == true) && (result->Size() >= MinimumCompressSize)) {
+                    const string compressed(_compressor.FileName(fileName.substr(_prefixPath.length())));
+                    Core::ProxyType<FileCache::Entry> cached(_fileCache.Find(compressed));
+
+                    if ((cached.IsValid() == true) && (cached->Exists() == true) && (cached->Modified().Ticks() == result->Modified().Ticks())) {
+                        result = cached;
+                        encoding = codings[1][0];
+                    }
+                    else {
+                        _compressor.Submit(fileName, compressed);
+                    }
+                }
+            }
+        }
+
+        if (result.IsValid() == false) {
+            result = _fileCache.Find(fileName);
+        }
+
+        return (result);
+    }
+
+    // If-None-Match takes precedence, If-Modified-Since is only used by clients that have no entity tag.
+    /* static */ bool WebServerImplementation::IncomingChannel::IsNotModified(const Web::Request& request, const FileCache::Entry& entry)
+    {
+        bool result = false;
+
+        if ((request.Verb == Web::Request::HTTP_GET) || (request.Verb == Web::Request::HTTP_HEAD)) {
+            if (request.IfNoneMatch.IsSet() == true) {
+                result = entry.Matches(request.IfNoneMatch.Value());
+            }
+            else if (request.IfModifiedSince.IsSet() == true) {
+                // HTTP dates have a resolution of a second.
+                result = ((entry.Modified().Ticks() / 1000000) <= (request.IfModifiedSince.Value().Ticks() / 1000000));
+            }
+        }
+
+        return (result);
+    }
+
+    // The part of the entry a GET asks for. All requested ranges are sent as the one range that spans them, a
+    // client asking for more than one range has to deal with a single part answer. The Range is ignored if it
+    // can not be parsed, has too many ranges, or If-Range holds another (or no) entity tag.
+    /* static */ WebServerImplementation::IncomingChannel::range WebServerImplementation::IncomingChannel::Requested(const Web::Request& request, const FileCache::Entry& entry, uint64_t& offset, uint64_t& length)
+    {
+        static constexpr uint8_t MaxRanges = 16;
+
+        range result = WHOLE;
+
+        if ((request.Verb == Web::Request::HTTP_GET) && (request.Range.IsSet() == true) && ((request.IfRange.IsSet() == false) || (request.IfRange.Value() == entry.ETag()))) {
+            const string& ranges(request.Range.Value());
+            const uint64_t size = entry.Size();
+            uint64_t first = ~static_cast<uint64_t>(0);
+            uint64_t last = 0;
+            uint8_t count = 0;
+            bool valid = (ranges.compare(0, 6, _T("bytes=")) == 0);
+            size_t start = 6;
+
+            while ((valid == true) && (start < ranges.length())) {
+                size_t end = ranges.find(',', start);
+                const string element(ranges.substr(start, (end == string::npos ? string::npos : end - start)));
+                const size_t dash = element.find('-');
+                const size_t begin = element.find_first_not_of(_T(" \t"));
+                const size_t finish = element.find_last_not_of(_T(" \t"));
+
+                valid = (dash != string::npos) && (++count <= MaxRanges) && (element.find_first_not_of(_T(" \t0123456789-")) == string::npos) && (element.find('-', dash + 1) == string::npos);
+
+                if (valid == true) {
+                    const bool suffix = (begin == dash);
+                    const bool open = (finish == dash);
+                    const uint64_t from = (suffix ? 0 : ::strtoull(&(element.c_str()[begin]), nullptr, 10));
+                    const uint64_t to = (open ? 0 : ::strtoull(&(element.c_str()[dash + 1]), nullptr, 10));
+
+                    if ((suffix == true) && (open == true)) {
+                        valid = false;
+                    }
+                    else if (suffix == true) {
+                        // The last "to" bytes.
+                        if ((to != 0) && (size != 0)) {
+                            first = std::min(first, size - std::min(to, size));
+                            last = std::max(last, size);
+                        }
+                    }
+                    else if ((open == false) && (to < from)) {
+                        valid = false;
+                    }
+                    else if (from < size) {
+                        first = std::min(first, from);
+                        last = std::max(last, (open == true ? size : std::min(to + 1, size)));
+                    }
+                }
+
+                start = (end == string::npos ? end : end + 1);
+            }
+
+            if ((valid == true) && (count > 0)) {
+                if (first >= last) {
+                    result = UNSATISFIABLE;
+                }
+                else if ((first != 0) || (last != size)) {
+                    offset = first;
+                    length = last - first;
+                    result = PARTIAL;
+                }
+            }
+        }
+
+        return (result);
+    }
+
+    // Files on disk are mapped to get to the part, if that is not possible, the whole file is sent.
+    /* static */ Core::ProxyType<Web::IBody> WebServerImplementation::IncomingChannel::Part(const Core::ProxyType<FileCache::Entry>& entry, const uint64_t offset, const uint64_t length)
+    {
+        Core::ProxyType<Web::IBody> result;
+
+        if (entry->IsLoaded() == true) {
+            result = Core::proxy_cast<Web::IBody>(Core::ProxyType<FileCache::Body>::Create(entry, static_cast<uint32_t>(offset), static_cast<uint32_t>(length)));
+        }
+        else {
+            Core::ProxyType<MappedBody> mappedBody(Core::ProxyType<MappedBody>::Create(entry->FileName(), offset, length));
+
+            if ((mappedBody->IsValid() == true) && (mappedBody->Length() == length)) {
+                result = Core::proxy_cast<Web::IBody>(mappedBody);
+            }
+        }
+
+        return (result);
+    }
+
+    /* virtual */ void WebServerImplementation::ProxyMap::OutgoingChannel::Send(const Core::ProxyType<Web::Request>& request)
+    {
+        ProxyMap& parent(_route.Parent());
+
+        parent.Lock();
+
+        std::list<OutstandingMessage>::iterator index(_outstandingMessages.begin());
+
+        while ((index != _outstandingMessages.end()) && (index->Request.IsValid() == false)) {
+            index++;
+        }
+
+        // It might have timed out, while it was being sent.
+        if ((index != _outstandingMessages.end()) && (index->Request == request)) {
+            index->Request.Release();
+        }
+
+        parent.Unlock();
+    }
+
+    /* virtual */ void WebServerImplementation::ProxyMap::OutgoingChannel::StateChange()
+    {
+        ProxyMap& parent(_route.Parent());
+        std::list<Failure> failures;
+
+        parent.Lock();
+
+        // Closed before it was ever opened, the server can not be reached.
+        const bool unreachable = _connecting;
+
+        _connecting = false;
+
+        if (IsOpen() == true) {
+            std::list<OutstandingMessage>::iterator index(_outstandingMessages.begin());
+
+            // Everything that was handed to us while connecting.
+            while (index != _outstandingMessages.end()) {
+                if (index->Request.IsValid() == true) {
+                    Submit(index->Request);
+                }
+                index++;
+            }
+        }
+        else {
+            std::list<OutstandingMessage> requeue;
+
+            _closing = false;
+
+            Abort(0, failures, requeue);
+
+            if (unreachable == true) {
+                // Trying again right away would not help.
+                for (std::list<OutstandingMessage>::const_iterator index(requeue.begin()); index != requeue.end(); index++) {
+                    Failure failure = { index->Id, false };
+                    failures.push_back(failure);
+                }
+            }
+            else {
+                _route.Requeue(requeue);
+            }
+
+            _route.Dispatch();
+        }
+
+        parent.Unlock();
+
+        parent.Report(failures);
+    }
+
     /* virtual */ void WebServerImplementation::ProxyMap::OutgoingChannel::Received(Core::ProxyType<Web::Response>& response)
     {
-        // Is response to our front of the list
-        ASSERT(_outstandingMessages.empty() == false);
-        ASSERT(_outstandingMessages.front().Request.IsValid() == false);
+        ProxyMap& parent(_route.Parent());
+        Core::ProxyType<Web::Response> answer;
+        uint32_t id = 0;
 
+        parent.Lock();
+
+        // If it is empty, the request it belongs to, timed out.
         if (_outstandingMessages.empty() == false) {
-            _proxyMap.Submit(_outstandingMessages.front().Id, response);
+            ASSERT(_outstandingMessages.front().Request.IsValid() == false);
+
+            id = _outstandingMessages.front().Id;
+            answer = _route.Completed(_outstandingMessages.front(), response);
             _outstandingMessages.pop_front();
 
-            // See if ther is a next one to send.
-            if (_outstandingMessages.size() > 0) {
+            // This connection can take the next one.
+            _route.Dispatch();
+        }
 
-                ASSERT(_outstandingMessages.front().Request.IsValid() == true);
+        parent.Unlock();
 
-                Submit(_outstandingMessages.front().Request);
-            }
+        if (answer.IsValid() == true) {
+            parent.Submit(id, answer);
         }
     }
 